@@ -37,11 +37,13 @@ typedef struct alsa_thread
    size_t period_size;
    snd_pcm_uframes_t period_frames;
 
-   fifo_buffer_t *buffer;
+   // The worker and the writer share the buffer without a lock. The writer only sleeps on cond
+   // when the buffer is full, and the worker only takes cond_lock to wake it when it says it is waiting.
+   fifo_spsc_t *buffer;
    sthread_t *worker_thread;
-   slock_t *fifo_lock;
    scond_t *cond;
    slock_t *cond_lock;
+   volatile bool writer_waiting;
 } alsa_thread_t;
 
 static void alsa_worker_thread(void *data)
@@ -57,12 +59,16 @@ static void alsa_worker_thread(void *data)
 
    while (!alsa->thread_dead)
    {
-      slock_lock(alsa->fifo_lock);
-      size_t avail = fifo_read_avail(alsa->buffer);
-      size_t fifo_size = min(alsa->period_size, avail);
-      fifo_read(alsa->buffer, buf, fifo_size);
-      scond_signal(alsa->cond);
-      slock_unlock(alsa->fifo_lock);
+      size_t fifo_size = fifo_spsc_read(alsa->buffer, buf, alsa->period_size);
+
+      // Pairs with the barrier in alsa_thread_wait().
+      __sync_synchronize();
+      if (alsa->writer_waiting)
+      {
+         slock_lock(alsa->cond_lock);
+         scond_signal(alsa->cond);
+         slock_unlock(alsa->cond_lock);
+      }
 
       // If underrun, fill rest with silence.
       memset(buf + fifo_size, 0, alsa->period_size - fifo_size);
@@ -124,11 +130,9 @@ static void alsa_thread_free(void *data)
          sthread_join(alsa->worker_thread);
       }
       if (alsa->buffer)
-         fifo_free(alsa->buffer);
+         fifo_spsc_free(alsa->buffer);
       if (alsa->cond)
          scond_free(alsa->cond);
-      if (alsa->fifo_lock)
-         slock_free(alsa->fifo_lock);
       if (alsa->cond_lock)
          slock_free(alsa->cond_lock);
       if (alsa->pcm)
@@ -196,11 +200,10 @@ static void *alsa_thread_init(const char *device, unsigned rate, unsigned latenc
    snd_pcm_hw_params_free(params);
    snd_pcm_sw_params_free(sw_params);
 
-   alsa->fifo_lock = slock_new();
    alsa->cond_lock = slock_new();
    alsa->cond = scond_new();
-   alsa->buffer = fifo_new(alsa->buffer_size);
-   if (!alsa->fifo_lock || !alsa->cond_lock || !alsa->cond || !alsa->buffer)
+   alsa->buffer = fifo_spsc_new(alsa->buffer_size);
+   if (!alsa->cond_lock || !alsa->cond || !alsa->buffer)
       goto error;
 
    alsa->worker_thread = sthread_create(alsa_worker_thread, alsa);
@@ -225,6 +228,21 @@ error:
    return NULL;
 }
 
+// Sleeps until the worker has made room in the buffer, or died.
+static void alsa_thread_wait(alsa_thread_t *alsa)
+{
+   slock_lock(alsa->cond_lock);
+   alsa->writer_waiting = true;
+
+   // Either the worker sees us waiting, or we see the room it made.
+   __sync_synchronize();
+   if (!fifo_spsc_write_avail(alsa->buffer) && !alsa->thread_dead)
+      scond_wait(alsa->cond, alsa->cond_lock);
+
+   alsa->writer_waiting = false;
+   slock_unlock(alsa->cond_lock);
+}
+
 static ssize_t alsa_thread_write(void *data, const void *buf, size_t size)
 {
    alsa_thread_t *alsa = (alsa_thread_t*)data;
@@ -233,37 +251,16 @@ static ssize_t alsa_thread_write(void *data, const void *buf, size_t size)
       return -1;
 
    if (alsa->nonblock)
-   {
-      slock_lock(alsa->fifo_lock);
-      size_t avail = fifo_write_avail(alsa->buffer);
-      size_t write_amt = min(avail, size);
-      fifo_write(alsa->buffer, buf, write_amt);
-      slock_unlock(alsa->fifo_lock);
-      return write_amt;
-   }
+      return fifo_spsc_write(alsa->buffer, buf, size);
    else
    {
       size_t written = 0;
       while (written < size && !alsa->thread_dead)
       {
-         slock_lock(alsa->fifo_lock);
-         size_t avail = fifo_write_avail(alsa->buffer);
-
-         if (avail == 0)
-         {
-            slock_unlock(alsa->fifo_lock);
-            slock_lock(alsa->cond_lock);
-            if (!alsa->thread_dead)
-               scond_wait(alsa->cond, alsa->cond_lock);
-            slock_unlock(alsa->cond_lock);
-         }
-         else
-         {
-            size_t write_amt = min(size - written, avail);
-            fifo_write(alsa->buffer, (const char*)buf + written, write_amt);
-            slock_unlock(alsa->fifo_lock);
-            written += write_amt;
-         }
+         size_t write_amt = fifo_spsc_write(alsa->buffer, (const char*)buf + written, size - written);
+         if (!write_amt)
+            alsa_thread_wait(alsa);
+         written += write_amt;
       }
       return written;
    }
@@ -293,10 +290,7 @@ static size_t alsa_thread_write_avail(void *data)
 
    if (alsa->thread_dead)
       return 0;
-   slock_lock(alsa->fifo_lock);
-   size_t val = fifo_write_avail(alsa->buffer);
-   slock_unlock(alsa->fifo_lock);
-   return val;
+   return fifo_spsc_write_avail(alsa->buffer);
 }
 
 static size_t alsa_thread_buffer_size(void *data)
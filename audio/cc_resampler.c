@@ -138,7 +138,7 @@ static void resampler_CC_free(void *re_)
    (void)re_;
 }
 
-static void *resampler_CC_init(double bandwidth_mod)
+static void *resampler_CC_init(double bandwidth_mod, enum resampler_quality quality, resampler_simd_mask_t mask)
 {
    __asm__ (
          ".set      push\n"
@@ -282,7 +282,7 @@ static void resampler_CC_free(void *re_)
       free(re);
 }
 
-static void *resampler_CC_init(double bandwidth_mod)
+static void *resampler_CC_init(double bandwidth_mod, enum resampler_quality quality, resampler_simd_mask_t mask)
 {
    int i;
    rarch_CC_resampler_t *re = (rarch_CC_resampler_t*)calloc(1, sizeof(rarch_CC_resampler_t));
@@ -7,11 +7,16 @@ filter0 = eq
 # Lower values will allow better frequency resolution, but more ripple.
 # eq_window_beta = 4.0
 
-# The block size on which FFT is done.
-# Too high value requires more processing as well as longer latency but
+# The length of the filter.
+# Too high value requires more processing, but
 # allows finer-grained control over the spectrum.
 # eq_block_size_log2 = 8
 
+# The filter is run in partitions of this size, which sets the latency of the EQ.
+# Lower values give lower latency at some extra processing.
+# Defaults to eq_block_size_log2, and can go as low as 4 (16 frames).
+# eq_partition_size_log2 = 8
+
 # An array of which frequencies to control.
 # You can create an arbitrary amount of these sampling points.
 # The EQ will try to create a frequency response which fits well to these points.
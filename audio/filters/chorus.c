@@ -18,6 +18,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
 #ifndef M_PI
 #define M_PI 3.1415926535897932384626433832795
 #endif
@@ -27,7 +31,7 @@
 
 struct chorus_data
 {
-   float old[2][CHORUS_MAX_DELAY];
+   float old[CHORUS_MAX_DELAY][2]; // Left and right next to each other.
    unsigned old_ptr;
 
    float delay;
@@ -37,6 +41,10 @@ struct chorus_data
    float mix_wet;
    unsigned lfo_ptr;
    unsigned lfo_period;
+
+   // The SIMD versions step the LFO by rotating (lfo_cos, lfo_sin) instead of calling sin() every frame.
+   double lfo_sin, lfo_cos;
+   double lfo_step_sin, lfo_step_cos;
 };
 
 static void chorus_free(void *data)
@@ -68,13 +76,13 @@ static void chorus_process(void *data, struct dspfilter_output *output,
          delay_int = CHORUS_MAX_DELAY - 2;
       float delay_frac = delay - delay_int;
 
-      ch->old[0][ch->old_ptr] = in[0];
-      ch->old[1][ch->old_ptr] = in[1];
+      ch->old[ch->old_ptr][0] = in[0];
+      ch->old[ch->old_ptr][1] = in[1];
 
-      float l_a = ch->old[0][(ch->old_ptr - delay_int - 0) & CHORUS_DELAY_MASK];
-      float l_b = ch->old[0][(ch->old_ptr - delay_int - 1) & CHORUS_DELAY_MASK];
-      float r_a = ch->old[1][(ch->old_ptr - delay_int - 0) & CHORUS_DELAY_MASK];
-      float r_b = ch->old[1][(ch->old_ptr - delay_int - 1) & CHORUS_DELAY_MASK];
+      float l_a = ch->old[(ch->old_ptr - delay_int - 0) & CHORUS_DELAY_MASK][0];
+      float l_b = ch->old[(ch->old_ptr - delay_int - 1) & CHORUS_DELAY_MASK][0];
+      float r_a = ch->old[(ch->old_ptr - delay_int - 0) & CHORUS_DELAY_MASK][1];
+      float r_b = ch->old[(ch->old_ptr - delay_int - 1) & CHORUS_DELAY_MASK][1];
 
       // Lerp introduces aliasing of the chorus component, but doing full polyphase here is probably overkill.
       float chorus_l = l_a * (1.0f - delay_frac) + l_b * delay_frac;
@@ -87,6 +95,69 @@ static void chorus_process(void *data, struct dspfilter_output *output,
    }
 }
 
+#if defined(__SSE__)
+// Returns the current LFO value and moves it one frame ahead.
+// Snaps back to the exact start every period, so rounding in the rotation doesn't build up.
+static inline float chorus_lfo_next(struct chorus_data *ch)
+{
+   float lfo = ch->lfo_sin;
+
+   if (++ch->lfo_ptr >= ch->lfo_period)
+   {
+      ch->lfo_ptr = 0;
+      ch->lfo_sin = 0.0;
+      ch->lfo_cos = 1.0;
+   }
+   else
+   {
+      double s = ch->lfo_sin * ch->lfo_step_cos + ch->lfo_cos * ch->lfo_step_sin;
+      double c = ch->lfo_cos * ch->lfo_step_cos - ch->lfo_sin * ch->lfo_step_sin;
+      ch->lfo_sin = s;
+      ch->lfo_cos = c;
+   }
+
+   return lfo;
+}
+#endif
+
+// The SIMD versions handle left and right in the lanes of one vector.
+#if defined(__SSE__)
+static void chorus_process_sse(void *data, struct dspfilter_output *output,
+      const struct dspfilter_input *input)
+{
+   unsigned i;
+   struct chorus_data *ch = (struct chorus_data*)data;
+
+   output->samples = input->samples;
+   output->frames  = input->frames;
+   float *out = output->samples;
+
+   __m128 mix_dry = _mm_set1_ps(ch->mix_dry);
+   __m128 mix_wet = _mm_set1_ps(ch->mix_wet);
+
+   for (i = 0; i < input->frames; i++, out += 2)
+   {
+      float delay = (ch->delay + ch->depth * chorus_lfo_next(ch)) * ch->input_rate;
+
+      unsigned delay_int = (unsigned)delay;
+      if (delay_int >= CHORUS_MAX_DELAY - 1)
+         delay_int = CHORUS_MAX_DELAY - 2;
+      float delay_frac = delay - delay_int;
+
+      __m128 in = _mm_loadl_pi(_mm_setzero_ps(), (const __m64*)out);
+      _mm_storel_pi((__m64*)ch->old[ch->old_ptr], in);
+
+      __m128 a = _mm_loadl_pi(_mm_setzero_ps(), (const __m64*)ch->old[(ch->old_ptr - delay_int - 0) & CHORUS_DELAY_MASK]);
+      __m128 b = _mm_loadl_pi(_mm_setzero_ps(), (const __m64*)ch->old[(ch->old_ptr - delay_int - 1) & CHORUS_DELAY_MASK]);
+      __m128 chorus = _mm_add_ps(_mm_mul_ps(a, _mm_set1_ps(1.0f - delay_frac)), _mm_mul_ps(b, _mm_set1_ps(delay_frac)));
+
+      _mm_storel_pi((__m64*)out, _mm_add_ps(_mm_mul_ps(mix_dry, in), _mm_mul_ps(mix_wet, chorus)));
+
+      ch->old_ptr = (ch->old_ptr + 1) & CHORUS_DELAY_MASK;
+   }
+}
+#endif
+
 static void *chorus_init(const struct dspfilter_info *info,
       const struct dspfilter_config *config, void *userdata)
 {
@@ -120,6 +191,11 @@ static void *chorus_init(const struct dspfilter_info *info,
    ch->input_rate = info->input_rate;
    if (!ch->lfo_period)
       ch->lfo_period = 1;
+
+   ch->lfo_sin      = 0.0;
+   ch->lfo_cos      = 1.0;
+   ch->lfo_step_sin = sin(2.0 * M_PI / ch->lfo_period);
+   ch->lfo_step_cos = cos(2.0 * M_PI / ch->lfo_period);
    return ch;
 }
 
@@ -133,12 +209,28 @@ static const struct dspfilter_implementation chorus_plug = {
    "chorus",
 };
 
+#if defined(__SSE__)
+static const struct dspfilter_implementation chorus_plug_sse = {
+   chorus_init,
+   chorus_process_sse,
+   chorus_free,
+
+   DSPFILTER_API_VERSION,
+   "Chorus (SSE)",
+   "chorus",
+};
+#endif
+
 #ifdef HAVE_FILTERS_BUILTIN
 #define dspfilter_get_implementation chorus_dspfilter_get_implementation
 #endif
 
 const struct dspfilter_implementation *dspfilter_get_implementation(dspfilter_simd_mask_t mask)
 {
+#if defined(__SSE__)
+   if (mask & DSPFILTER_SIMD_SSE)
+      return &chorus_plug_sse;
+#endif
    (void)mask;
    return &chorus_plug;
 }
@@ -17,6 +17,16 @@
 #include <math.h>
 #include <stdlib.h>
 
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+// The AVX version is built with a target attribute and only picked if the CPU has it.
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define ECHO_HAVE_AVX
+#include <immintrin.h>
+#endif
+
 #ifndef min
 #define min(a, b) ((a) < (b) ? (a) : (b))
 #endif
@@ -91,6 +101,132 @@ static void echo_process(void *data, struct dspfilter_output *output,
    }
 }
 
+#if defined(__SSE__) || defined(ECHO_HAVE_AVX)
+// The SIMD versions work on runs of frames where no channel's delay line wraps around.
+// Within a run every tap reads and writes consecutive samples, and each sample is read before it's overwritten,
+// so left and right of several frames can go through in one vector.
+static unsigned echo_run_frames(const struct echo_data *echo, unsigned frames)
+{
+   unsigned c;
+   for (c = 0; c < echo->num_channels; c++)
+      frames = min(frames, echo->channels[c].frames - echo->channels[c].ptr);
+   return frames;
+}
+
+static void echo_run_scalar(struct echo_data *echo, float *out, unsigned begin, unsigned end)
+{
+   unsigned i, c;
+   for (i = begin; i < end; i++)
+   {
+      float echo_sample = 0.0f;
+      for (c = 0; c < echo->num_channels; c++)
+         echo_sample += echo->channels[c].buffer[(echo->channels[c].ptr << 1) + i];
+      echo_sample *= echo->amp;
+
+      for (c = 0; c < echo->num_channels; c++)
+         echo->channels[c].buffer[(echo->channels[c].ptr << 1) + i] = out[i] + echo->channels[c].feedback * echo_sample;
+
+      out[i] += echo_sample;
+   }
+}
+
+static void echo_advance(struct echo_data *echo, unsigned frames)
+{
+   unsigned c;
+   for (c = 0; c < echo->num_channels; c++)
+   {
+      echo->channels[c].ptr += frames;
+      if (echo->channels[c].ptr >= echo->channels[c].frames)
+         echo->channels[c].ptr = 0;
+   }
+}
+#endif
+
+#if defined(__SSE__)
+static void echo_process_sse(void *data, struct dspfilter_output *output,
+      const struct dspfilter_input *input)
+{
+   unsigned i, c;
+   struct echo_data *echo = (struct echo_data*)data;
+
+   output->samples = input->samples;
+   output->frames  = input->frames;
+
+   float *out = output->samples;
+   unsigned frames = input->frames;
+   __m128 amp = _mm_set1_ps(echo->amp);
+
+   while (frames)
+   {
+      unsigned run = echo_run_frames(echo, frames);
+      unsigned samples = run << 1;
+
+      for (i = 0; i + 4 <= samples; i += 4)
+      {
+         __m128 echo_sample = _mm_setzero_ps();
+         for (c = 0; c < echo->num_channels; c++)
+            echo_sample = _mm_add_ps(echo_sample, _mm_loadu_ps(echo->channels[c].buffer + (echo->channels[c].ptr << 1) + i));
+         echo_sample = _mm_mul_ps(echo_sample, amp);
+
+         __m128 in = _mm_loadu_ps(out + i);
+         for (c = 0; c < echo->num_channels; c++)
+            _mm_storeu_ps(echo->channels[c].buffer + (echo->channels[c].ptr << 1) + i,
+                  _mm_add_ps(in, _mm_mul_ps(_mm_set1_ps(echo->channels[c].feedback), echo_sample)));
+
+         _mm_storeu_ps(out + i, _mm_add_ps(in, echo_sample));
+      }
+      echo_run_scalar(echo, out, i, samples);
+
+      echo_advance(echo, run);
+      out    += samples;
+      frames -= run;
+   }
+}
+#endif
+
+#ifdef ECHO_HAVE_AVX
+__attribute__((target("avx")))
+static void echo_process_avx(void *data, struct dspfilter_output *output,
+      const struct dspfilter_input *input)
+{
+   unsigned i, c;
+   struct echo_data *echo = (struct echo_data*)data;
+
+   output->samples = input->samples;
+   output->frames  = input->frames;
+
+   float *out = output->samples;
+   unsigned frames = input->frames;
+   __m256 amp = _mm256_set1_ps(echo->amp);
+
+   while (frames)
+   {
+      unsigned run = echo_run_frames(echo, frames);
+      unsigned samples = run << 1;
+
+      for (i = 0; i + 8 <= samples; i += 8)
+      {
+         __m256 echo_sample = _mm256_setzero_ps();
+         for (c = 0; c < echo->num_channels; c++)
+            echo_sample = _mm256_add_ps(echo_sample, _mm256_loadu_ps(echo->channels[c].buffer + (echo->channels[c].ptr << 1) + i));
+         echo_sample = _mm256_mul_ps(echo_sample, amp);
+
+         __m256 in = _mm256_loadu_ps(out + i);
+         for (c = 0; c < echo->num_channels; c++)
+            _mm256_storeu_ps(echo->channels[c].buffer + (echo->channels[c].ptr << 1) + i,
+                  _mm256_add_ps(in, _mm256_mul_ps(_mm256_set1_ps(echo->channels[c].feedback), echo_sample)));
+
+         _mm256_storeu_ps(out + i, _mm256_add_ps(in, echo_sample));
+      }
+      echo_run_scalar(echo, out, i, samples);
+
+      echo_advance(echo, run);
+      out    += samples;
+      frames -= run;
+   }
+}
+#endif
+
 static void *echo_init(const struct dspfilter_info *info,
       const struct dspfilter_config *config, void *userdata)
 {
@@ -153,12 +289,44 @@ static const struct dspfilter_implementation echo_plug = {
    "echo",
 };
 
+#if defined(__SSE__)
+static const struct dspfilter_implementation echo_plug_sse = {
+   echo_init,
+   echo_process_sse,
+   echo_free,
+
+   DSPFILTER_API_VERSION,
+   "Multi-Echo (SSE)",
+   "echo",
+};
+#endif
+
+#ifdef ECHO_HAVE_AVX
+static const struct dspfilter_implementation echo_plug_avx = {
+   echo_init,
+   echo_process_avx,
+   echo_free,
+
+   DSPFILTER_API_VERSION,
+   "Multi-Echo (AVX)",
+   "echo",
+};
+#endif
+
 #ifdef HAVE_FILTERS_BUILTIN
 #define dspfilter_get_implementation echo_dspfilter_get_implementation
 #endif
 
 const struct dspfilter_implementation *dspfilter_get_implementation(dspfilter_simd_mask_t mask)
 {
+#ifdef ECHO_HAVE_AVX
+   if (mask & DSPFILTER_SIMD_AVX)
+      return &echo_plug_avx;
+#endif
+#if defined(__SSE__)
+   if (mask & DSPFILTER_SIMD_SSE)
+      return &echo_plug_sse;
+#endif
    (void)mask;
    return &echo_plug;
 }
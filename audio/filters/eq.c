@@ -28,17 +28,26 @@
 #define min(a, b) ((a) < (b) ? (a) : (b))
 #endif
 
+// The filter is split into partitions of block_size taps, and run as a
+// uniformly partitioned overlap-save convolution. Latency is one partition.
 struct eq_data
 {
-   fft_t *fft;
-   float buffer[8 * 1024];
-
-   float *save;
-   float *block;
-   fft_complex_t *filter;
+   fft_t *fft; // Real FFT of 2 * block_size samples.
+   float *buffer;
+   unsigned buffer_frames;
+
+   float *block; // The last 2 * block_size input frames.
+   float *time_block;
+   fft_complex_t *filter; // One spectrum of block_size + 1 bins per partition.
+   fft_complex_t *history; // Spectra of the last num_partitions input blocks, per channel.
    fft_complex_t *fftblock;
    unsigned block_size;
    unsigned block_ptr;
+   unsigned num_partitions;
+   unsigned history_ptr;
+
+   void (*mul_add)(fft_complex_t *out, const fft_complex_t *a,
+         const fft_complex_t *b, unsigned bins);
 };
 
 struct eq_gain
@@ -54,18 +63,92 @@ static void eq_free(void *data)
       return;
 
    fft_free(eq->fft);
-   free(eq->save);
+   free(eq->buffer);
    free(eq->block);
+   free(eq->time_block);
+   free(eq->history);
    free(eq->fftblock);
    free(eq->filter);
    free(eq);
 }
 
+static void eq_mul_add(fft_complex_t *out, const fft_complex_t *a,
+      const fft_complex_t *b, unsigned bins)
+{
+   unsigned i;
+   for (i = 0; i < bins; i++)
+      out[i] = fft_complex_add(out[i], fft_complex_mul(a[i], b[i]));
+}
+
+#if defined(__SSE__)
+static void eq_mul_add_sse(fft_complex_t *out, const fft_complex_t *a,
+      const fft_complex_t *b, unsigned bins)
+{
+   unsigned i;
+   const __m128 sign = _mm_setr_ps(-1.0f, 1.0f, -1.0f, 1.0f);
+
+   for (i = 0; i + 2 <= bins; i += 2)
+   {
+      __m128 va = _mm_loadu_ps((const float*)(a + i));
+      __m128 vb = _mm_loadu_ps((const float*)(b + i));
+      __m128 b_real = _mm_shuffle_ps(vb, vb, _MM_SHUFFLE(2, 2, 0, 0));
+      __m128 b_imag = _mm_shuffle_ps(vb, vb, _MM_SHUFFLE(3, 3, 1, 1));
+      __m128 a_swap = _mm_shuffle_ps(va, va, _MM_SHUFFLE(2, 3, 0, 1));
+
+      __m128 res = _mm_add_ps(_mm_mul_ps(va, b_real),
+            _mm_mul_ps(_mm_mul_ps(a_swap, b_imag), sign));
+      _mm_storeu_ps((float*)(out + i), _mm_add_ps(_mm_loadu_ps((const float*)(out + i)), res));
+   }
+
+   eq_mul_add(out + i, a + i, b + i, bins - i);
+}
+#endif
+
+// Convolves the input block for both channels, and writes block_size frames to out.
+static void eq_convolve(struct eq_data *eq, float *out)
+{
+   unsigned i, p, c;
+   unsigned bins = eq->block_size + 1;
+
+   for (c = 0; c < 2; c++)
+   {
+      fft_complex_t *history = eq->history + c * eq->num_partitions * bins;
+      fft_process_forward_real(eq->fft, history + eq->history_ptr * bins, eq->block + c, 2);
+
+      // Older blocks are further along the history, and meet later partitions of the filter.
+      memset(eq->fftblock, 0, bins * sizeof(*eq->fftblock));
+      for (p = 0; p < eq->num_partitions; p++)
+      {
+         unsigned index = (eq->history_ptr + p) % eq->num_partitions;
+         eq->mul_add(eq->fftblock, history + index * bins, eq->filter + p * bins, bins);
+      }
+
+      // Overlap save, the first half has wrapped around and is discarded.
+      fft_process_inverse_real(eq->fft, eq->time_block, eq->fftblock, 1);
+      for (i = 0; i < eq->block_size; i++)
+         out[2 * i + c] = eq->time_block[eq->block_size + i];
+   }
+
+   eq->history_ptr = (eq->history_ptr + eq->num_partitions - 1) % eq->num_partitions;
+   memcpy(eq->block, eq->block + 2 * eq->block_size, 2 * eq->block_size * sizeof(float));
+}
+
 static void eq_process(void *data, struct dspfilter_output *output,
       const struct dspfilter_input *input)
 {
    struct eq_data *eq = (struct eq_data*)data;
 
+   unsigned max_frames = eq->block_ptr + input->frames;
+   if (max_frames > eq->buffer_frames)
+   {
+      float *buffer = (float*)realloc(eq->buffer, max_frames * 2 * sizeof(float));
+      if (buffer)
+      {
+         eq->buffer = buffer;
+         eq->buffer_frames = max_frames;
+      }
+   }
+
    output->samples = eq->buffer;
    output->frames  = 0;
 
@@ -79,7 +162,7 @@ static void eq_process(void *data, struct dspfilter_output *output,
       if (input_frames < write_avail)
          write_avail = input_frames;
 
-      memcpy(eq->block + eq->block_ptr * 2, in, write_avail * 2 * sizeof(float));
+      memcpy(eq->block + (eq->block_size + eq->block_ptr) * 2, in, write_avail * 2 * sizeof(float));
 
       in += write_avail * 2;
       input_frames -= write_avail;
@@ -88,22 +171,10 @@ static void eq_process(void *data, struct dspfilter_output *output,
       // Convolve a new block.
       if (eq->block_ptr == eq->block_size)
       {
-         unsigned i, c;
-
-         for (c = 0; c < 2; c++)
-         {
-            fft_process_forward(eq->fft, eq->fftblock, eq->block + c, 2);
-            for (i = 0; i < 2 * eq->block_size; i++)
-               eq->fftblock[i] = fft_complex_mul(eq->fftblock[i], eq->filter[i]);
-            fft_process_inverse(eq->fft, out + c, eq->fftblock, 2);
-         }
-
-         // Overlap add method, so add in saved block now.
-         for (i = 0; i < 2 * eq->block_size; i++)
-            out[i] += eq->save[i];
+         if (output->frames + eq->block_size > eq->buffer_frames)
+            break;
 
-         // Save block for later.
-         memcpy(eq->save, out + 2 * eq->block_size, 2 * eq->block_size * sizeof(float));
+         eq_convolve(eq, out);
 
          out += eq->block_size * 2;
          output->frames += eq->block_size;
@@ -220,22 +291,25 @@ static void create_filter(struct eq_data *eq, unsigned size_log2,
       struct eq_gain *gains, unsigned num_gains, double beta, const char *filter_path)
 {
    int i;
-   int half_block_size = eq->block_size >> 1;
+   unsigned p;
+   int filter_size = 1 << size_log2;
+   int half_block_size = filter_size >> 1;
    double window_mod = 1.0 / kaiser_window(0.0, beta);
 
    fft_t *fft = fft_new(size_log2);
-   float *time_filter = (float*)calloc(eq->block_size * 2 + 1, sizeof(*time_filter));
-   if (!fft || !time_filter)
+   fft_complex_t *response = (fft_complex_t*)calloc(filter_size + 1, sizeof(*response));
+   float *time_filter = (float*)calloc(filter_size + 1, sizeof(*time_filter));
+   if (!fft || !response || !time_filter)
       goto end;
 
    // Make sure bands are in correct order.
    qsort(gains, num_gains, sizeof(*gains), gains_cmp);
 
    // Compute desired filter response.
-   generate_response(eq->filter, gains, num_gains, half_block_size);
+   generate_response(response, gains, num_gains, half_block_size);
 
    // Get equivalent time-domain filter.
-   fft_process_inverse(fft, time_filter, eq->filter, 1);
+   fft_process_inverse(fft, time_filter, response, 1);
 
    // ifftshift() to create the correct linear phase filter.
    // The filter response was designed with zero phase, which won't work unless we compensate
@@ -248,10 +322,10 @@ static void create_filter(struct eq_data *eq, unsigned size_log2,
    }
 
    // Apply a window to smooth out the frequency repsonse.
-   for (i = 0; i < (int)eq->block_size; i++)
+   for (i = 0; i < filter_size; i++)
    {
       // Kaiser window.
-      double phase = (double)i / eq->block_size;
+      double phase = (double)i / filter_size;
       phase = 2.0 * (phase - 0.5);
       time_filter[i] *= window_mod * kaiser_window(phase, beta);
    }
@@ -262,24 +336,34 @@ static void create_filter(struct eq_data *eq, unsigned size_log2,
       FILE *file = fopen(filter_path, "w");
       if (file)
       {
-         for (i = 0; i < (int)eq->block_size - 1; i++)
+         for (i = 0; i < filter_size - 1; i++)
             fprintf(file, "%.8f\n", time_filter[i + 1]);
          fclose(file);
       }
    }
 
-   // Padded FFT to create our FFT filter.
+   // Padded FFT of each partition to create our FFT filter.
    // Make our even-length filter odd by discarding the first coefficient.
    // For some interesting reason, this allows us to design an odd-length linear phase filter.
-   fft_process_forward(eq->fft, eq->filter, time_filter + 1, 1);
+   for (p = 0; p < eq->num_partitions; p++)
+   {
+      unsigned start = p * eq->block_size + 1;
+      unsigned taps = min(eq->block_size, filter_size - start);
+
+      memset(eq->block, 0, 2 * eq->block_size * sizeof(float));
+      memcpy(eq->block, time_filter + start, taps * sizeof(float));
+      fft_process_forward_real(eq->fft, eq->filter + p * (eq->block_size + 1), eq->block, 1);
+   }
+   memset(eq->block, 0, 4 * eq->block_size * sizeof(float));
 
 end:
    fft_free(fft);
+   free(response);
    free(time_filter);
 }
 
-static void *eq_init(const struct dspfilter_info *info,
-      const struct dspfilter_config *config, void *userdata)
+static void *eq_new(const struct dspfilter_info *info,
+      const struct dspfilter_config *config, void *userdata, int simd)
 {
    unsigned i;
    struct eq_data *eq = (struct eq_data*)calloc(1, sizeof(*eq));
@@ -296,6 +380,14 @@ static void *eq_init(const struct dspfilter_info *info,
    config->get_int(userdata, "block_size_log2", &size_log2, 8);
    unsigned size = 1 << size_log2;
 
+   int partition_log2;
+   config->get_int(userdata, "partition_size_log2", &partition_log2, size_log2);
+   if (partition_log2 > size_log2)
+      partition_log2 = size_log2;
+   if (partition_log2 < 4)
+      partition_log2 = 4;
+   unsigned partition = 1 << partition_log2;
+
    struct eq_gain *gains = NULL;
    float *frequencies, *gain;
    unsigned num_freq, num_gain;
@@ -323,20 +415,33 @@ static void *eq_init(const struct dspfilter_info *info,
    config->free(frequencies);
    config->free(gain);
 
-   eq->block_size = size;
+   // The filter has size - 1 taps.
+   eq->block_size     = partition;
+   eq->num_partitions = (size - 1 + partition - 1) / partition;
 
-   eq->save     = (float*)calloc(    size, 2 * sizeof(*eq->save));
-   eq->block    = (float*)calloc(2 * size, 2 * sizeof(*eq->block));
-   eq->fftblock = (fft_complex_t*)calloc(2 * size, sizeof(*eq->fftblock));
-   eq->filter   = (fft_complex_t*)calloc(2 * size, sizeof(*eq->filter));
+   eq->block      = (float*)calloc(2 * partition, 2 * sizeof(*eq->block));
+   eq->time_block = (float*)calloc(2 * partition, sizeof(*eq->time_block));
+   eq->fftblock   = (fft_complex_t*)calloc(partition + 1, sizeof(*eq->fftblock));
+   eq->filter     = (fft_complex_t*)calloc(eq->num_partitions * (partition + 1), sizeof(*eq->filter));
+   eq->history    = (fft_complex_t*)calloc(2 * eq->num_partitions * (partition + 1), sizeof(*eq->history));
 
    // Use an FFT which is twice the block size with zero-padding
    // to make circular convolution => proper convolution.
-   eq->fft = fft_new(size_log2 + 1);
+   // A real FFT of 2 * partition samples runs a complex FFT of partition samples.
+   eq->fft = fft_new(partition_log2);
 
-   if (!eq->fft || !eq->fftblock || !eq->save || !eq->block || !eq->filter)
+   if (!eq->fft || !eq->fftblock || !eq->block || !eq->time_block || !eq->filter || !eq->history)
       goto error;
 
+   eq->mul_add = eq_mul_add;
+   if (simd)
+   {
+      fft_set_simd(eq->fft, 1);
+#if defined(__SSE__)
+      eq->mul_add = eq_mul_add_sse;
+#endif
+   }
+
    create_filter(eq, size_log2, gains, num_gain, beta, filter_path);
    config->free(filter_path);
    filter_path = NULL;
@@ -350,6 +455,20 @@ error:
    return NULL;
 }
 
+static void *eq_init(const struct dspfilter_info *info,
+      const struct dspfilter_config *config, void *userdata)
+{
+   return eq_new(info, config, userdata, 0);
+}
+
+#if defined(__SSE__)
+static void *eq_init_simd(const struct dspfilter_info *info,
+      const struct dspfilter_config *config, void *userdata)
+{
+   return eq_new(info, config, userdata, 1);
+}
+#endif
+
 static const struct dspfilter_implementation eq_plug = {
    eq_init,
    eq_process,
@@ -360,12 +479,28 @@ static const struct dspfilter_implementation eq_plug = {
    "eq",
 };
 
+#if defined(__SSE__)
+static const struct dspfilter_implementation eq_plug_sse = {
+   eq_init_simd,
+   eq_process,
+   eq_free,
+
+   DSPFILTER_API_VERSION,
+   "Linear-Phase FFT Equalizer (SSE)",
+   "eq",
+};
+#endif
+
 #ifdef HAVE_FILTERS_BUILTIN
 #define dspfilter_get_implementation eq_dspfilter_get_implementation
 #endif
 
 const struct dspfilter_implementation *dspfilter_get_implementation(dspfilter_simd_mask_t mask)
 {
+#if defined(__SSE__)
+   if (mask & DSPFILTER_SIMD_SSE)
+      return &eq_plug_sse;
+#endif
    (void)mask;
    return &eq_plug;
 }
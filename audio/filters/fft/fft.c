@@ -17,6 +17,10 @@
 #include <math.h>
 #include <stdlib.h>
 
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
 #ifndef M_PI
 #define M_PI 3.1415926535897932384626433832795
 #endif
@@ -25,8 +29,10 @@ struct fft
 {
    fft_complex_t *interleave_buffer;
    fft_complex_t *phase_lut;
+   fft_complex_t *twiddles; // Forward twiddles of every butterfly pass, back to back.
    unsigned *bitinverse_buffer;
    unsigned size;
+   int simd;
 };
 
 static unsigned bitswap(unsigned x, unsigned size_log2)
@@ -60,6 +66,14 @@ static void build_phase_lut(fft_complex_t *out, int size)
       out[i] = exp_imag((M_PI * i) / size);
 }
 
+static void build_twiddles(fft_complex_t *out, unsigned size)
+{
+   unsigned i, step_size;
+   for (step_size = 1; step_size < size; step_size <<= 1)
+      for (i = 0; i < step_size; i++)
+         *out++ = exp_imag((-M_PI * i) / step_size);
+}
+
 static void interleave_complex(const unsigned *bitinverse,
       fft_complex_t *out, const fft_complex_t *in,
       unsigned samples, unsigned step)
@@ -101,14 +115,16 @@ fft_t *fft_new(unsigned block_size_log2)
    fft->interleave_buffer = (fft_complex_t*)calloc(size, sizeof(*fft->interleave_buffer));
    fft->bitinverse_buffer = (unsigned*)calloc(size, sizeof(*fft->bitinverse_buffer));
    fft->phase_lut         = (fft_complex_t*)calloc(2 * size + 1, sizeof(*fft->phase_lut));
+   fft->twiddles          = (fft_complex_t*)calloc(size, sizeof(*fft->twiddles));
 
-   if (!fft->interleave_buffer || !fft->bitinverse_buffer || !fft->phase_lut)
+   if (!fft->interleave_buffer || !fft->bitinverse_buffer || !fft->phase_lut || !fft->twiddles)
       goto error;
 
    fft->size = size;
 
    build_bitinverse(fft->bitinverse_buffer, block_size_log2);
    build_phase_lut(fft->phase_lut, size);
+   build_twiddles(fft->twiddles, size);
    return fft;
 
 error:
@@ -124,9 +140,15 @@ void fft_free(fft_t *fft)
    free(fft->interleave_buffer);
    free(fft->bitinverse_buffer);
    free(fft->phase_lut);
+   free(fft->twiddles);
    free(fft);
 }
 
+void fft_set_simd(fft_t *fft, int enable)
+{
+   fft->simd = enable;
+}
+
 static void butterfly(fft_complex_t *a, fft_complex_t *b, fft_complex_t mod)
 {
    mod = fft_complex_mul(mod, *b);
@@ -135,62 +157,182 @@ static void butterfly(fft_complex_t *a, fft_complex_t *b, fft_complex_t mod)
 }
 
 static void butterflies(fft_complex_t *butterfly_buf,
-      const fft_complex_t *phase_lut,
-      int phase_dir, unsigned step_size, unsigned samples)
+      const fft_complex_t *twiddles,
+      int inverse, unsigned step_size, unsigned samples)
 {
    unsigned i, j;
+
+   // First pass only has a twiddle of 1.
+   if (step_size == 1)
+   {
+      for (i = 0; i < samples; i += 2)
+      {
+         fft_complex_t a = butterfly_buf[i];
+         fft_complex_t b = butterfly_buf[i + 1];
+         butterfly_buf[i]     = fft_complex_add(a, b);
+         butterfly_buf[i + 1] = fft_complex_sub(a, b);
+      }
+      return;
+   }
+
    for (i = 0; i < samples; i += step_size << 1)
    {
-      int phase_step = (int)samples * phase_dir / (int)step_size;
-      for (j = i; j < i + step_size; j++)
-         butterfly(&butterfly_buf[j], &butterfly_buf[j + step_size], phase_lut[phase_step * (int)(j - i)]);
+      for (j = 0; j < step_size; j++)
+      {
+         fft_complex_t mod = inverse ? fft_complex_conj(twiddles[j]) : twiddles[j];
+         butterfly(&butterfly_buf[i + j], &butterfly_buf[i + j + step_size], mod);
+      }
    }
 }
 
-void fft_process_forward_complex(fft_t *fft,
-      fft_complex_t *out, const fft_complex_t *in, unsigned step)
+// The SIMD versions do two butterflies per vector, so they start from the second pass.
+#if defined(__SSE__)
+static void butterflies_sse(fft_complex_t *butterfly_buf,
+      const fft_complex_t *twiddles,
+      int inverse, unsigned step_size, unsigned samples)
 {
-   unsigned step_size;
-   unsigned samples = fft->size;
-   interleave_complex(fft->bitinverse_buffer, out, in, samples, step);
+   unsigned i, j;
+   const __m128 conj = inverse ? _mm_setr_ps(1.0f, -1.0f, 1.0f, -1.0f) : _mm_set1_ps(1.0f);
+   const __m128 sign = _mm_setr_ps(-1.0f, 1.0f, -1.0f, 1.0f);
 
-   for (step_size = 1; step_size < samples; step_size <<= 1)
+   for (i = 0; i < samples; i += step_size << 1)
    {
-      butterflies(out,
-            fft->phase_lut + samples,
-            -1, step_size, samples);
+      float *a_ptr = (float*)(butterfly_buf + i);
+      float *b_ptr = (float*)(butterfly_buf + i + step_size);
+      const float *w_ptr = (const float*)twiddles;
+
+      for (j = 0; j < step_size; j += 2, a_ptr += 4, b_ptr += 4, w_ptr += 4)
+      {
+         __m128 w = _mm_mul_ps(_mm_loadu_ps(w_ptr), conj);
+         __m128 a = _mm_loadu_ps(a_ptr);
+         __m128 b = _mm_loadu_ps(b_ptr);
+
+         __m128 w_real = _mm_shuffle_ps(w, w, _MM_SHUFFLE(2, 2, 0, 0));
+         __m128 w_imag = _mm_shuffle_ps(w, w, _MM_SHUFFLE(3, 3, 1, 1));
+         __m128 b_swap = _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 3, 0, 1));
+
+         __m128 mod = _mm_add_ps(_mm_mul_ps(b, w_real),
+               _mm_mul_ps(_mm_mul_ps(b_swap, w_imag), sign));
+
+         _mm_storeu_ps(b_ptr, _mm_sub_ps(a, mod));
+         _mm_storeu_ps(a_ptr, _mm_add_ps(a, mod));
+      }
    }
 }
+#endif
 
-void fft_process_forward(fft_t *fft,
-      fft_complex_t *out, const float *in, unsigned step)
+static void run_butterflies(fft_t *fft, fft_complex_t *butterfly_buf, int inverse)
 {
    unsigned step_size;
    unsigned samples = fft->size;
-   interleave_float(fft->bitinverse_buffer, out, in, samples, step);
+   const fft_complex_t *twiddles = fft->twiddles;
 
-   for (step_size = 1; step_size < fft->size; step_size <<= 1)
+   for (step_size = 1; step_size < samples; twiddles += step_size, step_size <<= 1)
    {
-      butterflies(out,
-            fft->phase_lut + samples,
-            -1, step_size, samples);
+#if defined(__SSE__)
+      if (fft->simd && step_size > 1)
+      {
+         butterflies_sse(butterfly_buf, twiddles, inverse, step_size, samples);
+         continue;
+      }
+#endif
+      butterflies(butterfly_buf, twiddles, inverse, step_size, samples);
    }
 }
 
+void fft_process_forward_complex(fft_t *fft,
+      fft_complex_t *out, const fft_complex_t *in, unsigned step)
+{
+   interleave_complex(fft->bitinverse_buffer, out, in, fft->size, step);
+   run_butterflies(fft, out, 0);
+}
+
+void fft_process_forward(fft_t *fft,
+      fft_complex_t *out, const float *in, unsigned step)
+{
+   interleave_float(fft->bitinverse_buffer, out, in, fft->size, step);
+   run_butterflies(fft, out, 0);
+}
+
 void fft_process_inverse(fft_t *fft,
       float *out, const fft_complex_t *in, unsigned step)
 {
-   unsigned step_size;
    unsigned samples = fft->size;
    interleave_complex(fft->bitinverse_buffer, fft->interleave_buffer, in, samples, 1);
+   run_butterflies(fft, fft->interleave_buffer, 1);
+   resolve_float(out, fft->interleave_buffer, samples, 1.0f / samples, step);
+}
 
-   for (step_size = 1; step_size < samples; step_size <<= 1)
+// The real transforms pack even samples into the real part and odd samples
+// into the imaginary part of a half-size complex FFT.
+// Bin k and size - k of the result share the same inputs, so they are split apart in pairs.
+void fft_process_forward_real(fft_t *fft,
+      fft_complex_t *out, const float *in, unsigned step)
+{
+   unsigned i;
+   unsigned samples = fft->size;
+   const fft_complex_t *phase_lut = fft->phase_lut + samples;
+
+   for (i = 0; i < samples; i++, in += 2 * step)
    {
-      butterflies(fft->interleave_buffer,
-            fft->phase_lut + samples,
-            1, step_size, samples);
+      fft_complex_t *packed = &out[fft->bitinverse_buffer[i]];
+      packed->real = in[0];
+      packed->imag = in[step];
    }
 
-   resolve_float(out, fft->interleave_buffer, samples, 1.0f / samples, step);
+   run_butterflies(fft, out, 0);
+
+   out[samples] = out[0];
+   for (i = 0; i <= samples >> 1; i++)
+   {
+      fft_complex_t z   = out[i];
+      fft_complex_t z_n = fft_complex_conj(out[samples - i]);
+
+      // even = (z + z_n) / 2, odd = (z - z_n) / 2i, X[i] = even + W^i * odd.
+      fft_complex_t even = { 0.5f * (z.real + z_n.real), 0.5f * (z.imag + z_n.imag) };
+      fft_complex_t odd  = { 0.5f * (z.imag - z_n.imag), 0.5f * (z_n.real - z.real) };
+      odd = fft_complex_mul(odd, phase_lut[-(int)i]);
+
+      out[samples - i] = fft_complex_conj(fft_complex_sub(even, odd));
+      out[i] = fft_complex_add(even, odd);
+   }
 }
 
+void fft_process_inverse_real(fft_t *fft,
+      float *out, const fft_complex_t *in, unsigned step)
+{
+   unsigned i;
+   unsigned samples = fft->size;
+   const fft_complex_t *phase_lut = fft->phase_lut + samples;
+   fft_complex_t *buf = fft->interleave_buffer;
+   float gain = 1.0f / samples;
+
+   for (i = 0; i <= samples >> 1; i++)
+   {
+      fft_complex_t x   = in[i];
+      fft_complex_t x_n = fft_complex_conj(in[samples - i]);
+
+      // Undo the split: z = even + i * odd, with odd = (x - x_n) / 2 * W^-i.
+      fft_complex_t even = { 0.5f * (x.real + x_n.real), 0.5f * (x.imag + x_n.imag) };
+      fft_complex_t odd  = { 0.5f * (x.real - x_n.real), 0.5f * (x.imag - x_n.imag) };
+      odd = fft_complex_mul(odd, phase_lut[i]);
+
+      fft_complex_t z = { even.real - odd.imag, even.imag + odd.real };
+      buf[fft->bitinverse_buffer[i]] = z;
+
+      if (i)
+      {
+         // Bin size - i is conj(even) + i * conj(odd).
+         fft_complex_t z_n = { even.real + odd.imag, odd.real - even.imag };
+         buf[fft->bitinverse_buffer[samples - i]] = z_n;
+      }
+   }
+
+   run_butterflies(fft, buf, 1);
+
+   for (i = 0; i < samples; i++, out += 2 * step)
+   {
+      out[0]    = gain * buf[i].real;
+      out[step] = gain * buf[i].imag;
+   }
+}
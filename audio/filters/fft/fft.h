@@ -74,6 +74,9 @@ fft_t *fft_new(unsigned block_size_log2);
 
 void fft_free(fft_t *fft);
 
+// Lets the butterflies use SSE, when built with it.
+void fft_set_simd(fft_t *fft, int enable);
+
 void fft_process_forward_complex(fft_t *fft,
       fft_complex_t *out, const fft_complex_t *in, unsigned step);
 
@@ -83,6 +86,14 @@ void fft_process_forward(fft_t *fft,
 void fft_process_inverse(fft_t *fft,
       float *out, const fft_complex_t *in, unsigned step);
 
+// Transforms of 2 * size real samples, where size is what the FFT was created with.
+// The spectrum is given as its size + 1 non-negative frequency bins.
+void fft_process_forward_real(fft_t *fft,
+      fft_complex_t *out, const float *in, unsigned step);
+
+void fft_process_inverse_real(fft_t *fft,
+      float *out, const fft_complex_t *in, unsigned step);
+
 
 #endif
 
@@ -19,6 +19,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
 #ifndef M_PI
 #define M_PI		3.1415926535897932384626433832795
 #endif
@@ -71,7 +75,6 @@ static void iir_process(void *data, struct dspfilter_output *output,
    float b0 = iir->b0;
    float b1 = iir->b1;
    float b2 = iir->b2;
-   float a0 = iir->a0;
    float a1 = iir->a1;
    float a2 = iir->a2;
 
@@ -90,8 +93,8 @@ static void iir_process(void *data, struct dspfilter_output *output,
       float in_l = out[0];
       float in_r = out[1];
 
-      float l = (b0 * in_l + b1 * xn1_l + b2 * xn2_l - a1 * yn1_l - a2 * yn2_l) / a0;
-      float r = (b0 * in_r + b1 * xn1_r + b2 * xn2_r - a1 * yn1_r - a2 * yn2_r) / a0;
+      float l = b0 * in_l + b1 * xn1_l + b2 * xn2_l - a1 * yn1_l - a2 * yn2_l;
+      float r = b0 * in_r + b1 * xn1_r + b2 * xn2_r - a1 * yn1_r - a2 * yn2_r;
 
       xn2_l = xn1_l;
       xn1_l = in_l;
@@ -118,6 +121,64 @@ static void iir_process(void *data, struct dspfilter_output *output,
    iir->r.yn2 = yn2_r;
 }
 
+// The SIMD versions run both channels in the lanes of one vector.
+#if defined(__SSE__)
+static void iir_process_sse(void *data, struct dspfilter_output *output,
+      const struct dspfilter_input *input)
+{
+   unsigned i;
+   struct iir_data *iir = (struct iir_data*)data;
+
+   output->samples = input->samples;
+   output->frames  = input->frames;
+
+   float *out = output->samples;
+
+   __m128 b0 = _mm_set1_ps(iir->b0);
+   __m128 b1 = _mm_set1_ps(iir->b1);
+   __m128 b2 = _mm_set1_ps(iir->b2);
+   __m128 a1 = _mm_set1_ps(iir->a1);
+   __m128 a2 = _mm_set1_ps(iir->a2);
+
+   __m128 xn1 = _mm_setr_ps(iir->l.xn1, iir->r.xn1, 0.0f, 0.0f);
+   __m128 xn2 = _mm_setr_ps(iir->l.xn2, iir->r.xn2, 0.0f, 0.0f);
+   __m128 yn1 = _mm_setr_ps(iir->l.yn1, iir->r.yn1, 0.0f, 0.0f);
+   __m128 yn2 = _mm_setr_ps(iir->l.yn2, iir->r.yn2, 0.0f, 0.0f);
+
+   for (i = 0; i < input->frames; i++, out += 2)
+   {
+      __m128 in = _mm_loadl_pi(_mm_setzero_ps(), (const __m64*)out);
+
+      // Leave a1 * yn1 for last, it's the only term waiting on the previous frame.
+      __m128 res = _mm_add_ps(_mm_mul_ps(b0, in), _mm_mul_ps(b1, xn1));
+      res = _mm_sub_ps(_mm_add_ps(res, _mm_mul_ps(b2, xn2)), _mm_mul_ps(a2, yn2));
+      res = _mm_sub_ps(res, _mm_mul_ps(a1, yn1));
+
+      xn2 = xn1;
+      xn1 = in;
+      yn2 = yn1;
+      yn1 = res;
+
+      _mm_storel_pi((__m64*)out, res);
+   }
+
+   float state[4][4];
+   _mm_storeu_ps(state[0], xn1);
+   _mm_storeu_ps(state[1], xn2);
+   _mm_storeu_ps(state[2], yn1);
+   _mm_storeu_ps(state[3], yn2);
+
+   iir->l.xn1 = state[0][0];
+   iir->r.xn1 = state[0][1];
+   iir->l.xn2 = state[1][0];
+   iir->r.xn2 = state[1][1];
+   iir->l.yn1 = state[2][0];
+   iir->r.yn1 = state[2][1];
+   iir->l.yn2 = state[3][0];
+   iir->r.yn2 = state[3][1];
+}
+#endif
+
 #define CHECK(x) if (!strcmp(str, #x)) return x
 static enum IIRFilter str_to_type(const char *str)
 {
@@ -305,12 +366,13 @@ static void iir_filter_init(struct iir_data *iir,
          break;
    }
 
-   iir->b0 = b0;
-   iir->b1 = b1;
-   iir->b2 = b2;
-   iir->a0 = a0;
-   iir->a1 = a1;
-   iir->a2 = a2;
+   // Normalize so processing doesn't have to divide by a0.
+   iir->b0 = b0 / a0;
+   iir->b1 = b1 / a0;
+   iir->b2 = b2 / a0;
+   iir->a0 = 1.0f;
+   iir->a1 = a1 / a0;
+   iir->a2 = a2 / a0;
 }
 
 static void *iir_init(const struct dspfilter_info *info,
@@ -345,12 +407,28 @@ static const struct dspfilter_implementation iir_plug = {
    "iir",
 };
 
+#if defined(__SSE__)
+static const struct dspfilter_implementation iir_plug_sse = {
+   iir_init,
+   iir_process_sse,
+   iir_free,
+
+   DSPFILTER_API_VERSION,
+   "IIR (SSE)",
+   "iir",
+};
+#endif
+
 #ifdef HAVE_FILTERS_BUILTIN
 #define dspfilter_get_implementation iir_dspfilter_get_implementation
 #endif
 
 const struct dspfilter_implementation *dspfilter_get_implementation(dspfilter_simd_mask_t mask)
 {
+#if defined(__SSE__)
+   if (mask & DSPFILTER_SIMD_SSE)
+      return &iir_plug_sse;
+#endif
    (void)mask;
    return &iir_plug;
 }
@@ -19,6 +19,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
 struct comb
 {
    float *buffer;
@@ -94,6 +98,9 @@ static const float freezemode = 0.5f;
 #define allpasstuningL2 441
 #define allpasstuningL3 341
 #define allpasstuningL4 225
+#define combtuningtotal (combtuningL1 + combtuningL2 + combtuningL3 + combtuningL4 + \
+      combtuningL5 + combtuningL6 + combtuningL7 + combtuningL8)
+#define allpasstuningtotal (allpasstuningL1 + allpasstuningL2 + allpasstuningL3 + allpasstuningL4)
 
 struct revmodel
 {
@@ -258,13 +265,9 @@ static void reverb_process(void *data, struct dspfilter_output *output,
    }
 }
 
-static void *reverb_init(const struct dspfilter_info *info,
+static void reverb_configure(struct revmodel *rev,
       const struct dspfilter_config *config, void *userdata)
 {
-   struct reverb_data *rev = (struct reverb_data*)calloc(1, sizeof(*rev));
-   if (!rev)
-      return NULL;
-
    float drytime, wettime, damping, roomwidth, roomsize;
    config->get_float(userdata, "drytime", &drytime, 0.43f);
    config->get_float(userdata, "wettime", &wettime, 0.4f);
@@ -272,24 +275,205 @@ static void *reverb_init(const struct dspfilter_info *info,
    config->get_float(userdata, "roomwidth", &roomwidth, 0.56f);
    config->get_float(userdata, "roomsize", &roomsize, 0.56f);
 
-   revmodel_init(&rev->left);
-   revmodel_init(&rev->right);
+   revmodel_init(rev);
+
+   revmodel_setdamp(rev, damping);
+   revmodel_setdry(rev, drytime);
+   revmodel_setwet(rev, wettime);
+   revmodel_setwidth(rev, roomwidth);
+   revmodel_setroomsize(rev, roomsize);
+}
+
+static void *reverb_init(const struct dspfilter_info *info,
+      const struct dspfilter_config *config, void *userdata)
+{
+   struct reverb_data *rev = (struct reverb_data*)calloc(1, sizeof(*rev));
+   if (!rev)
+      return NULL;
+
+   reverb_configure(&rev->left, config, userdata);
+   reverb_configure(&rev->right, config, userdata);
+
+   return rev;
+}
+
+#if defined(__SSE__)
+// Left and right share tunings and settings, so the SIMD versions keep both channels of a comb or allpass
+// interleaved in one buffer, and run them as a pair of lanes.
+// Combs are independent of each other, so two of them go in each vector.
+// Four per AVX vector was tried, but gathering and scattering the pairs made it slower than SSE.
+struct reverb_lanes
+{
+   float *comb[numcombs];
+   unsigned combsize[numcombs];
+   unsigned combidx[numcombs];
+   float filterstore[numcombs][2];
+
+   float *allpass[numallpasses];
+   unsigned allpasssize[numallpasses];
+   unsigned allpassidx[numallpasses];
+
+   float gain;
+   float feedback;
+   float damp1, damp2;
+   float allpassfeedback;
+   float dry, wet1;
 
-   revmodel_setdamp(&rev->left, damping);
-   revmodel_setdry(&rev->left, drytime);
-   revmodel_setwet(&rev->left, wettime);
-   revmodel_setwidth(&rev->left, roomwidth);
-   revmodel_setroomsize(&rev->left, roomsize);
+   float bufcomb[2 * combtuningtotal];
+   float bufallpass[2 * allpasstuningtotal];
+};
+
+static void *reverb_lanes_init(const struct dspfilter_info *info,
+      const struct dspfilter_config *config, void *userdata)
+{
+   unsigned i;
+   struct reverb_lanes *rev = (struct reverb_lanes*)calloc(1, sizeof(*rev));
+   struct revmodel *model = (struct revmodel*)calloc(1, sizeof(*model));
+   if (!rev || !model)
+   {
+      free(rev);
+      free(model);
+      return NULL;
+   }
+
+   reverb_configure(model, config, userdata);
+
+   float *buf = rev->bufcomb;
+   for (i = 0; i < numcombs; i++)
+   {
+      rev->comb[i]     = buf;
+      rev->combsize[i] = model->combL[i].bufsize;
+      buf += 2 * model->combL[i].bufsize;
+   }
+
+   buf = rev->bufallpass;
+   for (i = 0; i < numallpasses; i++)
+   {
+      rev->allpass[i]     = buf;
+      rev->allpasssize[i] = model->allpassL[i].bufsize;
+      buf += 2 * model->allpassL[i].bufsize;
+   }
 
-   revmodel_setdamp(&rev->right, damping);
-   revmodel_setdry(&rev->right, drytime);
-   revmodel_setwet(&rev->right, wettime);
-   revmodel_setwidth(&rev->right, roomwidth);
-   revmodel_setroomsize(&rev->right, roomsize);
+   rev->gain            = model->gain;
+   rev->feedback        = model->combL[0].feedback;
+   rev->damp1           = model->combL[0].damp1;
+   rev->damp2           = model->combL[0].damp2;
+   rev->allpassfeedback = model->allpassL[0].feedback;
+   rev->dry             = model->dry;
+   rev->wet1            = model->wet1;
 
+   free(model);
    return rev;
 }
 
+// Frames until the first comb or allpass wraps around. Within that, every delay line moves linearly.
+static unsigned reverb_lanes_run(const struct reverb_lanes *rev, unsigned frames)
+{
+   unsigned i;
+   for (i = 0; i < numcombs; i++)
+      if (rev->combsize[i] - rev->combidx[i] < frames)
+         frames = rev->combsize[i] - rev->combidx[i];
+   for (i = 0; i < numallpasses; i++)
+      if (rev->allpasssize[i] - rev->allpassidx[i] < frames)
+         frames = rev->allpasssize[i] - rev->allpassidx[i];
+   return frames;
+}
+
+static void reverb_lanes_advance(struct reverb_lanes *rev, unsigned frames)
+{
+   unsigned i;
+   for (i = 0; i < numcombs; i++)
+   {
+      rev->combidx[i] += frames;
+      if (rev->combidx[i] >= rev->combsize[i])
+         rev->combidx[i] = 0;
+   }
+   for (i = 0; i < numallpasses; i++)
+   {
+      rev->allpassidx[i] += frames;
+      if (rev->allpassidx[i] >= rev->allpasssize[i])
+         rev->allpassidx[i] = 0;
+   }
+}
+#endif
+
+#if defined(__SSE__)
+static void reverb_process_sse(void *data, struct dspfilter_output *output,
+      const struct dspfilter_input *input)
+{
+   unsigned i, c;
+   struct reverb_lanes *rev = (struct reverb_lanes*)data;
+
+   output->samples = input->samples;
+   output->frames  = input->frames;
+   float *out = output->samples;
+   unsigned frames = input->frames;
+
+   __m128 gain            = _mm_set1_ps(rev->gain);
+   __m128 feedback        = _mm_set1_ps(rev->feedback);
+   __m128 damp1           = _mm_set1_ps(rev->damp1);
+   __m128 damp2           = _mm_set1_ps(rev->damp2);
+   __m128 allpassfeedback = _mm_set1_ps(rev->allpassfeedback);
+   __m128 dry             = _mm_set1_ps(rev->dry);
+   __m128 wet1            = _mm_set1_ps(rev->wet1);
+
+   __m128 filterstore[numcombs / 2];
+   for (c = 0; c < numcombs / 2; c++)
+      filterstore[c] = _mm_loadu_ps(rev->filterstore[2 * c]);
+
+   while (frames)
+   {
+      unsigned run = reverb_lanes_run(rev, frames);
+
+      float *comb[numcombs], *allpass[numallpasses];
+      for (c = 0; c < numcombs; c++)
+         comb[c] = rev->comb[c] + 2 * rev->combidx[c];
+      for (c = 0; c < numallpasses; c++)
+         allpass[c] = rev->allpass[c] + 2 * rev->allpassidx[c];
+
+      for (i = 0; i < run; i++, out += 2)
+      {
+         __m128 in = _mm_loadl_pi(_mm_setzero_ps(), (const __m64*)out);
+         __m128 comb_in = _mm_mul_ps(_mm_movelh_ps(in, in), gain);
+         __m128 sum = _mm_setzero_ps();
+
+         for (c = 0; c < numcombs / 2; c++)
+         {
+            float *lo = comb[2 * c + 0] + 2 * i;
+            float *hi = comb[2 * c + 1] + 2 * i;
+
+            __m128 comb_out = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (const __m64*)lo), (const __m64*)hi);
+            filterstore[c] = _mm_add_ps(_mm_mul_ps(comb_out, damp2), _mm_mul_ps(filterstore[c], damp1));
+
+            __m128 res = _mm_add_ps(comb_in, _mm_mul_ps(filterstore[c], feedback));
+            _mm_storel_pi((__m64*)lo, res);
+            _mm_storeh_pi((__m64*)hi, res);
+
+            sum = _mm_add_ps(sum, comb_out);
+         }
+
+         __m128 mono = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+
+         for (c = 0; c < numallpasses; c++)
+         {
+            float *ptr = allpass[c] + 2 * i;
+            __m128 bufout = _mm_loadl_pi(_mm_setzero_ps(), (const __m64*)ptr);
+            _mm_storel_pi((__m64*)ptr, _mm_add_ps(mono, _mm_mul_ps(bufout, allpassfeedback)));
+            mono = _mm_sub_ps(bufout, mono);
+         }
+
+         _mm_storel_pi((__m64*)out, _mm_add_ps(_mm_mul_ps(in, dry), _mm_mul_ps(mono, wet1)));
+      }
+
+      reverb_lanes_advance(rev, run);
+      frames -= run;
+   }
+
+   for (c = 0; c < numcombs / 2; c++)
+      _mm_storeu_ps(rev->filterstore[2 * c], filterstore[c]);
+}
+#endif
+
 static const struct dspfilter_implementation reverb_plug = {
    reverb_init,
    reverb_process,
@@ -300,12 +484,28 @@ static const struct dspfilter_implementation reverb_plug = {
    "reverb",
 };
 
+#if defined(__SSE__)
+static const struct dspfilter_implementation reverb_plug_sse = {
+   reverb_lanes_init,
+   reverb_process_sse,
+   reverb_free,
+
+   DSPFILTER_API_VERSION,
+   "Reverb (SSE)",
+   "reverb",
+};
+#endif
+
 #ifdef HAVE_FILTERS_BUILTIN
 #define dspfilter_get_implementation reverb_dspfilter_get_implementation
 #endif
 
 const struct dspfilter_implementation *dspfilter_get_implementation(dspfilter_simd_mask_t mask)
 {
+#if defined(__SSE__)
+   if (mask & DSPFILTER_SIMD_SSE)
+      return &reverb_plug_sse;
+#endif
    (void)mask;
    return &reverb_plug;
 }
@@ -0,0 +1,200 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ * 
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pipeline_thread.h"
+#include "../thread.h"
+#include "../fifo_buffer.h"
+#include <stdlib.h>
+
+struct rarch_audio_pipeline
+{
+   fifo_buffer_t *buffer;
+   rarch_audio_pipeline_process_t process;
+
+   sthread_t *thread;
+   slock_t *lock; // Protects buffer and the flags below.
+   scond_t *cond;
+   slock_t *process_lock;
+
+   int16_t *process_buf;
+   size_t process_samples;
+
+   bool nonblock;
+   bool stopped;
+   bool failed;
+   bool quit;
+};
+
+static void pipeline_thread(void *data)
+{
+   rarch_audio_pipeline_t *pipe = (rarch_audio_pipeline_t*)data;
+
+   slock_lock(pipe->lock);
+   while (!pipe->quit)
+   {
+      size_t avail = fifo_read_avail(pipe->buffer);
+      if (!avail)
+      {
+         scond_wait(pipe->cond, pipe->lock);
+         continue;
+      }
+
+      size_t size = pipe->process_samples * sizeof(int16_t);
+      if (size > avail)
+         size = avail;
+      fifo_read(pipe->buffer, pipe->process_buf, size);
+
+      // Only the emulation thread can be waiting on us here.
+      scond_signal(pipe->cond);
+      slock_unlock(pipe->lock);
+
+      // The driver can't be stopped while we hold process_lock,
+      // so it's either still running here or we drop the samples.
+      bool ret = true;
+      slock_lock(pipe->process_lock);
+      slock_lock(pipe->lock);
+      bool stopped = pipe->stopped;
+      slock_unlock(pipe->lock);
+      if (!stopped)
+         ret = pipe->process(pipe->process_buf, size / sizeof(int16_t));
+      slock_unlock(pipe->process_lock);
+
+      slock_lock(pipe->lock);
+      if (!ret)
+      {
+         pipe->failed = true;
+         scond_signal(pipe->cond);
+      }
+   }
+   slock_unlock(pipe->lock);
+}
+
+rarch_audio_pipeline_t *rarch_audio_pipeline_new(size_t samples, rarch_audio_pipeline_process_t process)
+{
+   rarch_audio_pipeline_t *pipe = (rarch_audio_pipeline_t*)calloc(1, sizeof(*pipe));
+   if (!pipe)
+      return NULL;
+
+   pipe->process         = process;
+   pipe->process_samples = samples;
+   pipe->buffer          = fifo_new(samples * sizeof(int16_t));
+   pipe->process_buf     = (int16_t*)malloc(samples * sizeof(int16_t));
+   pipe->lock            = slock_new();
+   pipe->process_lock    = slock_new();
+   pipe->cond            = scond_new();
+
+   if (!pipe->buffer || !pipe->process_buf || !pipe->lock || !pipe->process_lock || !pipe->cond)
+      goto error;
+
+   pipe->thread = sthread_create(pipeline_thread, pipe);
+   if (!pipe->thread)
+      goto error;
+
+   return pipe;
+
+error:
+   rarch_audio_pipeline_free(pipe);
+   return NULL;
+}
+
+void rarch_audio_pipeline_free(rarch_audio_pipeline_t *pipe)
+{
+   if (!pipe)
+      return;
+
+   if (pipe->thread)
+   {
+      slock_lock(pipe->lock);
+      pipe->quit = true;
+      scond_signal(pipe->cond);
+      slock_unlock(pipe->lock);
+      sthread_join(pipe->thread);
+   }
+
+   if (pipe->buffer)
+      fifo_free(pipe->buffer);
+   if (pipe->lock)
+      slock_free(pipe->lock);
+   if (pipe->process_lock)
+      slock_free(pipe->process_lock);
+   if (pipe->cond)
+      scond_free(pipe->cond);
+   free(pipe->process_buf);
+   free(pipe);
+}
+
+bool rarch_audio_pipeline_push(rarch_audio_pipeline_t *pipe, const int16_t *data, size_t samples)
+{
+   size_t size = samples * sizeof(int16_t);
+
+   slock_lock(pipe->lock);
+   while (size && !pipe->failed && !pipe->stopped)
+   {
+      // Keep whole stereo frames in the queue.
+      size_t avail = fifo_write_avail(pipe->buffer) & ~(2 * sizeof(int16_t) - 1);
+      if (!avail)
+      {
+         if (pipe->nonblock)
+            break;
+         scond_wait(pipe->cond, pipe->lock);
+         continue;
+      }
+
+      size_t write_size = size < avail ? size : avail;
+      fifo_write(pipe->buffer, data, write_size);
+      scond_signal(pipe->cond);
+
+      data += write_size / sizeof(int16_t);
+      size -= write_size;
+   }
+   bool ret = !pipe->failed;
+   slock_unlock(pipe->lock);
+
+   return ret;
+}
+
+void rarch_audio_pipeline_set_nonblock_state(rarch_audio_pipeline_t *pipe, bool state)
+{
+   slock_lock(pipe->lock);
+   pipe->nonblock = state;
+   slock_unlock(pipe->lock);
+}
+
+void rarch_audio_pipeline_stop(rarch_audio_pipeline_t *pipe)
+{
+   slock_lock(pipe->lock);
+   pipe->stopped = true;
+   fifo_clear(pipe->buffer);
+   scond_signal(pipe->cond);
+   slock_unlock(pipe->lock);
+}
+
+void rarch_audio_pipeline_start(rarch_audio_pipeline_t *pipe)
+{
+   slock_lock(pipe->lock);
+   pipe->stopped = false;
+   slock_unlock(pipe->lock);
+}
+
+void rarch_audio_pipeline_lock(rarch_audio_pipeline_t *pipe)
+{
+   slock_lock(pipe->process_lock);
+}
+
+void rarch_audio_pipeline_unlock(rarch_audio_pipeline_t *pipe)
+{
+   slock_unlock(pipe->process_lock);
+}
+
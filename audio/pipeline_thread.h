@@ -0,0 +1,51 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ * 
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RARCH_AUDIO_PIPELINE_THREAD_H__
+#define RARCH_AUDIO_PIPELINE_THREAD_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "../boolean.h"
+
+// Runs the audio pipeline (conversion, DSP, resampling and the driver write) in its own thread.
+// The emulation thread only queues the core's interleaved S16 stereo samples.
+typedef struct rarch_audio_pipeline rarch_audio_pipeline_t;
+
+// Called on the pipeline thread with a batch of queued samples. Returns false if the driver failed.
+typedef bool (*rarch_audio_pipeline_process_t)(const int16_t *data, size_t samples);
+
+// Queue holds up to 'samples' samples.
+rarch_audio_pipeline_t *rarch_audio_pipeline_new(size_t samples, rarch_audio_pipeline_process_t process);
+void rarch_audio_pipeline_free(rarch_audio_pipeline_t *pipe);
+
+// Blocks while the queue is full, unless in non-blocking state, where samples which don't fit are dropped.
+// Returns false once processing has failed.
+bool rarch_audio_pipeline_push(rarch_audio_pipeline_t *pipe, const int16_t *data, size_t samples);
+void rarch_audio_pipeline_set_nonblock_state(rarch_audio_pipeline_t *pipe, bool state);
+
+// Call stop before stopping the audio driver, and start after starting it again.
+// While stopped, queued and pushed samples are dropped rather than written to the driver,
+// which could otherwise block forever on a write to a stopped device.
+void rarch_audio_pipeline_stop(rarch_audio_pipeline_t *pipe);
+void rarch_audio_pipeline_start(rarch_audio_pipeline_t *pipe);
+
+// Held by the pipeline thread while it processes.
+// Take it before touching the audio driver, DSP or resampler from another thread.
+void rarch_audio_pipeline_lock(rarch_audio_pipeline_t *pipe);
+void rarch_audio_pipeline_unlock(rarch_audio_pipeline_t *pipe);
+
+#endif
+
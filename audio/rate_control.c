@@ -0,0 +1,66 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ * 
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "rate_control.h"
+#include <string.h>
+
+// Drivers which report free space in whole periods make the fill level step around a lot.
+#define RATE_CONTROL_FILTER_TIME 0.05
+
+void rarch_rate_control_init(rarch_rate_control_t *rc, double delta, double integral_gain)
+{
+   memset(rc, 0, sizeof(*rc));
+   rc->delta         = delta;
+   rc->integral_gain = integral_gain;
+   rc->filter_time   = RATE_CONTROL_FILTER_TIME;
+}
+
+double rarch_rate_control_update(rarch_rate_control_t *rc,
+      size_t write_avail, size_t buffer_size, size_t write_size, double seconds)
+{
+   if (write_avail >= buffer_size)
+      rc->underruns++;
+   if (write_size > write_avail)
+      rc->overruns++;
+
+   double half_size = buffer_size / 2.0;
+   double error = ((double)write_avail - half_size) / half_size;
+
+   // First update starts from the measured level rather than from zero.
+   if (rc->updates && rc->filter_time > 0.0)
+      rc->error += (error - rc->error) * (seconds / (rc->filter_time + seconds));
+   else
+      rc->error = error;
+
+   // The integral never has to cover more than what the proportional term could,
+   // which also keeps it from winding up while the buffer sits at either end.
+   rc->integral += rc->integral_gain * rc->error * seconds;
+   if (rc->integral > rc->delta)
+      rc->integral = rc->delta;
+   else if (rc->integral < -rc->delta)
+      rc->integral = -rc->delta;
+
+   double adjust = 1.0 + rc->delta * rc->error + rc->integral;
+
+   if (!rc->updates || adjust < rc->adjust_min)
+      rc->adjust_min = adjust;
+   if (!rc->updates || adjust > rc->adjust_max)
+      rc->adjust_max = adjust;
+   rc->adjust_accum += adjust;
+   rc->updates++;
+
+   return adjust;
+}
+
@@ -0,0 +1,55 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ * 
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RARCH_AUDIO_RATE_CONTROL_H__
+#define RARCH_AUDIO_RATE_CONTROL_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "../boolean.h"
+
+// Dynamic rate control.
+// Keeps the audio driver buffer half full by nudging the resampling ratio,
+// with a PI controller on a low-pass filtered fill level.
+// The proportional term tracks jitter, the integral term soaks up a steady clock difference
+// between the core and the audio device, so the buffer doesn't settle off center.
+typedef struct rarch_rate_control
+{
+   double delta; // Proportional gain, as the ratio adjustment at an empty or full buffer.
+   double integral_gain; // Ratio adjustment per second of audio at an empty or full buffer.
+   double filter_time; // Time constant of the fill level filter, in seconds.
+
+   double error; // Filtered fill level, from -1 (full) to 1 (empty).
+   double integral;
+
+   // Telemetry.
+   unsigned underruns; // Buffer found empty.
+   unsigned overruns; // Write didn't fit in the buffer, so it blocked or dropped samples.
+   double adjust_min;
+   double adjust_max;
+   double adjust_accum;
+   uint64_t updates;
+} rarch_rate_control_t;
+
+void rarch_rate_control_init(rarch_rate_control_t *rc, double delta, double integral_gain);
+
+// Call once per write, with the free space in the driver buffer, and the
+// amount of audio about to be written, both in the units of the buffer and in seconds.
+// Returns the factor to apply to the resampling ratio.
+double rarch_rate_control_update(rarch_rate_control_t *rc,
+      size_t write_avail, size_t buffer_size, size_t write_size, double seconds);
+
+#endif
+
@@ -21,6 +21,7 @@
 #endif
 
 #include "../general.h"
+#include "../performance.h"
 
 static const rarch_resampler_t *backends[] = {
    &sinc_resampler,
@@ -59,7 +60,10 @@ static const rarch_resampler_t *find_resampler_driver(const char *ident)
    }
 }
 
-#ifndef RESAMPLER_TEST
+#ifdef RESAMPLER_TEST
+// The tests link performance.c for CPU feature detection, which wants this around.
+struct global g_extern;
+#else
 void find_prev_resampler_driver(void)
 {
    int i = find_resampler_driver_index(g_settings.audio.resampler);
@@ -79,7 +83,8 @@ void find_next_resampler_driver(void)
 }
 #endif
 
-bool rarch_resampler_realloc(void **re, const rarch_resampler_t **backend, const char *ident, double bw_ratio)
+bool rarch_resampler_realloc(void **re, const rarch_resampler_t **backend, const char *ident,
+      enum resampler_quality quality, double bw_ratio)
 {
    if (*re && *backend)
       (*backend)->free(*re);
@@ -91,7 +96,7 @@ bool rarch_resampler_realloc(void **re, const rarch_resampler_t **backend, const
    if (!*backend)
       return false;
 
-   *re = (*backend)->init(bw_ratio);
+   *re = (*backend)->init(bw_ratio, quality, rarch_get_cpu_features());
 
    if (!*re)
    {
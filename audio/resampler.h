@@ -31,6 +31,20 @@
 #define M_PI 3.14159265358979323846264338327
 #endif
 
+// Quality/CPU trade-off. What the tiers mean is up to the resampler, DONTCARE gets its default.
+enum resampler_quality
+{
+   RESAMPLER_QUALITY_DONTCARE = 0,
+   RESAMPLER_QUALITY_LOWEST,
+   RESAMPLER_QUALITY_LOWER,
+   RESAMPLER_QUALITY_NORMAL,
+   RESAMPLER_QUALITY_HIGHER,
+   RESAMPLER_QUALITY_HIGHEST,
+};
+
+// RETRO_SIMD_* bits a resampler may use.
+typedef unsigned resampler_simd_mask_t;
+
 struct resampler_data
 {
    const float *data_in;
@@ -44,7 +58,7 @@ struct resampler_data
 
 typedef struct rarch_resampler
 {
-   void *(*init)(double bandwidth_mod); // Bandwidth factor. Will be < 1.0 for downsampling, > 1.0 for upsamling. Corresponds to expected resampling ratio.
+   void *(*init)(double bandwidth_mod, enum resampler_quality quality, resampler_simd_mask_t mask); // Bandwidth factor. Will be < 1.0 for downsampling, > 1.0 for upsamling. Corresponds to expected resampling ratio.
    void (*process)(void *re, struct resampler_data *data);
    void (*free)(void *re);
    const char *ident;
@@ -54,8 +68,9 @@ extern const rarch_resampler_t sinc_resampler;
 extern const rarch_resampler_t CC_resampler;
 
 // Reallocs resampler. Will free previous handle before allocating a new one.
-// If ident is NULL, first resampler will be used.
-bool rarch_resampler_realloc(void **re, const rarch_resampler_t **backend, const char *ident, double bw_ratio);
+// If ident is NULL, first resampler will be used. SIMD kernels are picked for the CPU we run on.
+bool rarch_resampler_realloc(void **re, const rarch_resampler_t **backend, const char *ident,
+      enum resampler_quality quality, double bw_ratio);
 
 // Convenience macros.
 // freep makes sure to set handles to NULL to avoid double-free in rarch_resampler_realloc.
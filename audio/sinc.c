@@ -35,74 +35,58 @@
 #include <xmmintrin.h>
 #endif
 
+#undef CPU_X86
+#if defined(__x86_64__) || defined(__i386__) || defined(__i486__) || defined(__i686__)
+#define CPU_X86
+#endif
+
+// AVX and AVX2/FMA kernels are built with target attributes and only picked if the CPU has them.
+#if defined(CPU_X86) && (defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define SINC_HAVE_AVX
+#include <immintrin.h>
+#endif
+
 // Rough SNR values for upsampling:
 // LOWEST: 40 dB
 // LOWER: 55 dB
 // NORMAL: 70 dB
 // HIGHER: 110 dB
 // HIGHEST: 140 dB
+struct sinc_quality
+{
+   const char *ident;
+   bool kaiser; // Lanczos window otherwise.
+   double kaiser_beta;
+   double cutoff;
+   unsigned phase_bits;
+   unsigned subphase_bits;
+   bool coeff_lerp;
+   unsigned sidelobes;
+   // For the little amount of taps the lower tiers use, SSE1 is faster than AVX.
+   bool enable_avx;
+};
 
-// TODO, make all this more configurable.
+static const struct sinc_quality sinc_qualities[] = {
+   { "lowest",  false, 0.0,  0.98,  12, 10, false, 2,   false },
+   { "lower",   false, 0.0,  0.98,  12, 10, false, 4,   false },
+   { "normal",  true,  5.5,  0.825, 8,  16, true,  8,   false },
+   { "higher",  true,  10.5, 0.90,  10, 14, true,  32,  true  },
+   { "highest", true,  14.5, 0.962, 10, 14, true,  128, true  },
+};
+
+// The SINC_*_QUALITY build options pick what RESAMPLER_QUALITY_DONTCARE gets.
 #if defined(SINC_LOWEST_QUALITY)
-#define SINC_WINDOW_LANCZOS
-#define CUTOFF 0.98
-#define PHASE_BITS 12
-#define SINC_COEFF_LERP 0
-#define SUBPHASE_BITS 10
-#define SIDELOBES 2
-#define ENABLE_AVX 0
+#define SINC_DEFAULT_QUALITY RESAMPLER_QUALITY_LOWEST
 #elif defined(SINC_LOWER_QUALITY)
-#define SINC_WINDOW_LANCZOS
-#define CUTOFF 0.98
-#define PHASE_BITS 12
-#define SUBPHASE_BITS 10
-#define SINC_COEFF_LERP 0
-#define SIDELOBES 4
-#define ENABLE_AVX 0
+#define SINC_DEFAULT_QUALITY RESAMPLER_QUALITY_LOWER
 #elif defined(SINC_HIGHER_QUALITY)
-#define SINC_WINDOW_KAISER
-#define SINC_WINDOW_KAISER_BETA 10.5
-#define CUTOFF 0.90
-#define PHASE_BITS 10
-#define SUBPHASE_BITS 14
-#define SINC_COEFF_LERP 1
-#define SIDELOBES 32
-#define ENABLE_AVX 1
+#define SINC_DEFAULT_QUALITY RESAMPLER_QUALITY_HIGHER
 #elif defined(SINC_HIGHEST_QUALITY)
-#define SINC_WINDOW_KAISER
-#define SINC_WINDOW_KAISER_BETA 14.5
-#define CUTOFF 0.962
-#define PHASE_BITS 10
-#define SUBPHASE_BITS 14
-#define SINC_COEFF_LERP 1
-#define SIDELOBES 128
-#define ENABLE_AVX 1
+#define SINC_DEFAULT_QUALITY RESAMPLER_QUALITY_HIGHEST
 #else
-#define SINC_WINDOW_KAISER
-#define SINC_WINDOW_KAISER_BETA 5.5
-#define CUTOFF 0.825
-#define PHASE_BITS 8
-#define SUBPHASE_BITS 16
-#define SINC_COEFF_LERP 1
-#define SIDELOBES 8
-#define ENABLE_AVX 0
+#define SINC_DEFAULT_QUALITY RESAMPLER_QUALITY_NORMAL
 #endif
 
-// For the little amount of taps we're using,
-// SSE1 is faster than AVX for some reason.
-// AVX code is kept here though as by increasing number
-// of sinc taps, the AVX code is clearly faster than SSE1.
-
-#if defined(__AVX__) && ENABLE_AVX
-#include <immintrin.h>
-#endif
-
-#define PHASES (1 << (PHASE_BITS + SUBPHASE_BITS))
-
-#define TAPS (SIDELOBES * 2)
-#define SUBPHASE_MASK ((1 << SUBPHASE_BITS) - 1)
-#define SUBPHASE_MOD (1.0f / (1 << SUBPHASE_BITS))
-
 typedef struct rarch_sinc_resampler
 {
    float *phase_table;
@@ -114,6 +98,31 @@ typedef struct rarch_sinc_resampler
    unsigned ptr;
    uint32_t time;
 
+   uint32_t phases;
+   unsigned subphase_bits;
+   uint32_t subphase_mask;
+   float subphase_mod;
+   unsigned phase_stride; // Floats per phase_table row.
+
+   void (*process)(struct rarch_sinc_resampler *resamp, const float *phase_table, float *out_buffer);
+   // Kernel without lerp, for the fixed ratio bank.
+   void (*process_fixed)(struct rarch_sinc_resampler *resamp, const float *phase_table, float *out_buffer);
+
+   // The ratio we were set up for gets a bank of exact phases to itself, see sinc_update_ratio().
+   const struct sinc_quality *quality;
+   double cutoff;
+   double nominal_ratio;
+   double last_ratio;
+   unsigned stable_calls;
+   bool fixed;
+   double bank_ratio; // What the bank was made for. Stays set if it couldn't be, so we don't keep trying.
+   float *bank;
+   uint32_t bank_max_phases;
+   uint32_t bank_phases; // Rows in the bank.
+   uint32_t bank_exact_step; // At bank_ratio, input advances exactly this many rows per output. 0 if it doesn't.
+   uint64_t bank_step; // Rows per output at the current ratio, in 32.32 fixed point.
+   uint64_t bank_pos; // Like time, in 32.32 fixed point rows of the bank.
+
    // A buffer for phase_table, buffer_l and buffer_r are created in a single calloc().
    // Ensure that we get as good cache locality as we can hope for.
    float *main_buffer;
@@ -127,12 +136,6 @@ static inline double sinc(double val)
       return sin(val) / val;
 }
 
-#if defined(SINC_WINDOW_LANCZOS)
-static inline double window_function(double index)
-{
-   return sinc(M_PI * index);
-}
-#elif defined(SINC_WINDOW_KAISER)
 // Modified Bessel function of first order.
 // Check Wiki for mathematical definition ...
 static inline double besseli0(double x)
@@ -161,19 +164,18 @@ static inline double besseli0(double x)
    return sum;
 }
 
-static inline double window_function(double index)
+static inline double window_function(const struct sinc_quality *quality, double index)
 {
-   return besseli0(SINC_WINDOW_KAISER_BETA * sqrt(1 - index * index));
+   if (quality->kaiser)
+      return besseli0(quality->kaiser_beta * sqrt(1 - index * index));
+   return sinc(M_PI * index);
 }
-#else
-#error "No SINC window function defined."
-#endif
 
-static void init_sinc_table(rarch_sinc_resampler_t *resamp, double cutoff,
+static void init_sinc_table(const struct sinc_quality *quality, double cutoff,
       float *phase_table, int phases, int taps, bool calculate_delta)
 {
    int i, j, p;
-   double window_mod = window_function(0.0); // Need to normalize w(0) to 1.0.
+   double window_mod = window_function(quality, 0.0); // Need to normalize w(0) to 1.0.
    int stride = calculate_delta ? 2 : 1;
 
    double sidelobes = taps / 2.0;
@@ -186,7 +188,7 @@ static void init_sinc_table(rarch_sinc_resampler_t *resamp, double cutoff,
          window_phase = 2.0 * window_phase - 1.0; // [-1, 1)
          double sinc_phase = sidelobes * window_phase;
 
-         float val = cutoff * sinc(M_PI * sinc_phase * cutoff) * window_function(window_phase) / window_mod;
+         float val = cutoff * sinc(M_PI * sinc_phase * cutoff) * window_function(quality, window_phase) / window_mod;
          phase_table[i * stride * taps + j] = val;
       }
    }
@@ -210,7 +212,7 @@ static void init_sinc_table(rarch_sinc_resampler_t *resamp, double cutoff,
          window_phase = 2.0 * window_phase - 1.0; // (-1, 1]
          double sinc_phase = sidelobes * window_phase;
 
-         float val = cutoff * sinc(M_PI * sinc_phase * cutoff) * window_function(window_phase) / window_mod;
+         float val = cutoff * sinc(M_PI * sinc_phase * cutoff) * window_function(quality, window_phase) / window_mod;
          float delta = (val - phase_table[phase * stride * taps + j]);
          phase_table[(phase * stride + 1) * taps + j] = delta;
       }
@@ -237,8 +239,10 @@ static void aligned_free__(void *ptr)
    free(p[-1]);
 }
 
-#if !(defined(__AVX__) && ENABLE_AVX) && !defined(__SSE__)
-static inline void process_sinc_C(rarch_sinc_resampler_t *resamp, float *out_buffer)
+// Every kernel comes in two flavors, with and without coefficient lerp, and is handed the phase_table row to use.
+// They share an inline body which takes 'lerp' as a constant so the check is compiled out.
+
+static inline void process_sinc_C_common(rarch_sinc_resampler_t *resamp, const float *phase_table, float *out_buffer, bool lerp)
 {
    unsigned i;
    float sum_l = 0.0f;
@@ -247,22 +251,12 @@ static inline void process_sinc_C(rarch_sinc_resampler_t *resamp, float *out_buf
    const float *buffer_r = resamp->buffer_r + resamp->ptr;
 
    unsigned taps  = resamp->taps;
-   unsigned phase = resamp->time >> SUBPHASE_BITS;
-#if SINC_COEFF_LERP
-   const float *phase_table = resamp->phase_table + phase * taps * 2;
    const float *delta_table = phase_table + taps;
-   float delta = (float)(resamp->time & SUBPHASE_MASK) * SUBPHASE_MOD;
-#else
-   const float *phase_table = resamp->phase_table + phase * taps;
-#endif
+   float delta = (float)(resamp->time & resamp->subphase_mask) * resamp->subphase_mod;
 
    for (i = 0; i < taps; i++)
    {
-#if SINC_COEFF_LERP
-      float sinc_val = phase_table[i] + delta_table[i] * delta;
-#else
-      float sinc_val = phase_table[i];
-#endif
+      float sinc_val = lerp ? phase_table[i] + delta_table[i] * delta : phase_table[i];
       sum_l         += buffer_l[i] * sinc_val;
       sum_r         += buffer_r[i] * sinc_val;
    }
@@ -270,60 +264,19 @@ static inline void process_sinc_C(rarch_sinc_resampler_t *resamp, float *out_buf
    out_buffer[0] = sum_l;
    out_buffer[1] = sum_r;
 }
-#endif
 
-#if defined(__AVX__) && ENABLE_AVX
-#define process_sinc_func process_sinc
-static void process_sinc(rarch_sinc_resampler_t *resamp, float *out_buffer)
+static void process_sinc_C(rarch_sinc_resampler_t *resamp, const float *phase_table, float *out_buffer)
 {
-   unsigned i;
-   __m256 sum_l = _mm256_setzero_ps();
-   __m256 sum_r = _mm256_setzero_ps();
-
-   const float *buffer_l = resamp->buffer_l + resamp->ptr;
-   const float *buffer_r = resamp->buffer_r + resamp->ptr;
-
-   unsigned taps = resamp->taps;
-   unsigned phase = resamp->time >> SUBPHASE_BITS;
-#if SINC_COEFF_LERP
-   const float *phase_table = resamp->phase_table + phase * taps * 2;
-   const float *delta_table = phase_table + taps;
-   __m256 delta = _mm256_set1_ps((float)(resamp->time & SUBPHASE_MASK) * SUBPHASE_MOD);
-#else
-   const float *phase_table = resamp->phase_table + phase * taps;
-#endif
-
-   for (i = 0; i < taps; i += 8)
-   {
-      __m256 buf_l = _mm256_loadu_ps(buffer_l + i);
-      __m256 buf_r = _mm256_loadu_ps(buffer_r + i);
-
-#if SINC_COEFF_LERP
-      __m256 deltas = _mm256_load_ps(delta_table + i);
-      __m256 sinc = _mm256_add_ps(_mm256_load_ps(phase_table + i), _mm256_mul_ps(deltas, delta));
-#else
-      __m256 sinc = _mm256_load_ps(phase_table + i);
-#endif
-      sum_l       = _mm256_add_ps(sum_l, _mm256_mul_ps(buf_l, sinc));
-      sum_r       = _mm256_add_ps(sum_r, _mm256_mul_ps(buf_r, sinc));
-   }
+   process_sinc_C_common(resamp, phase_table, out_buffer, false);
+}
 
-   // hadd on AVX is weird, and acts on low-lanes and high-lanes separately.
-   __m256 res_l = _mm256_hadd_ps(sum_l, sum_l);
-   __m256 res_r = _mm256_hadd_ps(sum_r, sum_r);
-   res_l = _mm256_hadd_ps(res_l, res_l);
-   res_r = _mm256_hadd_ps(res_r, res_r);
-   res_l = _mm256_add_ps(_mm256_permute2f128_ps(res_l, res_l, 1), res_l);
-   res_r = _mm256_add_ps(_mm256_permute2f128_ps(res_r, res_r, 1), res_r);
-
-   // This is optimized to mov %xmmN, [mem].
-   // There doesn't seem to be any _mm256_store_ss intrinsic.
-   _mm_store_ss(out_buffer + 0, _mm256_extractf128_ps(res_l, 0));
-   _mm_store_ss(out_buffer + 1, _mm256_extractf128_ps(res_r, 0));
+static void process_sinc_C_lerp(rarch_sinc_resampler_t *resamp, const float *phase_table, float *out_buffer)
+{
+   process_sinc_C_common(resamp, phase_table, out_buffer, true);
 }
-#elif defined(__SSE__)
-#define process_sinc_func process_sinc
-static void process_sinc(rarch_sinc_resampler_t *resamp, float *out_buffer)
+
+#ifdef __SSE__
+static inline void process_sinc_sse_common(rarch_sinc_resampler_t *resamp, const float *phase_table, float *out_buffer, bool lerp)
 {
    unsigned i;
    __m128 sum_l = _mm_setzero_ps();
@@ -333,26 +286,17 @@ static void process_sinc(rarch_sinc_resampler_t *resamp, float *out_buffer)
    const float *buffer_r = resamp->buffer_r + resamp->ptr;
 
    unsigned taps = resamp->taps;
-   unsigned phase = resamp->time >> SUBPHASE_BITS;
-#if SINC_COEFF_LERP
-   const float *phase_table = resamp->phase_table + phase * taps * 2;
    const float *delta_table = phase_table + taps;
-   __m128 delta = _mm_set1_ps((float)(resamp->time & SUBPHASE_MASK) * SUBPHASE_MOD);
-#else
-   const float *phase_table = resamp->phase_table + phase * taps;
-#endif
+   __m128 delta = _mm_set1_ps((float)(resamp->time & resamp->subphase_mask) * resamp->subphase_mod);
 
    for (i = 0; i < taps; i += 4)
    {
       __m128 buf_l = _mm_loadu_ps(buffer_l + i);
       __m128 buf_r = _mm_loadu_ps(buffer_r + i);
 
-#if SINC_COEFF_LERP
-      __m128 deltas = _mm_load_ps(delta_table + i);
-      __m128 sinc = _mm_add_ps(_mm_load_ps(phase_table + i), _mm_mul_ps(deltas, delta));
-#else
       __m128 sinc = _mm_load_ps(phase_table + i);
-#endif
+      if (lerp)
+         sinc = _mm_add_ps(sinc, _mm_mul_ps(_mm_load_ps(delta_table + i), delta));
       sum_l       = _mm_add_ps(sum_l, _mm_mul_ps(buf_l, sinc));
       sum_r       = _mm_add_ps(sum_r, _mm_mul_ps(buf_r, sinc));
    }
@@ -378,39 +322,363 @@ static void process_sinc(rarch_sinc_resampler_t *resamp, float *out_buffer)
    // movehl { X, R, X, L } == { X, R, X, R }
    _mm_store_ss(out_buffer + 1, _mm_movehl_ps(sum, sum));
 }
-#elif defined(HAVE_NEON)
 
-#if SINC_COEFF_LERP
-#error "NEON asm does not support SINC lerp."
+static void process_sinc_sse(rarch_sinc_resampler_t *resamp, const float *phase_table, float *out_buffer)
+{
+   process_sinc_sse_common(resamp, phase_table, out_buffer, false);
+}
+
+static void process_sinc_sse_lerp(rarch_sinc_resampler_t *resamp, const float *phase_table, float *out_buffer)
+{
+   process_sinc_sse_common(resamp, phase_table, out_buffer, true);
+}
 #endif
 
-// Need to make this function pointer as Android doesn't have built-in targets
-// for NEON and plain ARMv7a.
-static void (*process_sinc_func)(rarch_sinc_resampler_t *resamp, float *out_buffer);
+#ifdef SINC_HAVE_AVX
+// hadd on AVX is weird, and acts on low-lanes and high-lanes separately.
+#define SINC_AVX_STORE(out_buffer, sum_l, sum_r) do { \
+   __m256 res_l = _mm256_hadd_ps(sum_l, sum_l); \
+   __m256 res_r = _mm256_hadd_ps(sum_r, sum_r); \
+   res_l = _mm256_hadd_ps(res_l, res_l); \
+   res_r = _mm256_hadd_ps(res_r, res_r); \
+   res_l = _mm256_add_ps(_mm256_permute2f128_ps(res_l, res_l, 1), res_l); \
+   res_r = _mm256_add_ps(_mm256_permute2f128_ps(res_r, res_r, 1), res_r); \
+   _mm_store_ss(out_buffer + 0, _mm256_castps256_ps128(res_l)); \
+   _mm_store_ss(out_buffer + 1, _mm256_castps256_ps128(res_r)); \
+} while(0)
+
+__attribute__((target("avx")))
+static inline void process_sinc_avx_common(rarch_sinc_resampler_t *resamp, const float *phase_table, float *out_buffer, bool lerp)
+{
+   unsigned i;
+   __m256 sum_l = _mm256_setzero_ps();
+   __m256 sum_r = _mm256_setzero_ps();
+
+   const float *buffer_l = resamp->buffer_l + resamp->ptr;
+   const float *buffer_r = resamp->buffer_r + resamp->ptr;
 
-// Assumes that taps >= 8, and that taps is a multiple of 8.
-void process_sinc_neon_asm(float *out, const float *left, const float *right, const float *coeff, unsigned taps);
+   unsigned taps = resamp->taps;
+   const float *delta_table = phase_table + taps;
+   __m256 delta = _mm256_set1_ps((float)(resamp->time & resamp->subphase_mask) * resamp->subphase_mod);
+
+   for (i = 0; i < taps; i += 8)
+   {
+      __m256 buf_l = _mm256_loadu_ps(buffer_l + i);
+      __m256 buf_r = _mm256_loadu_ps(buffer_r + i);
+
+      __m256 sinc = _mm256_load_ps(phase_table + i);
+      if (lerp)
+         sinc = _mm256_add_ps(sinc, _mm256_mul_ps(_mm256_load_ps(delta_table + i), delta));
+      sum_l       = _mm256_add_ps(sum_l, _mm256_mul_ps(buf_l, sinc));
+      sum_r       = _mm256_add_ps(sum_r, _mm256_mul_ps(buf_r, sinc));
+   }
+
+   SINC_AVX_STORE(out_buffer, sum_l, sum_r);
+}
+
+__attribute__((target("avx")))
+static void process_sinc_avx(rarch_sinc_resampler_t *resamp, const float *phase_table, float *out_buffer)
+{
+   process_sinc_avx_common(resamp, phase_table, out_buffer, false);
+}
+
+__attribute__((target("avx")))
+static void process_sinc_avx_lerp(rarch_sinc_resampler_t *resamp, const float *phase_table, float *out_buffer)
+{
+   process_sinc_avx_common(resamp, phase_table, out_buffer, true);
+}
 
-static void process_sinc_neon(rarch_sinc_resampler_t *resamp, float *out_buffer)
+// Same as AVX, with the multiply-adds fused.
+__attribute__((target("avx2,fma")))
+static inline void process_sinc_fma_common(rarch_sinc_resampler_t *resamp, const float *phase_table, float *out_buffer, bool lerp)
 {
+   unsigned i;
+   __m256 sum_l = _mm256_setzero_ps();
+   __m256 sum_r = _mm256_setzero_ps();
+
    const float *buffer_l = resamp->buffer_l + resamp->ptr;
    const float *buffer_r = resamp->buffer_r + resamp->ptr;
 
-   unsigned phase = resamp->time >> SUBPHASE_BITS;
    unsigned taps = resamp->taps;
-   const float *phase_table = resamp->phase_table + phase * taps;
+   const float *delta_table = phase_table + taps;
+   __m256 delta = _mm256_set1_ps((float)(resamp->time & resamp->subphase_mask) * resamp->subphase_mod);
+
+   for (i = 0; i < taps; i += 8)
+   {
+      __m256 sinc = _mm256_load_ps(phase_table + i);
+      if (lerp)
+         sinc = _mm256_fmadd_ps(_mm256_load_ps(delta_table + i), delta, sinc);
+      sum_l       = _mm256_fmadd_ps(_mm256_loadu_ps(buffer_l + i), sinc, sum_l);
+      sum_r       = _mm256_fmadd_ps(_mm256_loadu_ps(buffer_r + i), sinc, sum_r);
+   }
+
+   SINC_AVX_STORE(out_buffer, sum_l, sum_r);
+}
 
-   process_sinc_neon_asm(out_buffer, buffer_l, buffer_r, phase_table, taps);
+__attribute__((target("avx2,fma")))
+static void process_sinc_fma(rarch_sinc_resampler_t *resamp, const float *phase_table, float *out_buffer)
+{
+   process_sinc_fma_common(resamp, phase_table, out_buffer, false);
+}
+
+__attribute__((target("avx2,fma")))
+static void process_sinc_fma_lerp(rarch_sinc_resampler_t *resamp, const float *phase_table, float *out_buffer)
+{
+   process_sinc_fma_common(resamp, phase_table, out_buffer, true);
+}
+#endif
+
+#ifdef HAVE_NEON
+// Assumes that taps >= 8, and that taps is a multiple of 8.
+void process_sinc_neon_asm(float *out, const float *left, const float *right, const float *coeff, unsigned taps);
+
+static void process_sinc_neon(rarch_sinc_resampler_t *resamp, const float *phase_table, float *out_buffer)
+{
+   const float *buffer_l = resamp->buffer_l + resamp->ptr;
+   const float *buffer_r = resamp->buffer_r + resamp->ptr;
+
+   process_sinc_neon_asm(out_buffer, buffer_l, buffer_r, phase_table, resamp->taps);
 }
-#else // Plain ol' C99
-#define process_sinc_func process_sinc_C
 #endif
 
+struct sinc_kernel
+{
+   const char *ident;
+   unsigned width; // Taps are rounded up to a multiple of this.
+   void (*process)(rarch_sinc_resampler_t *resamp, const float *phase_table, float *out_buffer);
+   void (*process_lerp)(rarch_sinc_resampler_t *resamp, const float *phase_table, float *out_buffer);
+};
+
+static const struct sinc_kernel *sinc_find_kernel(const struct sinc_quality *quality, resampler_simd_mask_t mask)
+{
+#ifdef SINC_HAVE_AVX
+   static const struct sinc_kernel fma = { "AVX2/FMA", 8, process_sinc_fma, process_sinc_fma_lerp };
+   static const struct sinc_kernel avx = { "AVX", 8, process_sinc_avx, process_sinc_avx_lerp };
+   if (quality->enable_avx && (mask & RETRO_SIMD_AVX2))
+      return &fma;
+   if (quality->enable_avx && (mask & RETRO_SIMD_AVX))
+      return &avx;
+#endif
+#ifdef __SSE__
+   static const struct sinc_kernel sse = { "SSE", 4, process_sinc_sse, process_sinc_sse_lerp };
+   if (mask & RETRO_SIMD_SSE)
+      return &sse;
+#endif
+#ifdef HAVE_NEON
+   // The asm doesn't do lerp, so the lerp tiers stay on C.
+   static const struct sinc_kernel neon = { "NEON", 8, process_sinc_neon, process_sinc_C_lerp };
+   if (!quality->coeff_lerp && (mask & RETRO_SIMD_NEON))
+      return &neon;
+#endif
+   static const struct sinc_kernel c = { "C", 1, process_sinc_C, process_sinc_C_lerp };
+   (void)quality;
+   (void)mask;
+   return &c;
+}
+
+// Calls in a row a ratio away from the nominal one has to hold before we make a bank for it.
+#define SINC_STABLE_CALLS 16
+// How far the bank's ratio may be off. About what rounding the step to whole phases costs the interpolated path.
+#define SINC_BANK_TOLERANCE 5e-8
+// How far the ratio may drift from the bank's and still be followed by stepping through the bank
+// at a slightly different rate. Covers what dynamic rate control does to the ratio.
+#define SINC_BANK_DRIFT 0.02
+
+// Finds step / phases close enough to 1 / ratio, with the smallest phases that will do.
+static bool sinc_bank_ratio(double ratio, uint32_t max_phases, uint32_t *phases, uint32_t *step)
+{
+   unsigned i;
+   double x = 1.0 / ratio;
+   double f = x;
+   uint64_t h0 = 0, h1 = 1;
+   uint64_t k0 = 1, k1 = 0;
+
+   // Continued fraction convergents are the best approximations for their size.
+   for (i = 0; i < 32; i++)
+   {
+      double a = floor(f);
+      uint64_t h = (uint64_t)a * h1 + h0;
+      uint64_t k = (uint64_t)a * k1 + k0;
+      if (k > max_phases || h > UINT32_MAX)
+         return false;
+
+      h0 = h1;
+      h1 = h;
+      k0 = k1;
+      k1 = k;
+
+      if (fabs((double)h / k - x) <= x * SINC_BANK_TOLERANCE)
+      {
+         *phases = k;
+         *step = h;
+         return true;
+      }
+
+      if (f - a < 1e-12)
+         return false;
+      f = 1.0 / (f - a);
+   }
+
+   return false;
+}
+
+static void sinc_enter_fixed(rarch_sinc_resampler_t *re)
+{
+   re->bank_pos = (uint64_t)((double)re->time * re->bank_phases / re->phases * 4294967296.0);
+   re->fixed = true;
+}
+
+static void sinc_leave_fixed(rarch_sinc_resampler_t *re)
+{
+   re->time = (uint32_t)(re->bank_pos / 4294967296.0 * re->phases / re->bank_phases + 0.5);
+   re->fixed = false;
+}
+
+static void sinc_make_bank(rarch_sinc_resampler_t *re, double ratio)
+{
+   if (re->fixed)
+      sinc_leave_fixed(re);
+   if (re->bank)
+      aligned_free__(re->bank);
+   re->bank = NULL;
+   re->bank_ratio = ratio;
+
+   // A bank never gets bigger than the table it stands in for.
+   // Away from an exact ratio, outputs land on the nearest row below, so use as many rows as fit.
+   uint32_t phases, step;
+   if (sinc_bank_ratio(ratio, re->bank_max_phases, &phases, &step))
+   {
+      uint32_t mult = re->bank_max_phases / phases;
+      phases *= mult;
+      step *= mult;
+   }
+   else
+   {
+      phases = re->bank_max_phases;
+      step = 0;
+   }
+
+   re->bank = (float*)aligned_alloc__(128, sizeof(float) * phases * re->taps);
+   if (!re->bank)
+      return;
+
+   init_sinc_table(re->quality, re->cutoff, re->bank, phases, re->taps, false);
+   re->bank_phases = phases;
+   re->bank_exact_step = step;
+   RARCH_LOG("Sinc resampler: fixed ratio bank, %u phases.\n", phases);
+}
+
+// Most content runs at one ratio for good, give or take what dynamic rate control does to it.
+// A bank of filters at that ratio's phases drops the lerp and its second table from every tap.
+// - While the ratio moves, as under rate control, the lerp tiers step through the bank in 32.32 fixed
+//   point and land on the row below. That is finer than what the interpolated path's whole-phase step costs
+//   it whenever the ratio changes, so it loses nothing there.
+// - Once the ratio holds for a while, a bank made exactly for it is used if there is one.
+//   Otherwise the interpolated table is more precise at a fixed ratio, so we go back to it.
+// - A ratio far from the bank's, like slow motion, goes back to the interpolated table.
+static void sinc_update_ratio(rarch_sinc_resampler_t *re, double ratio)
+{
+   bool use_bank;
+
+   if (ratio == re->last_ratio)
+   {
+      if (re->stable_calls <= SINC_STABLE_CALLS)
+         re->stable_calls++;
+      if (re->stable_calls != SINC_STABLE_CALLS)
+         return;
+
+      uint32_t phases, step;
+      if (ratio != re->bank_ratio && sinc_bank_ratio(ratio, re->bank_max_phases, &phases, &step))
+         sinc_make_bank(re, ratio);
+      use_bank = re->bank && ratio == re->bank_ratio && re->bank_exact_step;
+   }
+   else
+   {
+      re->last_ratio = ratio;
+      re->stable_calls = 0;
+
+      // Without lerp, the table has as many rows as the bank, so stepping through it buys nothing.
+      if (!re->quality->coeff_lerp)
+         use_bank = false;
+      else
+      {
+         // Back near where we started, after running somewhere else for a while.
+         if (fabs(ratio / re->bank_ratio - 1.0) > SINC_BANK_DRIFT &&
+               fabs(ratio / re->nominal_ratio - 1.0) <= SINC_BANK_DRIFT)
+            sinc_make_bank(re, re->nominal_ratio);
+
+         use_bank = re->bank && fabs(ratio / re->bank_ratio - 1.0) <= SINC_BANK_DRIFT;
+      }
+   }
+
+   if (!use_bank)
+   {
+      if (re->fixed)
+         sinc_leave_fixed(re);
+      return;
+   }
+
+   if (ratio == re->bank_ratio && re->bank_exact_step)
+      re->bank_step = (uint64_t)re->bank_exact_step << 32;
+   else
+      re->bank_step = (uint64_t)(re->bank_phases / ratio * 4294967296.0 + 0.5);
+
+   if (!re->fixed)
+      sinc_enter_fixed(re);
+}
+
+static inline void sinc_push(rarch_sinc_resampler_t *re, const float *input)
+{
+   // Push in reverse to make filter more obvious.
+   if (!re->ptr)
+      re->ptr = re->taps;
+   re->ptr--;
+
+   re->buffer_l[re->ptr + re->taps] = re->buffer_l[re->ptr] = input[0];
+   re->buffer_r[re->ptr + re->taps] = re->buffer_r[re->ptr] = input[1];
+}
+
+static size_t resampler_sinc_process_fixed(rarch_sinc_resampler_t *re, const float *input, float *output, size_t frames)
+{
+   size_t out_frames = 0;
+   uint64_t phases = (uint64_t)re->bank_phases << 32;
+   uint64_t step = re->bank_step;
+
+   while (frames)
+   {
+      while (frames && re->bank_pos >= phases)
+      {
+         sinc_push(re, input);
+         input += 2;
+         re->bank_pos -= phases;
+         frames--;
+      }
+
+      while (re->bank_pos < phases)
+      {
+         re->process_fixed(re, re->bank + (re->bank_pos >> 32) * re->taps, output);
+         output += 2;
+         out_frames++;
+         re->bank_pos += step;
+      }
+   }
+
+   return out_frames;
+}
+
 static void resampler_sinc_process(void *re_, struct resampler_data *data)
 {
    rarch_sinc_resampler_t *re = (rarch_sinc_resampler_t*)re_;
 
-   uint32_t ratio = PHASES / data->ratio;
+   sinc_update_ratio(re, data->ratio);
+   if (re->fixed)
+   {
+      data->output_frames = resampler_sinc_process_fixed(re, data->data_in, data->data_out, data->input_frames);
+      return;
+   }
+
+   uint32_t phases = re->phases;
+   uint32_t ratio = phases / data->ratio;
 
    const float *input = data->data_in;
    float *output      = data->data_out;
@@ -419,23 +687,17 @@ static void resampler_sinc_process(void *re_, struct resampler_data *data)
 
    while (frames)
    {
-      while (frames && re->time >= PHASES)
+      while (frames && re->time >= phases)
       {
-         // Push in reverse to make filter more obvious.
-         if (!re->ptr)
-            re->ptr = re->taps;
-         re->ptr--;
-
-         re->buffer_l[re->ptr + re->taps] = re->buffer_l[re->ptr] = *input++;
-         re->buffer_r[re->ptr + re->taps] = re->buffer_r[re->ptr] = *input++;
-
-         re->time -= PHASES;
+         sinc_push(re, input);
+         input += 2;
+         re->time -= phases;
          frames--;
       }
 
-      while (re->time < PHASES)
+      while (re->time < phases)
       {
-         process_sinc_func(re, output);
+         re->process(re, re->phase_table + (re->time >> re->subphase_bits) * re->phase_stride, output);
          output += 2;
          out_frames++;
          re->time += ratio;
@@ -449,11 +711,15 @@ static void resampler_sinc_free(void *re)
 {
    rarch_sinc_resampler_t *resampler = (rarch_sinc_resampler_t*)re;
    if (resampler)
+   {
       aligned_free__(resampler->main_buffer);
+      if (resampler->bank)
+         aligned_free__(resampler->bank);
+   }
    free(resampler);
 }
 
-static void *resampler_sinc_new(double bandwidth_mod)
+static void *resampler_sinc_new(double bandwidth_mod, enum resampler_quality quality_id, resampler_simd_mask_t mask)
 {
    rarch_sinc_resampler_t *re = (rarch_sinc_resampler_t*)calloc(1, sizeof(*re));
    if (!re)
@@ -461,8 +727,21 @@ static void *resampler_sinc_new(double bandwidth_mod)
 
    memset(re, 0, sizeof(*re));
 
-   re->taps = TAPS;
-   double cutoff = CUTOFF;
+   if (quality_id == RESAMPLER_QUALITY_DONTCARE || quality_id > RESAMPLER_QUALITY_HIGHEST)
+      quality_id = SINC_DEFAULT_QUALITY;
+   const struct sinc_quality *quality = &sinc_qualities[quality_id - RESAMPLER_QUALITY_LOWEST];
+   const struct sinc_kernel *kernel = sinc_find_kernel(quality, mask);
+
+   re->phases = 1u << (quality->phase_bits + quality->subphase_bits);
+   re->subphase_bits = quality->subphase_bits;
+   re->subphase_mask = (1u << quality->subphase_bits) - 1;
+   re->subphase_mod = 1.0f / (1u << quality->subphase_bits);
+   re->process = quality->coeff_lerp ? kernel->process_lerp : kernel->process;
+   re->process_fixed = kernel->process;
+   re->quality = quality;
+
+   re->taps = quality->sidelobes * 2;
+   double cutoff = quality->cutoff;
 
    // Downsampling, must lower cutoff, and extend number of taps accordingly to keep same stopband attenuation.
    if (bandwidth_mod < 1.0)
@@ -472,41 +751,33 @@ static void *resampler_sinc_new(double bandwidth_mod)
    }
 
    // Be SIMD-friendly.
-#if (defined(__AVX__) && ENABLE_AVX) || defined(HAVE_NEON)
-   re->taps = (re->taps + 7) & ~7;
-#else
-   re->taps = (re->taps + 3) & ~3;
-#endif
+   re->taps = (re->taps + kernel->width - 1) / kernel->width * kernel->width;
+   re->phase_stride = quality->coeff_lerp ? re->taps * 2 : re->taps;
+   re->cutoff = cutoff;
 
-   size_t phase_elems = (1 << PHASE_BITS) * re->taps;
-#if SINC_COEFF_LERP
-   phase_elems *= 2;
-#endif
+   size_t phase_elems = (1 << quality->phase_bits) * re->taps;
+   if (quality->coeff_lerp)
+      phase_elems *= 2;
    size_t elems = phase_elems + 4 * re->taps;
 
    re->main_buffer = (float*)aligned_alloc__(128, sizeof(float) * elems);
    if (!re->main_buffer)
       goto error;
+   memset(re->main_buffer, 0, sizeof(float) * elems);
 
    re->phase_table = re->main_buffer;
+   re->bank_max_phases = phase_elems / re->taps;
    re->buffer_l = re->main_buffer + phase_elems;
    re->buffer_r = re->buffer_l + 2 * re->taps;
 
-   init_sinc_table(re, cutoff, re->phase_table, 1 << PHASE_BITS, re->taps, SINC_COEFF_LERP);
+   init_sinc_table(quality, cutoff, re->phase_table, 1 << quality->phase_bits, re->taps, quality->coeff_lerp);
 
-#if defined(__AVX__) && ENABLE_AVX
-   RARCH_LOG("Sinc resampler [AVX]\n");
-#elif defined(__SSE__)
-   RARCH_LOG("Sinc resampler [SSE]\n");
-#elif defined(HAVE_NEON)
-   unsigned cpu = rarch_get_cpu_features();
-   process_sinc_func = cpu & RETRO_SIMD_NEON ? process_sinc_neon : process_sinc_C;
-   RARCH_LOG("Sinc resampler [%s]\n", cpu & RETRO_SIMD_NEON ? "NEON" : "C");
-#else
-   RARCH_LOG("Sinc resampler [C]\n");
-#endif
+   re->nominal_ratio = bandwidth_mod;
+   if (quality->coeff_lerp)
+      sinc_make_bank(re, bandwidth_mod);
 
-   RARCH_LOG("SINC params (%u phase bits, %u taps).\n", PHASE_BITS, re->taps);
+   RARCH_LOG("Sinc resampler [%s]\n", kernel->ident);
+   RARCH_LOG("SINC params (%s quality, %u phase bits, %u taps).\n", quality->ident, quality->phase_bits, re->taps);
    return re;
 
 error:
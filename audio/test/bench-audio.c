@@ -0,0 +1,242 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Throughput of everything audio_flush() runs samples through, over a sweep of ratios and block sizes:
+// - the sinc resampler, every quality tier with each set of SIMD features this CPU has,
+// - the CC resampler,
+// - each audio_convert_* implementation built for this CPU.
+// Results go to stdout as CSV, one line per case, so runs before and after a change can be diffed.
+// Resamplers are measured in output frames, conversions in stereo frames.
+
+#include "../resampler.h"
+#include "../utils.h"
+#include "../../libretro.h"
+#include "../../performance.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_MAX_FRAMES 4096
+#define BENCH_MAX_RATIO 2.0
+#define BENCH_BATCH_FRAMES 65536 // Calls between timer reads, so small blocks aren't timing the timer.
+
+static const unsigned bench_blocks[] = { 64, 512, BENCH_MAX_FRAMES };
+
+// Deviation is how far the ratio swings either way between calls, as under dynamic rate control.
+static const struct
+{
+   double in_rate;
+   double out_rate;
+   double deviation;
+} bench_ratios[] = {
+   { 96000.0, 48000.0, 0.0 },
+   { 48000.0, 44100.0, 0.0 },
+   { 44100.0, 48000.0, 0.0 },
+   { 44100.0, 48000.0, 0.005 },
+   { 32000.0, 48000.0, 0.0 },
+   { 32040.5, 48000.0, 0.005 }, // SNES, off any nice ratio.
+};
+
+static unsigned bench_usec = 100000;
+
+static void bench_print(const char *suite, const char *impl, const char *variant,
+      double ratio, double deviation, unsigned block, uint64_t frames, retro_time_t elapsed)
+{
+   double fps = frames * 1000000.0 / elapsed;
+   printf("%s,%s,%s,%.6f,%.3f,%u,%.0f,%.3f\n", suite, impl, variant,
+         ratio, deviation, block, fps, 1000000000.0 / fps);
+   fflush(stdout);
+}
+
+static void bench_resampler(const char *suite, const char *variant, const rarch_resampler_t *backend,
+      enum resampler_quality quality, resampler_simd_mask_t mask, const float *input, float *output)
+{
+   unsigned r, b;
+   for (r = 0; r < sizeof(bench_ratios) / sizeof(bench_ratios[0]); r++)
+   {
+      double ratio = bench_ratios[r].out_rate / bench_ratios[r].in_rate;
+      double deviation = bench_ratios[r].deviation;
+
+      for (b = 0; b < sizeof(bench_blocks) / sizeof(bench_blocks[0]); b++)
+      {
+         void *re = backend->init(ratio, quality, mask);
+         if (!re)
+         {
+            fprintf(stderr, "Failed to init %s %s.\n", suite, variant);
+            exit(1);
+         }
+
+         struct resampler_data data = {
+            .data_in = input,
+            .data_out = output,
+            .input_frames = bench_blocks[b],
+            .ratio = ratio,
+         };
+
+         // Warm up the tables, and let a fixed ratio settle in.
+         unsigned i;
+         for (i = 0; i < 32; i++)
+            backend->process(re, &data);
+
+         unsigned calls = 0;
+         unsigned batch = (BENCH_BATCH_FRAMES + bench_blocks[b] - 1) / bench_blocks[b];
+         uint64_t frames = 0;
+         retro_time_t start = rarch_get_time_usec();
+         retro_time_t elapsed;
+         do
+         {
+            for (i = 0; i < batch; i++)
+            {
+               data.ratio = ratio * (1.0 + (calls++ & 1 ? deviation : -deviation));
+               backend->process(re, &data);
+               frames += data.output_frames;
+            }
+            elapsed = rarch_get_time_usec() - start;
+         } while (elapsed < bench_usec);
+
+         bench_print(suite, backend->ident, variant, ratio, deviation, bench_blocks[b], frames, elapsed);
+         backend->free(re);
+      }
+   }
+}
+
+static void bench_sinc(const float *input, float *output)
+{
+   static const char *qualities[] = { "lowest", "lower", "normal", "higher", "highest" };
+   static const struct
+   {
+      const char *ident;
+      resampler_simd_mask_t mask;
+   } kernels[] = {
+      { "C", 0 },
+      { "SSE", RETRO_SIMD_SSE },
+      { "AVX", RETRO_SIMD_SSE | RETRO_SIMD_AVX },
+      { "AVX2", RETRO_SIMD_SSE | RETRO_SIMD_AVX | RETRO_SIMD_AVX2 },
+      { "NEON", RETRO_SIMD_NEON },
+   };
+
+   uint64_t cpu = rarch_get_cpu_features();
+   unsigned q, k;
+   for (q = RESAMPLER_QUALITY_LOWEST; q <= RESAMPLER_QUALITY_HIGHEST; q++)
+   {
+      for (k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+      {
+         if ((cpu & kernels[k].mask) != kernels[k].mask)
+            continue;
+
+         char variant[32];
+         snprintf(variant, sizeof(variant), "%s-%s", qualities[q - RESAMPLER_QUALITY_LOWEST], kernels[k].ident);
+         bench_resampler("resampler", variant, &sinc_resampler, (enum resampler_quality)q, kernels[k].mask, input, output);
+      }
+   }
+}
+
+typedef void (*bench_s16_to_float_t)(float *out, const int16_t *in, size_t samples, float gain);
+typedef void (*bench_float_to_s16_t)(int16_t *out, const float *in, size_t samples);
+
+static void bench_convert(const char *variant,
+      bench_s16_to_float_t s16_to_float, bench_float_to_s16_t float_to_s16)
+{
+   static int16_t buf_s16[BENCH_MAX_FRAMES * 2];
+   static float buf_float[BENCH_MAX_FRAMES * 2];
+   unsigned i, b, dir;
+
+   for (i = 0; i < BENCH_MAX_FRAMES * 2; i++)
+      buf_s16[i] = rand() - RAND_MAX / 2;
+
+   for (dir = 0; dir < 2; dir++)
+   {
+      for (b = 0; b < sizeof(bench_blocks) / sizeof(bench_blocks[0]); b++)
+      {
+         size_t samples = bench_blocks[b] * 2;
+         unsigned batch = (BENCH_BATCH_FRAMES + bench_blocks[b] - 1) / bench_blocks[b];
+         uint64_t frames = 0;
+         retro_time_t start = rarch_get_time_usec();
+         retro_time_t elapsed;
+         do
+         {
+            for (i = 0; i < batch; i++)
+            {
+               if (dir == 0)
+                  s16_to_float(buf_float, buf_s16, samples, 1.0f);
+               else
+                  float_to_s16(buf_s16, buf_float, samples);
+            }
+            frames += (uint64_t)batch * bench_blocks[b];
+            elapsed = rarch_get_time_usec() - start;
+         } while (elapsed < bench_usec);
+
+         bench_print("convert", dir == 0 ? "s16_to_float" : "float_to_s16", variant,
+               1.0, 0.0, bench_blocks[b], frames, elapsed);
+      }
+   }
+}
+
+static void bench_converters(void)
+{
+   bench_convert("C", audio_convert_s16_to_float_C, audio_convert_float_to_s16_C);
+#if defined(__SSE2__)
+   bench_convert("SSE2", audio_convert_s16_to_float_SSE2, audio_convert_float_to_s16_SSE2);
+#elif defined(__ALTIVEC__)
+   bench_convert("altivec", audio_convert_s16_to_float_altivec, audio_convert_float_to_s16_altivec);
+#elif defined(HAVE_NEON)
+   // Picked at runtime, so this is NEON only if the CPU has it.
+   audio_convert_init_simd();
+   bench_convert((rarch_get_cpu_features() & RETRO_SIMD_NEON) ? "NEON" : "C-runtime",
+         audio_convert_s16_to_float_arm, audio_convert_float_to_s16_arm);
+#elif defined(_MIPS_ARCH_ALLEGREX)
+   bench_convert("ALLEGREX", audio_convert_s16_to_float_ALLEGREX, audio_convert_float_to_s16_ALLEGREX);
+#endif
+}
+
+int main(int argc, char *argv[])
+{
+   const char *only = NULL;
+   int i;
+
+   for (i = 1; i < argc; i++)
+   {
+      if (!strcmp(argv[i], "-t") && i + 1 < argc)
+         bench_usec = strtoul(argv[++i], NULL, 0) * 1000;
+      else if (!only && (!strcmp(argv[i], "sinc") || !strcmp(argv[i], "cc") || !strcmp(argv[i], "convert")))
+         only = argv[i];
+      else
+      {
+         fprintf(stderr, "Usage: %s [-t msec-per-case] [sinc|cc|convert]\n", argv[0]);
+         return 1;
+      }
+   }
+
+   float *input = (float*)malloc(BENCH_MAX_FRAMES * 2 * sizeof(float));
+   float *output = (float*)malloc((size_t)(BENCH_MAX_FRAMES * BENCH_MAX_RATIO * 1.01 + 16) * 2 * sizeof(float));
+   if (!input || !output)
+      return 1;
+
+   for (i = 0; i < BENCH_MAX_FRAMES * 2; i++)
+      input[i] = (2.0f * rand()) / RAND_MAX - 1.0f;
+
+   printf("suite,impl,variant,ratio,deviation,block,frames_per_sec,ns_per_frame\n");
+
+   if (!only || !strcmp(only, "sinc"))
+      bench_sinc(input, output);
+   if (!only || !strcmp(only, "cc"))
+      bench_resampler("resampler", "C", &CC_resampler, RESAMPLER_QUALITY_DONTCARE, 0, input, output);
+   if (!only || !strcmp(only, "convert"))
+      bench_converters();
+
+   free(input);
+   free(output);
+   return 0;
+}
@@ -0,0 +1,307 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ * 
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Measures throughput of the DSP filter plugins, offering each the SIMD features this CPU has.
+// Every SIMD implementation is also checked against the C one on the same input.
+
+#include "../filters/dspfilter.h"
+#include "../../libretro.h"
+#include "../../performance.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define BENCH_RATE 48000.0f
+#define BENCH_FRAMES 1024 // About what audio_flush() hands the DSP in one go.
+#define BENCH_CHECK_BLOCKS 64
+#define BENCH_USEC 500000
+
+extern const struct dspfilter_implementation *iir_dspfilter_get_implementation(dspfilter_simd_mask_t mask);
+extern const struct dspfilter_implementation *echo_dspfilter_get_implementation(dspfilter_simd_mask_t mask);
+extern const struct dspfilter_implementation *reverb_dspfilter_get_implementation(dspfilter_simd_mask_t mask);
+extern const struct dspfilter_implementation *chorus_dspfilter_get_implementation(dspfilter_simd_mask_t mask);
+extern const struct dspfilter_implementation *phaser_dspfilter_get_implementation(dspfilter_simd_mask_t mask);
+extern const struct dspfilter_implementation *wahwah_dspfilter_get_implementation(dspfilter_simd_mask_t mask);
+extern const struct dspfilter_implementation *eq_dspfilter_get_implementation(dspfilter_simd_mask_t mask);
+
+// Plugins get their defaults, apart from the keys listed here.
+struct bench_key
+{
+   const char *key;
+   const char *value;
+};
+
+struct bench_plug
+{
+   const char *ident;
+   dspfilter_get_implementation_t get[2]; // Stacked like the .dsp presets when there are two.
+   struct bench_key keys[4];
+};
+
+static const struct bench_plug bench_plugs[] = {
+   { "iir", { iir_dspfilter_get_implementation } },
+   { "wahwah", { wahwah_dspfilter_get_implementation } },
+   { "phaser", { phaser_dspfilter_get_implementation }, { { "stages", "8" } } },
+   { "chorus", { chorus_dspfilter_get_implementation } },
+   { "echo", { echo_dspfilter_get_implementation } },
+   { "echo-7", { echo_dspfilter_get_implementation },
+      { { "delay", "60 80 120 172 200 320 380" }, { "feedback", "0.5 0.5 0.4 0.3 0.5 0.3 0.2" }, { "amp", "0.12" } } },
+   { "reverb", { reverb_dspfilter_get_implementation } },
+   // EchoReverb.dsp
+   { "echo+reverb", { echo_dspfilter_get_implementation, reverb_dspfilter_get_implementation },
+      { { "delay", "200" }, { "feedback", "0.6" }, { "amp", "0.25" } } },
+   // EQ.dsp with a few bands, at the default and at a finer spectral resolution,
+   // each also at the lower latency of a smaller partition size.
+#define BENCH_EQ_BANDS { "frequencies", "32 64 125 250 500 1000 2000 4000 8000 16000" }, { "gains", "6 4 2 0 -2 0 2 4 2 0" }
+   { "eq", { eq_dspfilter_get_implementation }, { BENCH_EQ_BANDS } },
+   { "eq-p64", { eq_dspfilter_get_implementation }, { BENCH_EQ_BANDS, { "partition_size_log2", "6" } } },
+   { "eq-1024", { eq_dspfilter_get_implementation }, { BENCH_EQ_BANDS, { "block_size_log2", "10" } } },
+   { "eq-1024-p128", { eq_dspfilter_get_implementation },
+      { BENCH_EQ_BANDS, { "block_size_log2", "10" }, { "partition_size_log2", "7" } } },
+#undef BENCH_EQ_BANDS
+};
+
+static const char *bench_lookup(void *userdata, const char *key)
+{
+   const struct bench_plug *plug = (const struct bench_plug*)userdata;
+   unsigned i;
+   for (i = 0; i < sizeof(plug->keys) / sizeof(plug->keys[0]) && plug->keys[i].key; i++)
+      if (!strcmp(plug->keys[i].key, key))
+         return plug->keys[i].value;
+   return NULL;
+}
+
+static int bench_get_float(void *userdata, const char *key, float *value, float default_value)
+{
+   const char *str = bench_lookup(userdata, key);
+   *value = str ? strtod(str, NULL) : default_value;
+   return str != NULL;
+}
+
+static int bench_get_int(void *userdata, const char *key, int *value, int default_value)
+{
+   const char *str = bench_lookup(userdata, key);
+   *value = str ? strtol(str, NULL, 0) : default_value;
+   return str != NULL;
+}
+
+static int bench_get_float_array(void *userdata, const char *key,
+      float **values, unsigned *out_num_values,
+      const float *default_values, unsigned num_default_values)
+{
+   const char *str = bench_lookup(userdata, key);
+   float parsed[32];
+   unsigned num = 0;
+
+   if (str)
+   {
+      char *end;
+      for (;;)
+      {
+         float v = strtod(str, &end);
+         if (end == str || num >= 32)
+            break;
+         parsed[num++] = v;
+         str = end;
+      }
+      default_values = parsed;
+      num_default_values = num;
+   }
+
+   *values = (float*)malloc(num_default_values * sizeof(float));
+   memcpy(*values, default_values, num_default_values * sizeof(float));
+   *out_num_values = num_default_values;
+   return str != NULL;
+}
+
+static int bench_get_int_array(void *userdata, const char *key,
+      int **values, unsigned *out_num_values,
+      const int *default_values, unsigned num_default_values)
+{
+   (void)userdata;
+   (void)key;
+   *values = (int*)malloc(num_default_values * sizeof(int));
+   memcpy(*values, default_values, num_default_values * sizeof(int));
+   *out_num_values = num_default_values;
+   return 0;
+}
+
+static int bench_get_string(void *userdata, const char *key, char **output, const char *default_output)
+{
+   const char *str = bench_lookup(userdata, key);
+   *output = strdup(str ? str : default_output);
+   return str != NULL;
+}
+
+static const struct dspfilter_config bench_config = {
+   bench_get_float,
+   bench_get_int,
+   bench_get_float_array,
+   bench_get_int_array,
+   bench_get_string,
+   free,
+};
+
+struct bench_chain
+{
+   const struct dspfilter_implementation *impl[2];
+   void *data[2];
+   unsigned num;
+};
+
+static bool bench_chain_init(struct bench_chain *chain, const struct bench_plug *plug, dspfilter_simd_mask_t mask)
+{
+   struct dspfilter_info info = { BENCH_RATE };
+   memset(chain, 0, sizeof(*chain));
+
+   for (chain->num = 0; chain->num < 2 && plug->get[chain->num]; chain->num++)
+   {
+      chain->impl[chain->num] = plug->get[chain->num](mask);
+      chain->data[chain->num] = chain->impl[chain->num]->init(&info, &bench_config, (void*)plug);
+      if (!chain->data[chain->num])
+         return false;
+   }
+   return true;
+}
+
+static void bench_chain_free(struct bench_chain *chain)
+{
+   unsigned i;
+   for (i = 0; i < chain->num; i++)
+      chain->impl[i]->free(chain->data[i]);
+}
+
+static const float *bench_chain_process(struct bench_chain *chain, float *samples, unsigned frames)
+{
+   unsigned i;
+   struct dspfilter_output output = { samples, frames };
+   for (i = 0; i < chain->num; i++)
+   {
+      struct dspfilter_input input = { output.samples, output.frames };
+      chain->impl[i]->process(chain->data[i], &output, &input);
+   }
+   return output.samples;
+}
+
+// Largest difference to the C implementation over a few seconds of noise.
+static float bench_check(const struct bench_plug *plug, dspfilter_simd_mask_t mask, const float *input)
+{
+   struct bench_chain ref, simd;
+   float buf_ref[BENCH_FRAMES * 2], buf_simd[BENCH_FRAMES * 2];
+   float max_diff = 0.0f;
+   unsigned b, i;
+
+   if (!bench_chain_init(&ref, plug, 0) || !bench_chain_init(&simd, plug, mask))
+      return INFINITY;
+
+   for (b = 0; b < BENCH_CHECK_BLOCKS; b++)
+   {
+      memcpy(buf_ref, input, sizeof(buf_ref));
+      memcpy(buf_simd, input, sizeof(buf_simd));
+      const float *out_ref = bench_chain_process(&ref, buf_ref, BENCH_FRAMES);
+      const float *out_simd = bench_chain_process(&simd, buf_simd, BENCH_FRAMES);
+
+      for (i = 0; i < BENCH_FRAMES * 2; i++)
+      {
+         float diff = fabsf(out_ref[i] - out_simd[i]);
+         if (!(diff <= max_diff))
+            max_diff = diff;
+      }
+   }
+
+   bench_chain_free(&ref);
+   bench_chain_free(&simd);
+   return max_diff;
+}
+
+// Frames per second.
+static double bench_run(const struct bench_plug *plug, dspfilter_simd_mask_t mask, const float *input)
+{
+   struct bench_chain chain;
+   float buf[BENCH_FRAMES * 2];
+
+   if (!bench_chain_init(&chain, plug, mask))
+      return 0.0;
+
+   uint64_t frames = 0;
+   retro_time_t start = rarch_get_time_usec();
+   retro_time_t elapsed;
+   do
+   {
+      memcpy(buf, input, sizeof(buf));
+      bench_chain_process(&chain, buf, BENCH_FRAMES);
+      frames += BENCH_FRAMES;
+      elapsed = rarch_get_time_usec() - start;
+   } while (elapsed < BENCH_USEC);
+
+   bench_chain_free(&chain);
+   return frames * 1000000.0 / elapsed;
+}
+
+int main(void)
+{
+   static const struct
+   {
+      const char *ident;
+      dspfilter_simd_mask_t mask;
+   } kernels[] = {
+      { "C", 0 },
+      { "SSE", RETRO_SIMD_SSE },
+      { "+AVX", RETRO_SIMD_SSE | RETRO_SIMD_AVX },
+      { "NEON", RETRO_SIMD_NEON },
+   };
+
+   float input[BENCH_FRAMES * 2];
+   unsigned i, p, k;
+   for (i = 0; i < BENCH_FRAMES * 2; i++)
+      input[i] = 0.5f * ((2.0f * rand()) / RAND_MAX - 1.0f);
+
+   dspfilter_simd_mask_t cpu = rarch_get_cpu_features();
+   printf("Mframes/s through each plugin at %.0f Hz, and the largest difference to the C output.\n", BENCH_RATE);
+   printf("%-12s %-32s %10s %12s %10s\n", "plugin", "implementation", "Mframes/s", "frame_usec", "max_diff");
+
+   for (p = 0; p < sizeof(bench_plugs) / sizeof(bench_plugs[0]); p++)
+   {
+      const struct dspfilter_implementation *last = NULL;
+      for (k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+      {
+         if ((cpu & kernels[k].mask) != kernels[k].mask)
+            continue;
+
+         // Skip masks which don't change what the plugin picks.
+         const struct dspfilter_implementation *impl = bench_plugs[p].get[bench_plugs[p].get[1] ? 1 : 0](kernels[k].mask);
+         const struct dspfilter_implementation *first = bench_plugs[p].get[0](kernels[k].mask);
+         if (k && impl == last && first == bench_plugs[p].get[0](kernels[k - 1].mask))
+            continue;
+         last = impl;
+
+         char ident[64];
+         if (bench_plugs[p].get[1])
+            snprintf(ident, sizeof(ident), "%s + %s", first->ident, impl->ident);
+         else
+            snprintf(ident, sizeof(ident), "%s", impl->ident);
+
+         double fps = bench_run(&bench_plugs[p], kernels[k].mask, input);
+         float diff = k ? bench_check(&bench_plugs[p], kernels[k].mask, input) : 0.0f;
+         // frame_usec is the cost of one 60 fps video frame worth of audio.
+         printf("%-12s %-32s %10.2f %12.2f %10.2g\n", bench_plugs[p].ident, ident,
+               fps / 1000000.0, (BENCH_RATE / 60.0) / fps * 1000000.0, diff);
+      }
+   }
+
+   return 0;
+}
+
@@ -0,0 +1,180 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ * 
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Pushes audio through a buffer shared by a writer and a worker thread, the way alsathread does,
+// once with fifo_buffer behind a mutex and a condition signaled on every read, and once with fifo_spsc.
+
+#include "../../fifo_buffer.h"
+#include "../../thread.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#define BENCH_BUFFER (16 * 1024)
+#define BENCH_PERIOD 1024
+#define BENCH_WRITE 3200 // About a frame of 48 kHz stereo S16 at 60 fps.
+#define BENCH_BYTES (256 * 1024 * 1024)
+
+typedef int64_t retro_time_t;
+
+static retro_time_t bench_time_usec(void)
+{
+   struct timespec tv;
+   clock_gettime(CLOCK_MONOTONIC, &tv);
+   return (retro_time_t)tv.tv_sec * 1000000 + tv.tv_nsec / 1000;
+}
+
+struct bench
+{
+   bool spsc;
+   fifo_buffer_t *fifo;
+   slock_t *fifo_lock;
+   fifo_spsc_t *ring;
+   volatile bool writer_waiting;
+
+   slock_t *cond_lock;
+   scond_t *cond;
+   volatile bool done;
+
+   uint64_t waits;
+   uint64_t worker_locks;
+   retro_time_t max_write_usec;
+};
+
+static void bench_worker(void *data)
+{
+   struct bench *b = (struct bench*)data;
+   uint8_t buf[BENCH_PERIOD];
+
+   while (!b->done)
+   {
+      if (b->spsc)
+      {
+         fifo_spsc_read(b->ring, buf, sizeof(buf));
+         __sync_synchronize();
+         if (b->writer_waiting)
+         {
+            b->worker_locks++;
+            slock_lock(b->cond_lock);
+            scond_signal(b->cond);
+            slock_unlock(b->cond_lock);
+         }
+      }
+      else
+      {
+         b->worker_locks++;
+         slock_lock(b->fifo_lock);
+         size_t avail = fifo_read_avail(b->fifo);
+         fifo_read(b->fifo, buf, avail < sizeof(buf) ? avail : sizeof(buf));
+         scond_signal(b->cond);
+         slock_unlock(b->fifo_lock);
+      }
+   }
+}
+
+static void bench_write(struct bench *b, const uint8_t *data, size_t size)
+{
+   size_t written = 0;
+   while (written < size)
+   {
+      if (b->spsc)
+      {
+         size_t amt = fifo_spsc_write(b->ring, data + written, size - written);
+         if (!amt)
+         {
+            slock_lock(b->cond_lock);
+            b->writer_waiting = true;
+            __sync_synchronize();
+            if (!fifo_spsc_write_avail(b->ring))
+            {
+               scond_wait(b->cond, b->cond_lock);
+               b->waits++;
+            }
+            b->writer_waiting = false;
+            slock_unlock(b->cond_lock);
+         }
+         written += amt;
+      }
+      else
+      {
+         slock_lock(b->fifo_lock);
+         size_t avail = fifo_write_avail(b->fifo);
+         if (!avail)
+         {
+            scond_wait(b->cond, b->fifo_lock);
+            b->waits++;
+         }
+         else
+         {
+            size_t amt = size - written < avail ? size - written : avail;
+            fifo_write(b->fifo, data + written, amt);
+            written += amt;
+         }
+         slock_unlock(b->fifo_lock);
+      }
+   }
+}
+
+static void bench_run(bool spsc)
+{
+   static uint8_t data[BENCH_WRITE];
+   struct bench b = {0};
+   b.spsc = spsc;
+   b.cond_lock = slock_new();
+   b.fifo_lock = b.cond_lock;
+   b.cond = scond_new();
+   if (spsc)
+      b.ring = fifo_spsc_new(BENCH_BUFFER);
+   else
+      b.fifo = fifo_new(BENCH_BUFFER);
+
+   sthread_t *worker = sthread_create(bench_worker, &b);
+
+   uint64_t bytes;
+   retro_time_t start = bench_time_usec();
+   for (bytes = 0; bytes < BENCH_BYTES; bytes += sizeof(data))
+   {
+      retro_time_t write_start = bench_time_usec();
+      bench_write(&b, data, sizeof(data));
+      retro_time_t write_usec = bench_time_usec() - write_start;
+      if (write_usec > b.max_write_usec)
+         b.max_write_usec = write_usec;
+   }
+   retro_time_t elapsed = bench_time_usec() - start;
+
+   b.done = true;
+   sthread_join(worker);
+
+   printf("%-6s %10.1f %10llu %14llu %14lld\n", spsc ? "spsc" : "locked",
+         bytes / (double)elapsed, (unsigned long long)b.waits,
+         (unsigned long long)b.worker_locks, (long long)b.max_write_usec);
+
+   if (spsc)
+      fifo_spsc_free(b.ring);
+   else
+      fifo_free(b.fifo);
+   scond_free(b.cond);
+   slock_free(b.cond_lock);
+}
+
+int main(void)
+{
+   printf("%-6s %10s %10s %14s %14s\n", "fifo", "MB/s", "waits", "worker_locks", "max_write_us");
+   bench_run(false);
+   bench_run(true);
+   return 0;
+}
+
@@ -0,0 +1,126 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ * 
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Measures sinc resampler throughput for every quality tier, offering it each set of SIMD features this CPU has.
+// Tiers with few taps stay on SSE even where AVX is offered, as that's faster for them.
+// Each is run at a fixed ratio, and at one which moves on every call like it does under dynamic rate control.
+
+#include "../resampler.h"
+#include "../../libretro.h"
+#include "../../performance.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BENCH_FRAMES 4096
+#define BENCH_USEC 500000
+
+// Output frames per second.
+static double bench_run(void *re, const float *input, float *output, double ratio, double deviation)
+{
+   struct resampler_data data = {
+      .data_in = input,
+      .data_out = output,
+      .input_frames = BENCH_FRAMES,
+      .ratio = ratio,
+   };
+
+   // Warm up the tables, and let a fixed ratio settle in.
+   unsigned i;
+   for (i = 0; i < 32; i++)
+      sinc_resampler.process(re, &data);
+
+   uint64_t frames = 0;
+   unsigned calls = 0;
+   retro_time_t start = rarch_get_time_usec();
+   retro_time_t elapsed;
+   do
+   {
+      data.ratio = ratio * (1.0 + (calls++ & 1 ? deviation : -deviation));
+      sinc_resampler.process(re, &data);
+      frames += data.output_frames;
+      elapsed = rarch_get_time_usec() - start;
+   } while (elapsed < BENCH_USEC);
+
+   return frames * 1000000.0 / elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+   static const char *qualities[] = { "lowest", "lower", "normal", "higher", "highest" };
+   static const struct
+   {
+      const char *ident;
+      resampler_simd_mask_t mask;
+   } kernels[] = {
+      { "C", 0 },
+      { "SSE", RETRO_SIMD_SSE },
+      { "+AVX", RETRO_SIMD_SSE | RETRO_SIMD_AVX },
+      { "+AVX2/FMA", RETRO_SIMD_SSE | RETRO_SIMD_AVX | RETRO_SIMD_AVX2 },
+      { "NEON", RETRO_SIMD_NEON },
+   };
+
+   if (argc > 3)
+   {
+      fprintf(stderr, "Usage: %s [in-rate] [out-rate]\n", argv[0]);
+      return 1;
+   }
+
+   double in_rate = argc > 1 ? strtod(argv[1], NULL) : 44100.0;
+   double out_rate = argc > 2 ? strtod(argv[2], NULL) : 48000.0;
+   double ratio = out_rate / in_rate;
+   if (ratio >= 7.99)
+   {
+      fprintf(stderr, "Ratio is too high.\n");
+      return 1;
+   }
+
+   float *input = (float*)malloc(BENCH_FRAMES * 2 * sizeof(float));
+   float *output = (float*)malloc(BENCH_FRAMES * 2 * 8 * sizeof(float));
+   if (!input || !output)
+      return 1;
+
+   unsigned i, q, k;
+   for (i = 0; i < BENCH_FRAMES * 2; i++)
+      input[i] = (2.0f * rand()) / RAND_MAX - 1.0f;
+
+   uint64_t cpu = rarch_get_cpu_features();
+   printf("Mframes/s out of the resampler, realtime is at the fixed ratio.\n");
+   printf("%-8s %-9s %12s %12s %10s\n", "quality", "simd", "fixed", "varying", "realtime");
+
+   for (q = RESAMPLER_QUALITY_LOWEST; q <= RESAMPLER_QUALITY_HIGHEST; q++)
+   {
+      for (k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+      {
+         if ((cpu & kernels[k].mask) != kernels[k].mask)
+            continue;
+
+         void *re = sinc_resampler.init(ratio, (enum resampler_quality)q, kernels[k].mask);
+         if (!re)
+            return 1;
+
+         double fixed = bench_run(re, input, output, ratio, 0.0);
+         double varying = bench_run(re, input, output, ratio, 0.001);
+         printf("%-8s %-9s %12.2f %12.2f %9.1fx\n", qualities[q - RESAMPLER_QUALITY_LOWEST], kernels[k].ident,
+               fixed / 1000000.0, varying / 1000000.0, fixed / out_rate);
+
+         sinc_resampler.free(re);
+      }
+   }
+
+   free(input);
+   free(output);
+   return 0;
+}
+
@@ -0,0 +1,29 @@
+#!/bin/sh
+
+# Compares two bench-audio CSV files, e.g. from before and after a change:
+# ./bench-audio > old.csv; (change, rebuild); ./bench-audio > new.csv; ./compare-bench-audio.sh old.csv new.csv
+# Lists each case with its change in ns_per_frame, slowest first,
+# and exits with failure if any case got slower than the threshold in percent (default 10).
+
+if [ $# -lt 2 ]; then
+   echo "Usage: $0 old.csv new.csv [threshold-percent]" >&2
+   exit 1
+fi
+
+awk -F, -v threshold="${3:-10}" '
+   FNR == 1 { next }
+   { key = $1 "," $2 "," $3 "," $4 "," $5 "," $6 }
+   FNR == NR { old[key] = $8; next }
+   key in old && old[key] > 0 {
+      change = ($8 - old[key]) * 100.0 / old[key]
+      printf "%+7.1f%% %10.3f %10.3f %s\n", change, old[key], $8, key | "sort -rn"
+      if (change > threshold)
+         slower++
+   }
+   END {
+      close("sort -rn")
+      if (slower) {
+         printf "%d cases got more than %s%% slower.\n", slower, threshold > "/dev/stderr"
+         exit 1
+      }
+   }' "$1" "$2"
@@ -0,0 +1,177 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ * 
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Simulates dynamic rate control against an audio device, at a range of audio_latency settings.
+// The device drains its buffer on its own clock, but like most drivers only reports free space
+// in whole periods. On underrun it stops until the buffer is half full again,
+// like ALSA with the start threshold RetroArch sets.
+// Video runs at 60 Hz on a clock which differs from the device's by a given amount,
+// and each frame's audio is written after a randomly varying amount of emulation work.
+// Writes block while the buffer is full, and the next frame then waits for the next vsync.
+
+#include "../rate_control.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#define SIM_RATE 48000.0
+#define SIM_FPS 60.0
+#define SIM_PERIODS 4
+
+enum sim_controller
+{
+   SIM_NONE = 0,
+   SIM_P, // What rate control used to be. Proportional only, aiming for a half full buffer before each write.
+   SIM_PI
+};
+
+struct sim_result
+{
+   unsigned underruns;
+   unsigned blocked;
+   double fill_accum;
+   uint64_t writes;
+   double adjust;
+};
+
+static uint32_t sim_rand_state;
+
+static double sim_rand(void)
+{
+   sim_rand_state = sim_rand_state * 1664525u + 1013904223u;
+   return (sim_rand_state >> 8) / 16777216.0;
+}
+
+// clock_diff is how much faster the device consumes than nominal.
+static void simulate(struct sim_result *res, enum sim_controller controller,
+      double delta, double integral_gain,
+      unsigned latency_ms, double clock_diff, double seconds)
+{
+   rarch_rate_control_t rc;
+   double capacity = floor(latency_ms * SIM_RATE / 1000.0);
+   double period = capacity / SIM_PERIODS;
+   double rate = SIM_RATE * (1.0 + clock_diff);
+
+   double written = 0.0; // Frames written since the device last started.
+   double start = 0.0; // When the device last started.
+   int running = 0;
+   double carry = 0.0;
+   uint64_t frame = 0;
+
+   rarch_rate_control_init(&rc, delta, controller == SIM_PI ? integral_gain : 0.0);
+   if (controller != SIM_PI)
+      rc.filter_time = 0.0;
+
+   sim_rand_state = 1;
+   res->underruns = 0;
+   res->blocked = 0;
+   res->fill_accum = 0.0;
+   res->writes = 0;
+   res->adjust = 1.0;
+
+   while (frame < seconds * SIM_FPS)
+   {
+      // Emulation work, with the occasional long frame.
+      double work = 0.002 + 0.006 * sim_rand();
+      if (sim_rand() < 0.01)
+         work += 0.006;
+      double t = frame / SIM_FPS + work;
+
+      double consumed = running ? (t - start) * rate : 0.0;
+      if (consumed > written)
+      {
+         // Ran dry some time since the last write.
+         res->underruns++;
+         running = 0;
+         written = consumed = 0.0;
+      }
+
+      double fill = written - consumed;
+      double reported_fill = written - floor(consumed / period) * period;
+      res->fill_accum += fill / capacity;
+      res->writes++;
+
+      double out = SIM_RATE / SIM_FPS;
+      double adjust = 1.0;
+      if (controller != SIM_NONE)
+      {
+         size_t write_size = (size_t)out;
+         adjust = rarch_rate_control_update(&rc, (size_t)(capacity - reported_fill),
+               (size_t)capacity, write_size, 1.0 / SIM_FPS);
+      }
+      res->adjust = adjust;
+
+      out = out * adjust + carry;
+      unsigned frames = (unsigned)out;
+      carry = out - frames;
+
+      // The device starts partway into the write that crosses the threshold.
+      if (!running && written + frames >= capacity / 2.0)
+      {
+         running = 1;
+         start = t;
+         consumed = 0.0;
+      }
+
+      // Blocking write. The driver wakes up once a period has been played.
+      if (fill + frames > capacity)
+      {
+         res->blocked++;
+         if (running)
+         {
+            consumed = ceil((consumed + fill + frames - capacity) / period) * period;
+            t = start + consumed / rate;
+         }
+      }
+      written += frames;
+
+      // Next frame starts at the first vsync after the write returns.
+      uint64_t next_frame = (uint64_t)(t * SIM_FPS) + 1;
+      frame = next_frame > frame + 1 ? next_frame : frame + 1;
+   }
+}
+
+int main(int argc, char *argv[])
+{
+   static const unsigned latencies[] = { 16, 24, 32, 48, 64 };
+   double clock_diff = argc > 1 ? strtod(argv[1], NULL) / 100.0 : 0.002;
+   double seconds = argc > 2 ? strtod(argv[2], NULL) : 600.0;
+   double delta = argc > 3 ? strtod(argv[3], NULL) : 0.005;
+   double integral = argc > 4 ? strtod(argv[4], NULL) : 0.005;
+   unsigned i, c;
+
+   printf("Device clock %+.3f %% off video, %.0f seconds, delta %g, integral gain %g.\n",
+         clock_diff * 100.0, seconds, delta, integral);
+   printf("%-10s %-12s %10s %10s %10s %10s\n",
+         "latency", "controller", "underruns", "blocked", "avg_fill", "adjust");
+
+   for (i = 0; i < sizeof(latencies) / sizeof(latencies[0]); i++)
+   {
+      for (c = SIM_NONE; c <= SIM_PI; c++)
+      {
+         static const char *names[] = { "none", "P (old)", "PI" };
+         struct sim_result res;
+
+         simulate(&res, (enum sim_controller)c, delta, integral, latencies[i], clock_diff, seconds);
+         printf("%-10u %-12s %10u %10u %9.1f%% %10.5f\n",
+               latencies[i], names[c], res.underruns, res.blocked,
+               100.0 * res.fill_accum / res.writes, res.adjust);
+      }
+   }
+
+   return 0;
+}
+
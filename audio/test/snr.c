@@ -235,19 +235,28 @@ static void calculate_snr(struct snr_result *res,
       res->alias_power[i] = 10.0 * log10(res->alias_power[i]);
 }
 
+#define SNR_BLOCK_FRAMES 1024
+
 int main(int argc, char *argv[])
 {
-   if (argc != 2)
+   if (argc < 2 || argc > 4)
    {
-      fprintf(stderr, "Usage: %s <ratio> (out-rate is fixed for FFT).\n", argv[0]);
+      fprintf(stderr, "Usage: %s <ratio> [quality 1-5] [drift] (out-rate is fixed for FFT).\n"
+            "Drift runs the resampler set up for ratio at ratio * (1 + drift), like dynamic rate control does.\n", argv[0]);
       return 1;
    }
 
    double ratio = strtod(argv[1], NULL);
+   enum resampler_quality quality = argc >= 3 ? (enum resampler_quality)strtoul(argv[2], NULL, 0) : RESAMPLER_QUALITY_DONTCARE;
+   double drift = argc >= 4 ? strtod(argv[3], NULL) : 0.0;
 
    const unsigned fft_samples = 1024 * 128;
    unsigned out_rate = fft_samples / 2;
    unsigned in_rate = round(out_rate / ratio);
+   double nominal_ratio = (double)out_rate / in_rate;
+
+   // Tones have to land on FFT bins of the output, so drift moves the input rate.
+   in_rate = round(in_rate / (1.0 + drift));
    ratio = (double)out_rate / in_rate;
 
    static const float freq_list[] = {
@@ -269,7 +278,7 @@ int main(int argc, char *argv[])
 
    void *re = NULL;
    const rarch_resampler_t *resampler = NULL;
-   if (!rarch_resampler_realloc(&re, &resampler, NULL, ratio))
+   if (!rarch_resampler_realloc(&re, &resampler, NULL, quality, nominal_ratio))
       return 1;
 
    test_fft();
@@ -280,14 +289,24 @@ int main(int argc, char *argv[])
       double omega = 2.0 * M_PI * freq / in_rate;
       gen_signal(input, omega, 0, samples);
 
-      struct resampler_data data = {
-         .data_in = input,
-         .data_out = output,
-         .input_frames = in_rate * 2,
-         .ratio = ratio,
-      };
-
-      rarch_resampler_process(resampler, re, &data);
+      // Fed a block at a time like audio_flush() does, which lets the fixed ratio path of sinc kick in.
+      unsigned pos, out_frames = 0;
+      for (pos = 0; pos < in_rate * 2; pos += SNR_BLOCK_FRAMES)
+      {
+         struct resampler_data data = {
+            .data_in = input + pos * 2,
+            .data_out = output + out_frames * 2,
+            .input_frames = min(SNR_BLOCK_FRAMES, in_rate * 2 - pos),
+            .ratio = ratio,
+         };
+
+         // Rate control never asks for quite the same ratio twice.
+         if (drift != 0.0)
+            data.ratio *= 1.0 + ((pos / SNR_BLOCK_FRAMES) & 1 ? 1e-9 : -1e-9);
+
+         rarch_resampler_process(resampler, re, &data);
+         out_frames += data.output_frames;
+      }
 
       // We generate 2 seconds worth of audio, however, only the last second is considered so phase has stabilized.
       struct snr_result res = {0};
@@ -0,0 +1,141 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Pauses and unpauses the audio pipeline thread while it is writing to a driver which blocks,
+// the way driver_audio_stop() and driver_audio_start() do.
+// Like Pulse or ALSA, the fake driver stops draining while stopped, so a write into it never returns.
+// A watchdog fails the test if that happens.
+
+#include "../pipeline_thread.h"
+#include "../../thread.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+
+#define TEST_QUEUE 2048
+#define TEST_PUSH 1600 // A frame of 48 kHz stereo at 60 fps.
+#define TEST_DEVICE (2 * TEST_PUSH)
+#define TEST_DRAIN 96 // Samples played per ms.
+#define TEST_ROUNDS 200
+
+static struct
+{
+   slock_t *lock;
+   scond_t *cond;
+   size_t fill;
+   bool running;
+   bool quit;
+} dev;
+
+static void device_thread(void *data)
+{
+   (void)data;
+   slock_lock(dev.lock);
+   while (!dev.quit)
+   {
+      if (dev.running)
+      {
+         dev.fill = dev.fill > TEST_DRAIN ? dev.fill - TEST_DRAIN : 0;
+         scond_signal(dev.cond);
+      }
+      slock_unlock(dev.lock);
+      usleep(1000);
+      slock_lock(dev.lock);
+   }
+   slock_unlock(dev.lock);
+}
+
+// A blocking write.
+static bool device_write(const int16_t *data, size_t samples)
+{
+   (void)data;
+   slock_lock(dev.lock);
+   while (dev.fill + samples > TEST_DEVICE)
+      scond_wait(dev.cond, dev.lock);
+   dev.fill += samples;
+   slock_unlock(dev.lock);
+   return true;
+}
+
+static void device_set_running(bool running)
+{
+   slock_lock(dev.lock);
+   dev.running = running;
+   slock_unlock(dev.lock);
+}
+
+static void watchdog(int sig)
+{
+   (void)sig;
+   static const char msg[] = "FAILED: pipeline deadlocked on pause.\n";
+   write(STDERR_FILENO, msg, sizeof(msg) - 1);
+   _exit(1);
+}
+
+int main(void)
+{
+   static int16_t frame[TEST_PUSH];
+   unsigned i, j;
+
+   dev.lock = slock_new();
+   dev.cond = scond_new();
+   dev.running = true;
+   sthread_t *dev_thread = sthread_create(device_thread, NULL);
+
+   rarch_audio_pipeline_t *pipe = rarch_audio_pipeline_new(TEST_QUEUE, device_write);
+   if (!pipe)
+      return 1;
+
+   signal(SIGALRM, watchdog);
+   alarm(30);
+
+   for (i = 0; i < TEST_ROUNDS; i++)
+   {
+      // Run with audio sync, so the pipeline thread is mostly blocked in a write.
+      for (j = 0; j < 1 + i % 4; j++)
+         rarch_audio_pipeline_push(pipe, frame, TEST_PUSH);
+
+      // driver_audio_stop()
+      rarch_audio_pipeline_stop(pipe);
+      rarch_audio_pipeline_lock(pipe);
+      device_set_running(false);
+      rarch_audio_pipeline_unlock(pipe);
+
+      // Whatever the core pushes while stopped must not block or reach the driver.
+      for (j = 0; j < 4; j++)
+         rarch_audio_pipeline_push(pipe, frame, TEST_PUSH);
+      usleep(1000 * (i % 3));
+
+      // driver_audio_start()
+      rarch_audio_pipeline_lock(pipe);
+      device_set_running(true);
+      rarch_audio_pipeline_unlock(pipe);
+      rarch_audio_pipeline_start(pipe);
+   }
+
+   rarch_audio_pipeline_free(pipe);
+   alarm(0);
+
+   slock_lock(dev.lock);
+   dev.quit = true;
+   slock_unlock(dev.lock);
+   sthread_join(dev_thread);
+   slock_free(dev.lock);
+   scond_free(dev.cond);
+
+   printf("%u pauses, no deadlock.\n", TEST_ROUNDS);
+   return 0;
+}
@@ -1,3 +1,25 @@
 #!/bin/sh
 
-ffmpeg -i "$1" -f s16le - | ./test-sinc-highest 44100 48000 $3 | ffmpeg -y -ar 48000 -f s16le -ac 2 -i - "$2"
+# With an input and output file, resamples audio through sinc, at the ratio given by the third argument.
+# Without arguments, simulates dynamic rate control at a few audio clock differences,
+# comparing underruns and blocked writes for different audio_latency settings.
+# Extra arguments after "sim" go to sim-rate-control:
+# clock difference in percent, seconds, delta and integral gain.
+
+if [ $# -ge 2 ] && [ "$1" != "sim" ]; then
+   ffmpeg -i "$1" -f s16le - | ./test-sinc-highest 44100 48000 $3 | ffmpeg -y -ar 48000 -f s16le -ac 2 -i - "$2"
+   exit $?
+fi
+
+make sim-rate-control >/dev/null || exit 1
+
+if [ "$1" = "sim" ]; then
+   shift
+   ./sim-rate-control "$@"
+   exit $?
+fi
+
+for diff in 0.05 0.2 -0.2; do
+   ./sim-rate-control $diff
+   echo
+done
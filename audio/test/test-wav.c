@@ -0,0 +1,149 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ * 
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Checks that the WAV sink driver paces writes like a sound card would, and writes a valid file.
+
+#include "../../driver.h"
+#include "../../performance.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_RATE 48000
+#define TEST_LATENCY 64
+#define TEST_SECONDS 2
+#define TEST_CHUNK 800
+
+static int failed;
+
+#define CHECK(cond) do { \
+   if (!(cond)) \
+   { \
+      fprintf(stderr, "FAILED: %s (line %d)\n", #cond, __LINE__); \
+      failed = 1; \
+   } \
+} while (0)
+
+static uint32_t read_le(const uint8_t *data, unsigned bytes)
+{
+   unsigned i;
+   uint32_t val = 0;
+   for (i = 0; i < bytes; i++)
+      val |= (uint32_t)data[i] << (8 * i);
+   return val;
+}
+
+static void check_file(const char *path, unsigned frames, unsigned frame_size)
+{
+   uint8_t header[44];
+   FILE *file = fopen(path, "rb");
+   CHECK(file);
+   if (!file)
+      return;
+
+   fseek(file, 0, SEEK_END);
+   long size = ftell(file);
+   rewind(file);
+   CHECK(fread(header, 1, sizeof(header), file) == sizeof(header));
+   fclose(file);
+
+   CHECK(size == 44 + (long)frames * frame_size);
+   CHECK(memcmp(header, "RIFF", 4) == 0);
+   CHECK(read_le(header + 4, 4) == size - 8);
+   CHECK(memcmp(header + 8, "WAVEfmt ", 8) == 0);
+   CHECK(read_le(header + 20, 2) == (frame_size == 8 ? 3 : 1));
+   CHECK(read_le(header + 22, 2) == 2);
+   CHECK(read_le(header + 24, 4) == TEST_RATE);
+   CHECK(read_le(header + 32, 2) == frame_size);
+   CHECK(memcmp(header + 36, "data", 4) == 0);
+   CHECK(read_le(header + 40, 4) == frames * frame_size);
+}
+
+// Blocking writes as fast as possible should take as long as the audio minus what fits in the buffer.
+static void test_blocking(const char *path)
+{
+   static float buf[2 * TEST_CHUNK];
+   unsigned i;
+   void *wav = audio_wav.init(path, TEST_RATE, TEST_LATENCY);
+   CHECK(wav);
+   if (!wav)
+      return;
+   CHECK(audio_wav.use_float(wav));
+
+   size_t buffer_size = audio_wav.buffer_size(wav);
+   CHECK(buffer_size == TEST_RATE * TEST_LATENCY / 1000 * sizeof(buf[0]) * 2);
+   CHECK(audio_wav.write_avail(wav) == buffer_size);
+
+   unsigned chunks = TEST_SECONDS * TEST_RATE / TEST_CHUNK;
+   retro_time_t start = rarch_get_time_usec();
+   for (i = 0; i < chunks; i++)
+      CHECK(audio_wav.write(wav, buf, sizeof(buf)) == sizeof(buf));
+   double elapsed = (rarch_get_time_usec() - start) / 1000000.0;
+
+   double expected = TEST_SECONDS - TEST_LATENCY / 1000.0;
+   printf("Blocking: %u s of audio written in %.3f s, expected %.3f s.\n", TEST_SECONDS, elapsed, expected);
+   CHECK(elapsed > expected - 0.01 && elapsed < expected + 0.05);
+
+   size_t period_size = buffer_size / 4;
+   CHECK(audio_wav.write_avail(wav) % period_size == 0);
+
+   audio_wav.free(wav);
+   check_file(path, chunks * TEST_CHUNK, 2 * sizeof(float));
+}
+
+// Non-blocking writes take what fits, and no more.
+static void test_nonblock(const char *path)
+{
+   static int16_t buf[2 * TEST_CHUNK * 8];
+   void *wav = audio_wav.init(path, TEST_RATE, TEST_LATENCY);
+   CHECK(wav);
+   if (!wav)
+      return;
+   CHECK(!audio_wav.use_float(wav));
+
+   audio_wav.set_nonblock_state(wav, true);
+   size_t buffer_size = audio_wav.buffer_size(wav);
+   ssize_t ret = audio_wav.write(wav, buf, sizeof(buf));
+   CHECK(ret >= 0 && (size_t)ret == buffer_size);
+   CHECK(audio_wav.write_avail(wav) < buffer_size);
+
+   // The clock should stand still while stopped.
+   rarch_sleep(TEST_LATENCY / 2);
+   size_t avail = audio_wav.write_avail(wav);
+   CHECK(avail > 0 && avail < buffer_size);
+   CHECK(audio_wav.stop(wav));
+   rarch_sleep(TEST_LATENCY);
+   CHECK(audio_wav.write_avail(wav) == avail);
+
+   // Once going again, it plays out and underruns.
+   CHECK(audio_wav.start(wav));
+   rarch_sleep(2 * TEST_LATENCY);
+   CHECK(audio_wav.write_avail(wav) == buffer_size);
+
+   audio_wav.free(wav);
+   check_file(path + 4, ret / 4, 2 * sizeof(int16_t));
+}
+
+int main(void)
+{
+   test_blocking("test-wav-float.wav");
+   test_nonblock("s16:test-wav-s16.wav");
+   remove("test-wav-float.wav");
+   remove("test-wav-s16.wav");
+
+   if (!failed)
+      printf("All tests passed.\n");
+   return failed;
+}
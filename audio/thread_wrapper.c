@@ -29,8 +29,9 @@ typedef struct audio_thread
    sthread_t *thread;
    slock_t *lock;
    scond_t *cond;
-   bool alive;
-   bool stopped;
+   // Written under lock, but read without it on every iteration of the audio loop.
+   volatile bool alive;
+   volatile bool stopped;
    bool use_float;
 
    int inited;
@@ -67,6 +68,13 @@ static void audio_thread_loop(void *data)
 
    for (;;)
    {
+      // The lock is only needed to stop or quit, the callback runs without it.
+      if (!thr->stopped && thr->alive)
+      {
+         g_extern.system.audio_callback.callback();
+         continue;
+      }
+
       slock_lock(thr->lock);
 
       if (!thr->alive)
@@ -85,7 +93,6 @@ static void audio_thread_loop(void *data)
       }
 
       slock_unlock(thr->lock);
-      g_extern.system.audio_callback.callback();
    }
 
    RARCH_LOG("[Audio Thread]: Tearing down driver.\n");
@@ -0,0 +1,288 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ * 
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Headless audio driver, for benchmarking and testing without sound hardware.
+// Samples go to a WAV file, or are only counted, but are played out on an emulated device clock:
+// - The buffer holds 'latency' ms, and the device drains it a period at a time,
+//   so free space is reported in whole periods like most sound cards do.
+// - Playback starts once the buffer is half full, and stops on underrun until it is again.
+// - Writes block while the buffer is full, unless in non-blocking state.
+//
+// audio_device is the path of the WAV file, which gets float samples.
+// Prefix it with "s16:" for 16-bit samples. Leave it empty to only count samples.
+
+#include "../driver.h"
+#include "../general.h"
+#include "../performance.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WAV_PERIODS 4
+#define WAV_HEADER_SIZE 44
+
+typedef struct wav_audio
+{
+   FILE *file;
+   bool use_float;
+   bool nonblock;
+   bool running; // Device is playing.
+   bool paused; // Stopped by the frontend.
+
+   unsigned rate;
+   size_t frame_size;
+   uint64_t buffer_frames;
+   uint64_t period_frames;
+
+   uint64_t written; // Frames written since playback last started.
+   uint64_t played_base; // Frames played at 'start'.
+   retro_time_t start;
+
+   uint64_t total_frames;
+   unsigned underruns;
+} wav_audio_t;
+
+static void wav_write_le(FILE *file, uint32_t val, unsigned bytes)
+{
+   unsigned i;
+   for (i = 0; i < bytes; i++)
+      fputc((val >> (8 * i)) & 0xff, file);
+}
+
+static void wav_write_header(wav_audio_t *wav, uint32_t data_size)
+{
+   unsigned bits = wav->use_float ? 32 : 16;
+
+   rewind(wav->file);
+   fwrite("RIFF", 1, 4, wav->file);
+   wav_write_le(wav->file, WAV_HEADER_SIZE - 8 + data_size, 4);
+   fwrite("WAVEfmt ", 1, 8, wav->file);
+   wav_write_le(wav->file, 16, 4);
+   wav_write_le(wav->file, wav->use_float ? 3 : 1, 2); // IEEE float or PCM.
+   wav_write_le(wav->file, 2, 2);
+   wav_write_le(wav->file, wav->rate, 4);
+   wav_write_le(wav->file, wav->rate * wav->frame_size, 4);
+   wav_write_le(wav->file, wav->frame_size, 2);
+   wav_write_le(wav->file, bits, 2);
+   fwrite("data", 1, 4, wav->file);
+   wav_write_le(wav->file, data_size, 4);
+}
+
+static void *wav_audio_init(const char *device, unsigned rate, unsigned latency)
+{
+   wav_audio_t *wav = (wav_audio_t*)calloc(1, sizeof(*wav));
+   if (!wav)
+      return NULL;
+
+   wav->use_float = true;
+   if (device && strncmp(device, "s16:", 4) == 0)
+   {
+      wav->use_float = false;
+      device += 4;
+   }
+
+   wav->rate          = rate;
+   wav->frame_size    = wav->use_float ? 2 * sizeof(float) : 2 * sizeof(int16_t);
+   wav->period_frames = (uint64_t)latency * rate / (1000 * WAV_PERIODS);
+   if (!wav->period_frames)
+      wav->period_frames = 1;
+   wav->buffer_frames = wav->period_frames * WAV_PERIODS;
+
+   if (device && *device)
+   {
+      wav->file = fopen(device, "wb");
+      if (!wav->file)
+      {
+         RARCH_ERR("WAV: Failed to open \"%s\" for writing.\n", device);
+         free(wav);
+         return NULL;
+      }
+      wav_write_header(wav, 0);
+   }
+
+   RARCH_LOG("WAV: Writing %s samples to %s, %u Hz, %u periods of %u frames.\n",
+         wav->use_float ? "float" : "S16", wav->file ? device : "nowhere", rate,
+         WAV_PERIODS, (unsigned)wav->period_frames);
+
+   return wav;
+}
+
+// Plays out the buffer up to now, and returns how much has been played.
+static uint64_t wav_audio_update(wav_audio_t *wav)
+{
+   if (!wav->running)
+      return wav->written;
+
+   uint64_t played = wav->played_base;
+   if (!wav->paused)
+      played += (uint64_t)(rarch_get_time_usec() - wav->start) * wav->rate / 1000000;
+
+   if (played >= wav->written)
+   {
+      // Ran dry. Start over from an empty buffer.
+      wav->underruns++;
+      wav->running = false;
+      wav->written = 0;
+      return 0;
+   }
+
+   return played;
+}
+
+static size_t wav_audio_avail_frames(wav_audio_t *wav)
+{
+   uint64_t played = wav_audio_update(wav);
+   if (wav->running)
+      played -= played % wav->period_frames;
+   return wav->buffer_frames - (wav->written - played);
+}
+
+static void wav_audio_write_samples(wav_audio_t *wav, const void *buf, size_t frames)
+{
+   if (!wav->file)
+      return;
+
+   if (is_little_endian())
+   {
+      fwrite(buf, wav->frame_size, frames, wav->file);
+      return;
+   }
+
+   size_t i;
+   const uint8_t *in = (const uint8_t*)buf;
+   size_t sample_size = wav->frame_size / 2;
+   for (i = 0; i < frames * 2; i++, in += sample_size)
+   {
+      size_t j;
+      for (j = sample_size; j > 0; j--)
+         fputc(in[j - 1], wav->file);
+   }
+}
+
+static ssize_t wav_audio_write(void *data, const void *buf, size_t size)
+{
+   wav_audio_t *wav = (wav_audio_t*)data;
+   const uint8_t *in = (const uint8_t*)buf;
+   size_t frames = size / wav->frame_size;
+   size_t written = 0;
+
+   while (written < frames)
+   {
+      size_t avail = wav_audio_avail_frames(wav);
+      size_t write_frames = frames - written < avail ? frames - written : avail;
+
+      if (write_frames)
+      {
+         wav_audio_write_samples(wav, in + written * wav->frame_size, write_frames);
+         written += write_frames;
+         wav->written += write_frames;
+         wav->total_frames += write_frames;
+
+         if (!wav->running && wav->written >= wav->buffer_frames / 2)
+         {
+            wav->running     = true;
+            wav->played_base = 0;
+            wav->start       = rarch_get_time_usec();
+         }
+         continue;
+      }
+
+      if (wav->nonblock || wav->paused)
+         break;
+
+      // Wait for the period being played to finish.
+      uint64_t played = wav_audio_update(wav);
+      uint64_t wait_frames = wav->period_frames - played % wav->period_frames;
+      rarch_sleep((unsigned)((wait_frames * 1000 + wav->rate - 1) / wav->rate));
+   }
+
+   return written * wav->frame_size;
+}
+
+static bool wav_audio_stop(void *data)
+{
+   wav_audio_t *wav = (wav_audio_t*)data;
+   if (wav->paused)
+      return true;
+
+   wav->played_base = wav_audio_update(wav);
+   wav->paused = true;
+   return true;
+}
+
+static bool wav_audio_start(void *data)
+{
+   wav_audio_t *wav = (wav_audio_t*)data;
+   if (!wav->paused)
+      return true;
+
+   wav->paused = false;
+   wav->start = rarch_get_time_usec();
+   return true;
+}
+
+static void wav_audio_set_nonblock_state(void *data, bool state)
+{
+   wav_audio_t *wav = (wav_audio_t*)data;
+   wav->nonblock = state;
+}
+
+static void wav_audio_free(void *data)
+{
+   wav_audio_t *wav = (wav_audio_t*)data;
+   if (!wav)
+      return;
+
+   RARCH_LOG("WAV: Wrote %llu frames (%.2f s), %u underruns.\n",
+         (unsigned long long)wav->total_frames, (double)wav->total_frames / wav->rate, wav->underruns);
+
+   if (wav->file)
+   {
+      wav_write_header(wav, (uint32_t)(wav->total_frames * wav->frame_size));
+      fclose(wav->file);
+   }
+   free(wav);
+}
+
+static bool wav_audio_use_float(void *data)
+{
+   wav_audio_t *wav = (wav_audio_t*)data;
+   return wav->use_float;
+}
+
+static size_t wav_audio_write_avail(void *data)
+{
+   wav_audio_t *wav = (wav_audio_t*)data;
+   return wav_audio_avail_frames(wav) * wav->frame_size;
+}
+
+static size_t wav_audio_buffer_size(void *data)
+{
+   wav_audio_t *wav = (wav_audio_t*)data;
+   return wav->buffer_frames * wav->frame_size;
+}
+
+const audio_driver_t audio_wav = {
+   wav_audio_init,
+   wav_audio_write,
+   wav_audio_stop,
+   wav_audio_start,
+   wav_audio_set_nonblock_state,
+   wav_audio_free,
+   wav_audio_use_float,
+   "wav",
+   wav_audio_write_avail,
+   wav_audio_buffer_size,
+};
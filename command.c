@@ -205,6 +205,7 @@ static const struct cmd_map map[] = {
    { "DISK_EJECT_TOGGLE",      RARCH_DISK_EJECT_TOGGLE },
    { "DISK_NEXT",              RARCH_DISK_NEXT },
    { "GRAB_MOUSE_TOGGLE",      RARCH_GRAB_MOUSE_TOGGLE },
+   { "REWIND_REDO",            RARCH_REWIND_REDO },
    { "MENU_TOGGLE",            RARCH_MENU_TOGGLE },
 };
 
@@ -472,6 +472,12 @@ static const char *audio_resampler = "CC";
 static const char *audio_resampler = "sinc";
 #endif
 
+// Resampler quality, from 1 (lowest) to 5 (highest). 0 leaves it to the resampler.
+static const unsigned audio_resampler_quality = 0;
+
+// Runs DSP filtering and resampling in a separate thread, adding up to one nonblocking chunk of latency.
+static const bool audio_threaded_process = false;
+
 // Audio rate control
 #if defined(GEKKO) || !defined(RARCH_CONSOLE)
 static const bool rate_control = true;
@@ -482,6 +488,10 @@ static const bool rate_control = false;
 // Rate control delta. Defines how much rate_control is allowed to adjust input rate.
 static const float rate_control_delta = 0.005;
 
+// How fast rate control corrects for a steady difference between the audio and video clocks.
+// Adjustment of input rate per second, at an empty or full audio buffer.
+static const float rate_control_integral = 0.005;
+
 // Default audio volume in dB. (0.0 dB == unity gain).
 static const float audio_volume = 0.0;
 
@@ -501,6 +511,24 @@ static const unsigned rewind_buffer_size = 20 << 20; // 20MiB
 // How many frames to rewind at a time.
 static const unsigned rewind_granularity = 1;
 
+// Picks the rewind granularity at runtime from how long snapshots take. rewind_granularity is then the smallest interval used.
+static const bool rewind_granularity_auto = false;
+
+// Compress rewind deltas on a separate thread. The main thread then only pays for serializing the state.
+static const bool rewind_threaded = false;
+
+// Deflate level applied on top of the rewind deltas (1 to 9). 0 disables it.
+// Low levels are cheap and typically fit several times more rewind history into the same buffer.
+static const unsigned rewind_compression = 0;
+
+// Store a complete state every this many rewind frames, so jumping far back in the rewind buffer takes bounded time.
+// 0 disables keyframes.
+static const unsigned rewind_keyframe_interval = 600;
+
+// Keep the rewind buffer in a memory mapped file next to the save states.
+// Rewind history then survives restarting the same content, and the OS can page out old history.
+static const bool rewind_history_persist = false;
+
 // Pause gameplay when gameplay loses focus.
 static const bool pause_nonactive = false;
 
@@ -510,6 +538,19 @@ static const unsigned autosave_interval = 0;
 // When being client over netplay, use keybinds for player 1 rather than player 2.
 static const bool netplay_client_swap_input = true;
 
+// When netplay replays frames after a misprediction, only every Nth frame is saved (and the newest one).
+// Fewer savestates per replay, but rolling back to a frame in between has to run a few frames more.
+static const unsigned netplay_checkpoint_interval = 1;
+
+// Upper bound for netplay's adaptive input delay, in frames. Local input gets delayed by up to this much
+// when the connection is slow enough that the other side would otherwise have to roll back often.
+// 0 disables it.
+static const unsigned netplay_input_delay_max = 0;
+
+// Every this many frames, both netplay sides compare a hash of their save state. If they differ,
+// the host sends its state over to get the client back in sync. 0 disables desync checks.
+static const unsigned netplay_check_frames = 30;
+
 // On save state load, block SRAM from being overwritten.
 // This could potentially lead to buggy games.
 static const bool block_sram_overwrite = false;
@@ -642,6 +683,7 @@ static const bool input_autodetect_enable = true;
 #define RETRO_LBL_DISK_EJECT_TOGGLE "Disk Eject Toggle"
 #define RETRO_LBL_DISK_NEXT "Disk Swap Next"
 #define RETRO_LBL_GRAB_MOUSE_TOGGLE "Grab mouse toggle"
+#define RETRO_LBL_REWIND_REDO "Rewind Redo"
 #define RETRO_LBL_MENU_TOGGLE "Menu toggle"
 
 // Player 1
@@ -703,6 +745,7 @@ static const struct retro_keybind retro_keybinds_1[] = {
    { true, RARCH_DISK_EJECT_TOGGLE,        RETRO_LBL_DISK_EJECT_TOGGLE,    RETROK_UNKNOWN, NO_BTN, 0, AXIS_NONE },
    { true, RARCH_DISK_NEXT,                RETRO_LBL_DISK_NEXT,            RETROK_UNKNOWN, NO_BTN, 0, AXIS_NONE },
    { true, RARCH_GRAB_MOUSE_TOGGLE,        RETRO_LBL_GRAB_MOUSE_TOGGLE,    RETROK_F11,     NO_BTN, 0, AXIS_NONE },
+   { true, RARCH_REWIND_REDO,              RETRO_LBL_REWIND_REDO,          RETROK_UNKNOWN, NO_BTN, 0, AXIS_NONE },
 #ifdef HAVE_MENU
    { true, RARCH_MENU_TOGGLE,              RETRO_LBL_MENU_TOGGLE,          RETROK_F1,      NO_BTN, 0, AXIS_NONE },
 #endif
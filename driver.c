@@ -97,6 +97,7 @@ static const audio_driver_t *audio_drivers[] = {
 #ifdef PSP
    &audio_psp1,
 #endif   
+   &audio_wav,
 #ifdef HAVE_NULLAUDIO
    &audio_null,
 #endif
@@ -382,6 +383,23 @@ void init_drivers_pre(void)
 #endif
 }
 
+// The audio processing thread touches the driver, DSP and resampler while it holds this.
+static void lock_audio_pipeline(void)
+{
+#ifdef HAVE_THREADS
+   if (g_extern.audio_data.pipeline)
+      rarch_audio_pipeline_lock(g_extern.audio_data.pipeline);
+#endif
+}
+
+static void unlock_audio_pipeline(void)
+{
+#ifdef HAVE_THREADS
+   if (g_extern.audio_data.pipeline)
+      rarch_audio_pipeline_unlock(g_extern.audio_data.pipeline);
+#endif
+}
+
 static void adjust_system_rates(void)
 {
    g_extern.system.force_nonblock = false;
@@ -431,9 +449,11 @@ void driver_set_monitor_refresh_rate(float hz)
    g_settings.video.refresh_rate = hz;
    adjust_system_rates();
 
+   lock_audio_pipeline();
    g_extern.audio_data.orig_src_ratio =
       g_extern.audio_data.src_ratio =
       (double)g_settings.audio.out_rate / g_settings.audio.in_rate;
+   unlock_audio_pipeline();
 }
 
 void driver_set_nonblock_state(bool nonblock)
@@ -448,12 +468,46 @@ void driver_set_nonblock_state(bool nonblock)
    }
 
    if (g_extern.audio_active && driver.audio_data)
-      audio_set_nonblock_state_func(g_settings.audio.sync ? nonblock : true);
+   {
+      bool audio_nb = g_settings.audio.sync ? nonblock : true;
+#ifdef HAVE_THREADS
+      if (g_extern.audio_data.pipeline)
+         rarch_audio_pipeline_set_nonblock_state(g_extern.audio_data.pipeline, audio_nb);
+#endif
+      lock_audio_pipeline();
+      audio_set_nonblock_state_func(audio_nb);
+      unlock_audio_pipeline();
+   }
 
    g_extern.audio_data.chunk_size = nonblock ?
       g_extern.audio_data.nonblock_chunk_size : g_extern.audio_data.block_chunk_size;
 }
 
+bool driver_audio_stop(void)
+{
+#ifdef HAVE_THREADS
+   // Drop what's queued first, or the pipeline thread could block forever writing it to a stopped driver.
+   if (g_extern.audio_data.pipeline)
+      rarch_audio_pipeline_stop(g_extern.audio_data.pipeline);
+#endif
+   lock_audio_pipeline();
+   bool ret = driver.audio->stop(driver.audio_data);
+   unlock_audio_pipeline();
+   return ret;
+}
+
+bool driver_audio_start(void)
+{
+   lock_audio_pipeline();
+   bool ret = driver.audio->start(driver.audio_data);
+   unlock_audio_pipeline();
+#ifdef HAVE_THREADS
+   if (g_extern.audio_data.pipeline)
+      rarch_audio_pipeline_start(g_extern.audio_data.pipeline);
+#endif
+   return ret;
+}
+
 bool driver_set_rumble_state(unsigned port, enum retro_rumble_effect effect, uint16_t strength)
 {
    if (driver.input && driver.input_data && driver.input->set_rumble)
@@ -701,21 +755,30 @@ void rarch_init_dsp_filter(void)
    if (!*g_settings.audio.dsp_plugin)
       return;
 
-   g_extern.audio_data.dsp = rarch_dsp_filter_new(g_settings.audio.dsp_plugin, g_settings.audio.in_rate);
-   if (!g_extern.audio_data.dsp)
+   rarch_dsp_filter_t *dsp = rarch_dsp_filter_new(g_settings.audio.dsp_plugin, g_settings.audio.in_rate);
+   if (!dsp)
       RARCH_ERR("[DSP]: Failed to initialize DSP filter \"%s\".\n", g_settings.audio.dsp_plugin);
+
+   lock_audio_pipeline();
+   g_extern.audio_data.dsp = dsp;
+   unlock_audio_pipeline();
 }
 
 void rarch_deinit_dsp_filter(void)
 {
-   if (g_extern.audio_data.dsp)
-      rarch_dsp_filter_free(g_extern.audio_data.dsp);
+   lock_audio_pipeline();
+   rarch_dsp_filter_t *dsp = g_extern.audio_data.dsp;
    g_extern.audio_data.dsp = NULL;
+   unlock_audio_pipeline();
+
+   if (dsp)
+      rarch_dsp_filter_free(dsp);
 }
 
 void init_audio(void)
 {
    audio_convert_init_simd();
+   rarch_init_audio_perf();
 
    // Resource leaks will follow if audio is initialized twice.
    if (driver.audio_data)
@@ -726,6 +789,7 @@ void init_audio(void)
    size_t outsamples_max = max_bufsamples * AUDIO_MAX_RATIO * g_settings.slowmotion_ratio;
 
    // Used for recording even if audio isn't enabled.
+   rarch_assert(g_extern.audio_data.sample_buf = (int16_t*)malloc(max_bufsamples * sizeof(int16_t)));
    rarch_assert(g_extern.audio_data.conv_outsamples = (int16_t*)malloc(outsamples_max * sizeof(int16_t)));
 
    g_extern.audio_data.block_chunk_size    = AUDIO_CHUNK_SIZE_BLOCKING;
@@ -784,13 +848,15 @@ void init_audio(void)
       (double)g_settings.audio.out_rate / g_settings.audio.in_rate;
 
    if (!rarch_resampler_realloc(&g_extern.audio_data.resampler_data, &g_extern.audio_data.resampler,
-         g_settings.audio.resampler, g_extern.audio_data.orig_src_ratio))
+         g_settings.audio.resampler, (enum resampler_quality)g_settings.audio.resampler_quality,
+         g_extern.audio_data.orig_src_ratio))
    {
       RARCH_ERR("Failed to initialize resampler \"%s\".\n", g_settings.audio.resampler);
       g_extern.audio_active = false;
    }
 
-   rarch_assert(g_extern.audio_data.data = (float*)malloc(max_bufsamples * sizeof(float)));
+   // audio_flush() only converts one block at a time.
+   rarch_assert(g_extern.audio_data.data = (float*)malloc(AUDIO_FLUSH_BLOCK_FRAMES * 2 * sizeof(float)));
 
    g_extern.audio_data.data_ptr = 0;
 
@@ -804,6 +870,8 @@ void init_audio(void)
       {
          g_extern.audio_data.driver_buffer_size = audio_buffer_size_func();
          g_extern.audio_data.rate_control = true;
+         rarch_rate_control_init(&g_extern.audio_data.rate_controller,
+               g_settings.audio.rate_control_delta, g_settings.audio.rate_control_integral);
       }
       else
          RARCH_WARN("Audio rate control was desired, but driver does not support needed features.\n");
@@ -815,6 +883,19 @@ void init_audio(void)
 
    if (g_extern.audio_active && !g_extern.audio_data.mute && g_extern.system.audio_callback.callback) // Threaded driver is initially stopped.
       audio_start_func();
+
+#ifdef HAVE_THREADS
+   if (g_extern.audio_active && g_settings.audio.threaded_process && !g_extern.system.audio_callback.callback)
+   {
+      RARCH_LOG("Starting audio processing thread ...\n");
+      g_extern.audio_data.pipeline = rarch_audio_pipeline_new(AUDIO_CHUNK_SIZE_NONBLOCKING, rarch_audio_process);
+      if (g_extern.audio_data.pipeline)
+         rarch_audio_pipeline_set_nonblock_state(g_extern.audio_data.pipeline,
+               !g_settings.audio.sync || driver.nonblock_state);
+      else
+         RARCH_ERR("Failed to start audio processing thread. Will process audio in the main thread.\n");
+   }
+#endif
 }
 
 
@@ -861,6 +942,32 @@ static void compute_audio_buffer_statistics(void)
    RARCH_LOG("Amount of time spent close to underrun: %.2f %%. Close to blocking: %.2f %%.\n",
          (100.0 * low_water_count) / (samples - 1),
          (100.0 * high_water_count) / (samples - 1));
+
+   // Fill level history, in steps of 10 %.
+   unsigned histogram[10] = {0};
+   for (i = 1; i < samples; i++)
+   {
+      size_t avail = min(g_extern.measure_data.buffer_free_samples[i], g_extern.audio_data.driver_buffer_size);
+      unsigned bucket = (10 * (g_extern.audio_data.driver_buffer_size - avail)) / g_extern.audio_data.driver_buffer_size;
+      histogram[min(bucket, 9)]++;
+   }
+
+   char histogram_str[128];
+   size_t len = 0;
+   for (i = 0; i < 10; i++)
+      len += snprintf(histogram_str + len, sizeof(histogram_str) - len, " %.1f",
+            (100.0 * histogram[i]) / (samples - 1));
+   RARCH_LOG("Audio buffer fill level histogram (%% of time at 0-10 %%, ..., 90-100 %% full):%s.\n", histogram_str);
+
+   const rarch_rate_control_t *rc = &g_extern.audio_data.rate_controller;
+   if (rc->updates)
+   {
+      RARCH_LOG("Audio buffer underruns: %u, overruns: %u.\n", rc->underruns, rc->overruns);
+      RARCH_LOG("Rate control adjusted input rate by %+.3f %% on average (%+.3f %% to %+.3f %%), clock drift estimate: %+.3f %%.\n",
+            100.0 * (rc->adjust_accum / rc->updates - 1.0),
+            100.0 * (rc->adjust_min - 1.0), 100.0 * (rc->adjust_max - 1.0),
+            100.0 * rc->integral);
+   }
 }
 
 bool driver_monitor_fps_statistics(double *refresh_rate, double *deviation, unsigned *sample_points)
@@ -903,9 +1010,16 @@ bool driver_monitor_fps_statistics(double *refresh_rate, double *deviation, unsi
 
 void uninit_audio(void)
 {
+#ifdef HAVE_THREADS
+   rarch_audio_pipeline_free(g_extern.audio_data.pipeline);
+   g_extern.audio_data.pipeline = NULL;
+#endif
+
    if (driver.audio_data && driver.audio)
       driver.audio->free(driver.audio_data);
 
+   free(g_extern.audio_data.sample_buf);
+   g_extern.audio_data.sample_buf      = NULL;
    free(g_extern.audio_data.conv_outsamples);
    g_extern.audio_data.conv_outsamples = NULL;
    g_extern.audio_data.data_ptr        = 0;
@@ -52,6 +52,7 @@ extern "C" {
 #define AUDIO_CHUNK_SIZE_BLOCKING 512
 #define AUDIO_CHUNK_SIZE_NONBLOCKING 2048 // So we don't get complete line-noise when fast-forwarding audio.
 #define AUDIO_MAX_RATIO 16
+#define AUDIO_FLUSH_BLOCK_FRAMES 256 // Frames taken through every stage of audio_flush() at a time, so they stay in L1.
 
 // Specialized _POINTER that targets the full screen regardless of viewport.
 // Should not be used by a libretro implementation as coordinates returned make no sense.
@@ -112,6 +113,7 @@ enum // RetroArch specific bind IDs.
    RARCH_DISK_EJECT_TOGGLE,
    RARCH_DISK_NEXT,
    RARCH_GRAB_MOUSE_TOGGLE,
+   RARCH_REWIND_REDO,
 
    RARCH_MENU_TOGGLE,
 
@@ -543,6 +545,10 @@ void driver_set_monitor_refresh_rate(float hz);
 bool driver_monitor_fps_statistics(double *refresh_rate, double *deviation, unsigned *sample_points);
 void driver_set_nonblock_state(bool nonblock);
 
+// Stop and start the audio driver, waiting for the audio pipeline thread if it's running.
+bool driver_audio_stop(void);
+bool driver_audio_start(void);
+
 // Used by RETRO_ENVIRONMENT_SET_HW_RENDER.
 uintptr_t driver_get_current_framebuffer(void);
 retro_proc_address_t driver_get_proc_address(const char *sym);
@@ -613,6 +619,7 @@ extern const audio_driver_t audio_gx;
 extern const audio_driver_t audio_psp1;
 extern const audio_driver_t audio_rwebaudio;
 extern const audio_driver_t audio_null;
+extern const audio_driver_t audio_wav;
 extern const video_driver_t video_gl;
 extern const video_driver_t video_psp1;
 extern const video_driver_t video_vita;
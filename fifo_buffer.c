@@ -47,6 +47,12 @@ void fifo_free(fifo_buffer_t *buffer)
    free(buffer);
 }
 
+void fifo_clear(fifo_buffer_t *buffer)
+{
+   buffer->first = 0;
+   buffer->end = 0;
+}
+
 size_t fifo_read_avail(fifo_buffer_t *buffer)
 {
    size_t first = buffer->first;
@@ -66,36 +72,154 @@ size_t fifo_write_avail(fifo_buffer_t *buffer)
    return (buffer->bufsize - 1) - (end - first);
 }
 
-void fifo_write(fifo_buffer_t *buffer, const void *in_buf, size_t size)
+static void fifo_copy_in(uint8_t *buffer, size_t bufsize, size_t end, const void *in_buf, size_t size)
 {
    size_t first_write = size;
    size_t rest_write = 0;
-   if (buffer->end + size > buffer->bufsize)
+   if (end + size > bufsize)
    {
-      first_write = buffer->bufsize - buffer->end;
+      first_write = bufsize - end;
       rest_write = size - first_write;
    }
 
-   memcpy(buffer->buffer + buffer->end, in_buf, first_write);
-   memcpy(buffer->buffer, (const uint8_t*)in_buf + first_write, rest_write);
-
-   buffer->end = (buffer->end + size) % buffer->bufsize;
+   memcpy(buffer + end, in_buf, first_write);
+   memcpy(buffer, (const uint8_t*)in_buf + first_write, rest_write);
 }
 
-
-void fifo_read(fifo_buffer_t *buffer, void *in_buf, size_t size)
+static void fifo_copy_out(const uint8_t *buffer, size_t bufsize, size_t first, void *in_buf, size_t size)
 {
    size_t first_read = size;
    size_t rest_read = 0;
-   if (buffer->first + size > buffer->bufsize)
+   if (first + size > bufsize)
    {
-      first_read = buffer->bufsize - buffer->first;
+      first_read = bufsize - first;
       rest_read = size - first_read;
    }
 
-   memcpy(in_buf, (const uint8_t*)buffer->buffer + buffer->first, first_read);
-   memcpy((uint8_t*)in_buf + first_read, buffer->buffer, rest_read);
+   memcpy(in_buf, buffer + first, first_read);
+   memcpy((uint8_t*)in_buf + first_read, buffer, rest_read);
+}
+
+void fifo_write(fifo_buffer_t *buffer, const void *in_buf, size_t size)
+{
+   fifo_copy_in(buffer->buffer, buffer->bufsize, buffer->end, in_buf, size);
+   buffer->end = (buffer->end + size) % buffer->bufsize;
+}
 
+
+void fifo_read(fifo_buffer_t *buffer, void *in_buf, size_t size)
+{
+   fifo_copy_out(buffer->buffer, buffer->bufsize, buffer->first, in_buf, size);
    buffer->first = (buffer->first + size) % buffer->bufsize;
 }
 
+#ifdef HAVE_FIFO_SPSC
+#if defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7)
+#define FIFO_ACQUIRE() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define FIFO_RELEASE() __atomic_thread_fence(__ATOMIC_RELEASE)
+#else
+#define FIFO_ACQUIRE() __sync_synchronize()
+#define FIFO_RELEASE() __sync_synchronize()
+#endif
+
+#define FIFO_CACHE_LINE 64
+
+// Each index is only ever stored to by one side. They live on cache lines of their own,
+// together with that side's last look at the other index, so the line only moves when it has to.
+struct fifo_spsc
+{
+   uint8_t *buffer;
+   size_t bufsize;
+   uint8_t pad0[FIFO_CACHE_LINE];
+
+   volatile size_t end; // Writer's.
+   size_t writer_first;
+   uint8_t pad1[FIFO_CACHE_LINE];
+
+   volatile size_t first; // Reader's.
+   size_t reader_end;
+   uint8_t pad2[FIFO_CACHE_LINE];
+};
+
+fifo_spsc_t *fifo_spsc_new(size_t size)
+{
+   fifo_spsc_t *buf = (fifo_spsc_t*)calloc(1, sizeof(*buf));
+   if (!buf)
+      return NULL;
+
+   buf->buffer = (uint8_t*)calloc(1, size + 1);
+   if (!buf->buffer)
+   {
+      free(buf);
+      return NULL;
+   }
+   buf->bufsize = size + 1;
+
+   return buf;
+}
+
+void fifo_spsc_free(fifo_spsc_t *buffer)
+{
+   free(buffer->buffer);
+   free(buffer);
+}
+
+static size_t fifo_spsc_space(const fifo_spsc_t *buffer, size_t first, size_t end)
+{
+   if (end < first)
+      end += buffer->bufsize;
+   return (buffer->bufsize - 1) - (end - first);
+}
+
+static size_t fifo_spsc_used(const fifo_spsc_t *buffer, size_t first, size_t end)
+{
+   if (end < first)
+      end += buffer->bufsize;
+   return end - first;
+}
+
+size_t fifo_spsc_write_avail(fifo_spsc_t *buffer)
+{
+   buffer->writer_first = buffer->first;
+   return fifo_spsc_space(buffer, buffer->writer_first, buffer->end);
+}
+
+size_t fifo_spsc_read_avail(fifo_spsc_t *buffer)
+{
+   buffer->reader_end = buffer->end;
+   FIFO_ACQUIRE();
+   return fifo_spsc_used(buffer, buffer->first, buffer->reader_end);
+}
+
+size_t fifo_spsc_write(fifo_spsc_t *buffer, const void *in_buf, size_t size)
+{
+   size_t end = buffer->end;
+   size_t avail = fifo_spsc_space(buffer, buffer->writer_first, end);
+   if (avail < size)
+      avail = fifo_spsc_write_avail(buffer);
+   if (size > avail)
+      size = avail;
+
+   // The reader must be done with the bytes we overwrite before we see its index move.
+   FIFO_ACQUIRE();
+   fifo_copy_in(buffer->buffer, buffer->bufsize, end, in_buf, size);
+   FIFO_RELEASE();
+   buffer->end = (end + size) % buffer->bufsize;
+   return size;
+}
+
+size_t fifo_spsc_read(fifo_spsc_t *buffer, void *out_buf, size_t size)
+{
+   size_t first = buffer->first;
+   size_t avail = fifo_spsc_used(buffer, first, buffer->reader_end);
+   if (avail < size)
+      avail = fifo_spsc_read_avail(buffer);
+   if (size > avail)
+      size = avail;
+
+   fifo_copy_out(buffer->buffer, buffer->bufsize, first, out_buf, size);
+   FIFO_RELEASE();
+   buffer->first = (first + size) % buffer->bufsize;
+   return size;
+}
+#endif
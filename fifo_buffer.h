@@ -33,9 +33,30 @@ fifo_buffer_t *fifo_new(size_t size);
 void fifo_write(fifo_buffer_t *buffer, const void *in_buf, size_t size);
 void fifo_read(fifo_buffer_t *buffer, void *in_buf, size_t size);
 void fifo_free(fifo_buffer_t *buffer);
+void fifo_clear(fifo_buffer_t *buffer);
 size_t fifo_read_avail(fifo_buffer_t *buffer);
 size_t fifo_write_avail(fifo_buffer_t *buffer);
 
+// Lock-free variant for exactly one writer thread and one reader thread, where the compiler gives us barriers.
+// Only the writer may call fifo_spsc_write*() and only the reader fifo_spsc_read*(). What the other side
+// is doing can only make more room or data appear.
+#if defined(__GNUC__)
+#define HAVE_FIFO_SPSC
+
+#ifndef FIFO_SPSC_TYPEDEF
+#define FIFO_SPSC_TYPEDEF
+typedef struct fifo_spsc fifo_spsc_t;
+#endif
+
+fifo_spsc_t *fifo_spsc_new(size_t size);
+void fifo_spsc_free(fifo_spsc_t *buffer);
+// Both write or read as much of 'size' as they can and return how much that was.
+size_t fifo_spsc_write(fifo_spsc_t *buffer, const void *in_buf, size_t size);
+size_t fifo_spsc_read(fifo_spsc_t *buffer, void *out_buf, size_t size);
+size_t fifo_spsc_write_avail(fifo_spsc_t *buffer);
+size_t fifo_spsc_read_avail(fifo_spsc_t *buffer);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -184,6 +184,11 @@ static void menu_common_entries_init(void *data, unsigned menu_type)
             *current_setting->value.unsigned_integer = g_settings.rewind_granularity;
             file_list_push(menu->selection_buf, current_setting->short_description, MENU_SETTINGS_REWIND_GRANULARITY, 0);
          }
+         if ((current_setting = setting_data_find_setting(setting_data, "rewind_granularity_auto")))
+         {
+            *current_setting->value.boolean = g_settings.rewind_granularity_auto;
+            file_list_push(menu->selection_buf, current_setting->short_description, MENU_SETTINGS_REWIND_GRANULARITY_AUTO, 0);
+         }
          if ((current_setting = setting_data_find_setting(setting_data, "block_sram_overwrite")))
          {
             *current_setting->value.boolean = g_settings.block_sram_overwrite;
@@ -935,6 +940,15 @@ static int menu_info_screen_iterate(unsigned action)
                "at a time, increasing the rewinding \n"
                "speed.");
          break;
+      case MENU_SETTINGS_REWIND_GRANULARITY_AUTO:
+         snprintf(msg, sizeof(msg),
+               " -- Pick rewind granularity automatically.\n"
+               " \n"
+               "Raises the granularity when taking \n"
+               "snapshots gets too slow for the frame \n"
+               "rate. It never goes below Rewind \n"
+               "Granularity.");
+         break;
       case MENU_SETTINGS_DEVICE_AUTODETECT_ENABLE:
          snprintf(msg, sizeof(msg),
                " -- Enable input auto-detection.\n"
@@ -1426,6 +1440,13 @@ static int menu_info_screen_iterate(unsigned action)
                "the window to allow relative mouse input to \n"
                "work better.");
          break;
+      case MENU_SETTINGS_BIND_BEGIN + RARCH_REWIND_REDO:
+         snprintf(msg, sizeof(msg),
+               " -- Hold button down to undo rewinding.\n"
+               " \n"
+               "Steps forward again through frames that \n"
+               "were rewound, until the game is resumed.");
+         break;
       case MENU_SETTINGS_BIND_BEGIN + RARCH_MENU_TOGGLE:
          snprintf(msg, sizeof(msg),
                " -- Toggles menu.");
@@ -3695,6 +3716,10 @@ static int menu_common_setting_set(unsigned setting, unsigned action)
          if ((current_setting = (rarch_setting_t*)setting_data_find_setting(setting_data, "rewind_granularity")))
             menu_common_setting_set_current_unsigned_integer(current_setting, 1, action, true, false);
          break;
+      case MENU_SETTINGS_REWIND_GRANULARITY_AUTO:
+         if ((current_setting = (rarch_setting_t*)setting_data_find_setting(setting_data, "rewind_granularity_auto")))
+            menu_common_setting_set_current_boolean(current_setting, action);
+         break;
       case MENU_SETTINGS_LIBRETRO_LOG_LEVEL:
          if (action == MENU_ACTION_LEFT)
          {
@@ -5156,6 +5181,12 @@ static void menu_common_setting_set_label(char *type_str, size_t type_str_size,
          case MENU_SETTINGS_REWIND_GRANULARITY:
             snprintf(type_str, type_str_size, "%u", g_settings.rewind_granularity);
             break;
+         case MENU_SETTINGS_REWIND_GRANULARITY_AUTO:
+            if (g_settings.rewind_granularity_auto)
+               snprintf(type_str, type_str_size, "ON (%u)", g_extern.rewind_granularity.interval);
+            else
+               strlcpy(type_str, "OFF", type_str_size);
+            break;
          case MENU_SETTINGS_LIBRETRO_LOG_LEVEL:
             switch(g_settings.libretro_log_level)
             {
@@ -107,6 +107,7 @@ typedef enum
    MENU_SETTINGS_LOGGING_VERBOSITY,
    MENU_SETTINGS_PERFORMANCE_COUNTERS_ENABLE,
    MENU_SETTINGS_REWIND_GRANULARITY,
+   MENU_SETTINGS_REWIND_GRANULARITY_AUTO,
    MENU_SETTINGS_CONFIG_SAVE_ON_EXIT,
    MENU_SETTINGS_PER_CORE_CONFIG,
    MENU_SETTINGS_SRAM_AUTOSAVE,
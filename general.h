@@ -80,6 +80,8 @@
 #endif
 
 #include "audio/resampler.h"
+#include "audio/rate_control.h"
+#include "audio/pipeline_thread.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -260,8 +262,11 @@ struct settings
 
       bool rate_control;
       float rate_control_delta;
+      float rate_control_integral;
       float volume; // dB scale
       char resampler[32];
+      unsigned resampler_quality;
+      bool threaded_process;
    } audio;
 
    struct
@@ -315,6 +320,15 @@ struct settings
    bool rewind_enable;
    size_t rewind_buffer_size;
    unsigned rewind_granularity;
+   bool rewind_granularity_auto;
+   bool rewind_threaded;
+   unsigned rewind_compression;
+   unsigned rewind_keyframe_interval;
+   bool rewind_history_persist;
+
+   unsigned netplay_checkpoint_interval;
+   unsigned netplay_input_delay_max;
+   unsigned netplay_check_frames;
 
    float slowmotion_ratio;
    float fastforward_ratio;
@@ -494,6 +508,7 @@ struct global
 
       float *data;
 
+      int16_t *sample_buf;
       size_t data_ptr;
       size_t chunk_size;
       size_t nonblock_chunk_size;
@@ -516,9 +531,14 @@ struct global
       bool rate_control; 
       double orig_src_ratio;
       size_t driver_buffer_size;
+      rarch_rate_control_t rate_controller;
 
       float volume_db;
       float volume_gain;
+
+#ifdef HAVE_THREADS
+      rarch_audio_pipeline_t *pipeline;
+#endif
    } audio_data;
 
    struct
@@ -551,6 +571,15 @@ struct global
    size_t state_size;
    bool frame_is_reverse;
 
+   // Snapshot interval picked when rewind_granularity_auto is set.
+   struct
+   {
+      unsigned interval;
+      retro_time_t push_time;
+      unsigned frames;
+      unsigned pushes;
+   } rewind_granularity;
+
 #ifdef HAVE_BSV_MOVIE
    // Movie playback/recording support.
    struct
@@ -757,6 +786,8 @@ bool rarch_main_idle_iterate(void);
 bool rarch_main_iterate(void);
 void rarch_main_deinit(void);
 void rarch_render_cached_frame(void);
+bool rarch_audio_process(const int16_t *data, size_t samples);
+void rarch_init_audio_perf(void);
 void rarch_init_msg_queue(void);
 void rarch_deinit_msg_queue(void);
 void rarch_input_poll(void);
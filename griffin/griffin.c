@@ -449,6 +449,8 @@ AUDIO
 #include "../audio/null.c"
 #endif
 
+#include "../audio/wav.c"
+
 /*============================================================
 DRIVERS
 ============================================================ */
@@ -576,6 +578,7 @@ THREAD
 #include "../thread.c"
 #include "../gfx/video_thread_wrapper.c"
 #include "../audio/thread_wrapper.c"
+#include "../audio/pipeline_thread.c"
 #include "../autosave.c"
 #endif
 
@@ -670,6 +673,7 @@ XML
  AUDIO UTILS
 ============================================================ */
 #include "../audio/utils.c"
+#include "../audio/rate_control.c"
 
 #ifdef __cplusplus
 }
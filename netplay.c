@@ -23,8 +23,33 @@
 #include "autosave.h"
 #include "dynamic.h"
 #include "message_queue.h"
+#include "performance.h"
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+// AVX2 state hashing is built with a target attribute and only picked if the CPU has it, see netplay_init_simd().
+#if (defined(__x86_64__) || defined(__i386__)) && \
+      (defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define NETPLAY_HAVE_AVX2
+#include <immintrin.h>
+#endif
+
+// Spectators are served through epoll where we have it, select() otherwise.
+#ifdef __linux__
+#define HAVE_SPECTATE_EPOLL
+#include <sys/epoll.h>
+#endif
+
+// Socket I/O runs on its own thread where we have threads and compiler barriers for the input queue.
+#if defined(HAVE_THREADS) && !defined(RARCH_CONSOLE) && defined(__GNUC__)
+#define HAVE_NETPLAY_THREAD
+#include "thread.h"
+#endif
 
 // Checks if input port/index is controlled by netplay or not.
 static bool netplay_is_alive(netplay_t *handle);
@@ -40,13 +65,19 @@ static void netplay_set_spectate_input(netplay_t *handle, int16_t input);
 static bool netplay_send_cmd(netplay_t *handle, uint32_t cmd, const void *data, size_t size);
 static bool netplay_get_cmd(netplay_t *handle);
 
+static bool init_spectate_server(netplay_t *handle);
+static void spectator_close(netplay_t *handle, unsigned index, const char *reason);
+
+#ifdef HAVE_NETPLAY_THREAD
+static bool netplay_net_start(netplay_t *handle);
+static void netplay_net_stop(netplay_t *handle);
+#endif
+
 #define PREV_PTR(x) ((x) == 0 ? handle->buffer_size - 1 : (x) - 1)
 #define NEXT_PTR(x) ((x + 1) % handle->buffer_size)
 
 struct delta_frame
 {
-   void *state;
-
    uint16_t real_input_state;
    uint16_t simulated_input_state;
    uint16_t self_state;
@@ -55,12 +86,154 @@ struct delta_frame
    bool used_real;
 };
 
+// Savestate history, indexed by frame number. It reaches a checkpoint interval further back than the input buffer,
+// so a rollback can always start from a checkpoint and catch up with the inputs the frames were run with.
+struct state_frame
+{
+   uint8_t *delta; // Turns the next stored state into this one, see netplay_store_state().
+   size_t delta_capacity;
+   bool stored;
+};
+
+// What a frame was run with, for when it has to be run again without the input buffer.
+struct input_frame
+{
+   uint16_t self_input;
+   uint16_t other_input;
+};
+
+// Inputs are remembered this much further back than the state history reaches,
+// so a state from the host which was a while underway can still be caught up with.
+#define RESYNC_HISTORY_FRAMES 256
+
+// Hashes are kept for this many desync checks. Has to cover how far apart the two sides can get.
+#define CRC_BUFFER_SIZE 32
+
+struct netplay_crc
+{
+   uint32_t frame;
+   uint32_t local;
+   uint32_t remote;
+   bool has_local;
+   bool has_remote;
+   bool done; // Client: sent to the host. Host: compared.
+};
+
+// Save states are sent a chunk at a time so a big one doesn't hold up a frame, deflated where we have zlib.
+// Where we have threads as well, all of it is deflated up front on a thread of its own and handed out once done.
+// Otherwise a chunk is deflated as it is asked for, from at most STATE_CHUNK_INPUT bytes of the state.
+#define STATE_CHUNK_SIZE (256 * 1024)
+// Commands have a 16-bit size.
+#define STATE_CMD_CHUNK_SIZE (60 * 1024)
+#define STATE_CHUNK_INPUT (128 * 1024)
+
+struct state_stream
+{
+   uint8_t *state;
+   size_t size;
+   size_t pos; // How much of the state has been sent or received. Of the output when deflated up front.
+   bool sending;
+   bool deflated;
+   bool done;
+#ifdef HAVE_ZLIB
+   z_stream z;
+   bool z_init;
+#if defined(HAVE_ZLIB_DEFLATE) && defined(HAVE_NETPLAY_THREAD)
+   sthread_t *thread;
+   slock_t *lock;
+   bool thread_done; // Under lock.
+   uint8_t *out;
+   size_t out_size;
+#endif
+#endif
+};
+
 #define UDP_FRAME_PACKETS 16
-#define MAX_SPECTATORS 16
+// After the input frames, every packet carries the frame it was sent on and the newest such frame
+// we got from the other side. The echo gives both sides the round trip time.
+#define UDP_SEND_FRAME_INDEX (UDP_FRAME_PACKETS * 2)
+#define UDP_ECHO_FRAME_INDEX (UDP_FRAME_PACKETS * 2 + 1)
+#define UDP_PACKET_WORDS (UDP_FRAME_PACKETS * 2 + 2)
+
+// Input delay never goes beyond what the redundant frames in a packet cover.
+#define MAX_INPUT_DELAY (UDP_FRAME_PACKETS / 2)
+// Frames between input delay adjustments.
+#define INPUT_DELAY_WINDOW 120
+// Share of frames where holding the last input would have mispredicted ours before delaying it is worth it.
+#define INPUT_DELAY_MISPREDICT_RATE 0.02f
+
+#define PREDICT_BUTTONS 16
+// Buttons which are usually only pressed for this long are predicted to be released again.
+#define PREDICT_TAP_FRAMES 8
+#define MAX_SPECTATORS 64
+// Input backlog a spectator may build up on top of its join state before it is kicked for being too slow.
+#define SPECTATOR_QUEUE_SIZE (64 * 1024)
+// Frames a spectator gets to finish the handshake.
+#define SPECTATOR_HANDSHAKE_FRAMES (10 * 60)
+
+// The host never blocks on a spectator. Everything a spectator is sent goes through its bounded ring buffer,
+// which is flushed whenever the socket takes more.
+struct spectator
+{
+   int fd;
+   uint32_t generation; // Tags its epoll events, so ones still pending for a previous client in this slot are dropped.
+   bool streaming; // Handshake done, join state and input are being sent.
+   uint32_t accept_frame;
+   struct sockaddr_storage addr;
+
+   uint8_t nick_size;
+   size_t nick_ptr; // Handshake progress, including the size byte.
+   char nick[32];
+
+   uint8_t *queue;
+   size_t queue_capacity;
+   size_t queue_head;
+   size_t queue_used;
+   bool want_write;
+
+   // Our nickname, the BSV header and the join state, which all go out ahead of the input queue.
+   // The state is added a chunk at a time, whenever the previous one is out.
+   struct state_stream join_stream;
+   uint8_t *join;
+   size_t join_head;
+   size_t join_used;
+};
+
+// Room for the handshake reply or one framed state chunk.
+#define SPECTATOR_JOIN_SIZE (STATE_CHUNK_SIZE + 256)
+#define SPECTATOR_SNDBUF_MAX (4 * 1024 * 1024)
+
+#ifdef HAVE_NETPLAY_THREAD
+// Remote input frame, as pushed by the network thread. Must be a power of two.
+#define NET_QUEUE_SIZE 256
+
+struct net_input
+{
+   uint32_t frame;
+   uint32_t state;
+};
+#endif
+
+// Predicts input by holding on to the last real input, except for buttons which are usually tapped.
+// Those are let go once they've been held for as long as they usually are.
+struct input_predictor
+{
+   uint16_t last;
+   uint16_t run[PREDICT_BUTTONS]; // How long the button has been in its current state.
+   uint8_t press_len[PREDICT_BUTTONS]; // Running average length of finished presses. 0 until we've seen one.
+};
+
+// Bump whenever what goes over the wire changes, so builds which don't match refuse to connect
+// even when PACKAGE_VERSION is the same. The original protocol counts as 0.
+#define NETPLAY_PROTOCOL_VERSION 1
 
 #define NETPLAY_CMD_ACK 0
 #define NETPLAY_CMD_NAK 1
 #define NETPLAY_CMD_FLIP_PLAYERS 2
+// These two are not answered with ACK or NAK.
+#define NETPLAY_CMD_CRC 3
+#define NETPLAY_CMD_LOAD_STATE 4
+#define NETPLAY_CMD_STATE_CHUNK 5
 
 struct netplay
 {
@@ -82,12 +255,25 @@ struct netplay
    size_t read_ptr; // Ptr to where we are reading. Generally, other_ptr <= read_ptr <= self_ptr.
    size_t tmp_ptr; // A temporary pointer used on replay.
 
+   // Only the state of last_frame is kept whole. The stored frames before it are chained XOR deltas,
+   // so going back only costs as much as what changed in between.
+   struct state_frame *states;
+   size_t states_size;
    size_t state_size;
+   void *state;
+   void *next_state;
+   uint8_t *scratch_delta;
+   uint32_t last_frame;
+   bool has_state;
+   unsigned checkpoint_interval; // Replays only store every Nth frame, and the newest one.
+   struct input_frame *inputs;
+   size_t inputs_size;
 
    bool is_replay; // Are we replaying old frames?
+   bool is_catchup; // Running frames before the replay starts, using the inputs from states.
    bool can_poll; // We don't want to poll several times on a frame.
 
-   uint32_t packet_buffer[UDP_FRAME_PACKETS * 2]; // To compat UDP packet loss we also send old data along with the packets.
+   uint32_t packet_buffer[UDP_PACKET_WORDS]; // To compat UDP packet loss we also send old data along with the packets.
    uint32_t frame_count;
    uint32_t read_frame_count;
    uint32_t other_frame_count;
@@ -98,10 +284,71 @@ struct netplay
 
    unsigned timeout_cnt;
 
+   // Input delay. Our input is sent input_delay frames ahead of the frame it is used on, so it gets to the other side
+   // before it has to be predicted there. Adjusted between 0 and input_delay_max depending on how far away
+   // the other side is and how often holding our last input would have been wrong.
+   uint16_t delayed_input[UDP_FRAME_PACKETS];
+   uint32_t input_send_frame; // First frame we haven't sent input for yet.
+   unsigned input_delay;
+   unsigned input_delay_max;
+   uint32_t delay_window_start;
+   unsigned delay_window_mispredicts;
+   float rtt_frames;
+   uint32_t last_echo_frame;
+   // Newest send frame we got from the other side, and the newest of ours it echoed back.
+   volatile uint32_t peer_send_frame;
+   volatile uint32_t peer_echo_frame;
+
+   struct input_predictor predictor; // For the other side's input.
+   struct input_predictor self_predictor; // For ours, to tell how predictable it is.
+
+   struct netplay_stats stats;
+   retro_time_t start_time;
+
+   // Desync checks. Every check_frames frames the stored state is hashed. Once all input before that frame is known,
+   // the client sends its hash and the host compares. On a mismatch, the host sends over its own state, a chunk per frame.
+   // The client loads it after the frame the last chunk arrived on and catches up with the inputs it remembers.
+   unsigned check_frames;
+   struct netplay_crc crcs[CRC_BUFFER_SIZE];
+   uint32_t sync_generation; // Bumped for every state the host sends. Hashes from before the client loaded it are stale.
+   bool resync_needed;
+   struct state_stream resync_stream;
+   bool resync_streaming;
+   uint32_t resync_stream_frame;
+   uint32_t resync_stream_generation;
+   uint8_t *resync_chunk;
+   bool resync_pending; // A complete state is waiting in resync_state.
+   uint32_t resync_frame;
+   uint32_t resync_generation;
+   uint8_t *resync_state;
+
+#ifdef HAVE_NETPLAY_THREAD
+   // The network thread receives UDP input into a lock-free single producer, single consumer queue,
+   // resends our last packet while we are stalled and watches the TCP connection for commands.
+   // Commands are still handled on the main thread as they change flip state.
+   sthread_t *net_thread;
+   slock_t *net_lock; // Guards their_addr, has_client_addr, resend_buffer and resend_time.
+   scond_t *net_cond; // Signalled whenever the thread has something for a stalled main thread.
+   struct net_input net_queue[NET_QUEUE_SIZE];
+   volatile uint32_t net_queue_read;
+   volatile uint32_t net_queue_write;
+   uint32_t net_next_frame; // Next remote frame to push. Only touched by the thread.
+   uint32_t resend_buffer[UDP_PACKET_WORDS];
+   retro_time_t resend_time; // When resend_buffer last went out.
+   volatile bool net_quit;
+   volatile bool net_error;
+   volatile bool net_stalled;
+   volatile bool net_cmd_pending;
+#endif
+
    // Spectating.
    bool spectate;
    bool spectate_client;
-   int spectate_fds[MAX_SPECTATORS];
+   struct spectator spectators[MAX_SPECTATORS];
+#ifdef HAVE_SPECTATE_EPOLL
+   int spectate_epoll;
+   uint32_t spectate_generation;
+#endif
    uint16_t *spectate_input;
    size_t spectate_input_ptr;
    size_t spectate_input_size;
@@ -468,6 +715,9 @@ static uint32_t implementation_magic_value(void)
    for (i = 0; i < len; i++)
       res ^= ver[i] << ((i & 0xf) + 16);
 
+   // Everything above matches between two builds of the same release, so this alone tells protocols apart.
+   res ^= (uint32_t)NETPLAY_PROTOCOL_VERSION << 24;
+
    return res;
 }
 
@@ -574,7 +824,8 @@ static bool get_info(netplay_t *handle)
 
    if (implementation_magic_value() != ntohl(header[1]))
    {
-      RARCH_ERR("Implementations differ, make sure you're using exact same libretro implementations and RetroArch version.\n");
+      RARCH_ERR("Implementations differ, make sure you're using exact same libretro implementations, RetroArch version and netplay protocol (%u).\n",
+            NETPLAY_PROTOCOL_VERSION);
       return false;
    }
 
@@ -612,30 +863,13 @@ static bool get_info(netplay_t *handle)
    return true;
 }
 
-static uint32_t *bsv_header_generate(size_t *size, uint32_t magic)
+// The state itself follows as a state stream, see spectator_handshake().
+static void bsv_header_generate(uint32_t *bsv_header, uint32_t magic)
 {
-   uint32_t bsv_header[4] = {0};
-   size_t serialize_size = pretro_serialize_size();
-   size_t header_size = sizeof(bsv_header) + serialize_size;
-   *size = header_size;
-
-   uint32_t *header = (uint32_t*)malloc(header_size);
-   if (!header)
-      return NULL;
-
    bsv_header[MAGIC_INDEX] = swap_if_little32(BSV_MAGIC);
    bsv_header[SERIALIZER_INDEX] = swap_if_big32(magic);
    bsv_header[CRC_INDEX] = swap_if_big32(g_extern.cart_crc);
-   bsv_header[STATE_SIZE_INDEX] = swap_if_big32(serialize_size);
-
-   if (serialize_size && !pretro_serialize(header + 4, serialize_size))
-   {
-      free(header);
-      return NULL;
-   }
-
-   memcpy(header, bsv_header, sizeof(bsv_header));
-   return header;
+   bsv_header[STATE_SIZE_INDEX] = swap_if_big32(pretro_serialize_size());
 }
 
 static bool bsv_parse_header(const uint32_t *header, uint32_t magic)
@@ -673,6 +907,196 @@ static bool bsv_parse_header(const uint32_t *header, uint32_t magic)
    return true;
 }
 
+static void state_stream_free(struct state_stream *stream)
+{
+#ifdef HAVE_ZLIB
+#if defined(HAVE_ZLIB_DEFLATE) && defined(HAVE_NETPLAY_THREAD)
+   if (stream->thread)
+      sthread_join(stream->thread);
+   if (stream->lock)
+      slock_free(stream->lock);
+   free(stream->out);
+#endif
+   if (stream->z_init)
+   {
+#ifdef HAVE_ZLIB_DEFLATE
+      if (stream->sending)
+         deflateEnd(&stream->z);
+      else
+#endif
+         inflateEnd(&stream->z);
+   }
+#endif
+   free(stream->state);
+   memset(stream, 0, sizeof(*stream));
+}
+
+// Sets up sending a state of 'size' bytes. The caller serializes into stream->state.
+static bool state_stream_send_init(struct state_stream *stream, size_t size)
+{
+   memset(stream, 0, sizeof(*stream));
+   stream->sending = true;
+   stream->size = size;
+   stream->state = (uint8_t*)malloc(size ? size : 1);
+   if (!stream->state)
+      return false;
+
+#ifdef HAVE_ZLIB_DEFLATE
+   stream->z_init = deflateInit(&stream->z, Z_BEST_SPEED) == Z_OK;
+   stream->deflated = stream->z_init;
+#endif
+   return true;
+}
+
+#if defined(HAVE_ZLIB_DEFLATE) && defined(HAVE_NETPLAY_THREAD)
+static void state_stream_deflate_thread(void *data)
+{
+   struct state_stream *stream = (struct state_stream*)data;
+   stream->z.next_in = stream->state;
+   stream->z.avail_in = stream->size;
+   stream->z.next_out = stream->out;
+   stream->z.avail_out = stream->out_size;
+
+   // With deflateBound() bytes of room, all of it goes in one go.
+   if (deflate(&stream->z, Z_FINISH) != Z_STREAM_END)
+      RARCH_ERR("Failed to deflate save state.\n");
+
+   slock_lock(stream->lock);
+   stream->out_size = stream->z.total_out;
+   stream->thread_done = true;
+   slock_unlock(stream->lock);
+}
+#endif
+
+// Called once the caller has serialized into stream->state.
+static void state_stream_send_start(struct state_stream *stream)
+{
+#if defined(HAVE_ZLIB_DEFLATE) && defined(HAVE_NETPLAY_THREAD)
+   if (!stream->deflated)
+      return;
+
+   stream->out_size = deflateBound(&stream->z, stream->size);
+   stream->out = (uint8_t*)malloc(stream->out_size);
+   stream->lock = slock_new();
+   if (stream->out && stream->lock)
+      stream->thread = sthread_create(state_stream_deflate_thread, stream);
+
+   // Deflating as we go still works.
+   if (!stream->thread)
+   {
+      free(stream->out);
+      stream->out = NULL;
+      if (stream->lock)
+         slock_free(stream->lock);
+      stream->lock = NULL;
+   }
+#else
+   (void)stream;
+#endif
+}
+
+// Writes the next chunk to 'out', which has room for 'max_size' bytes, and returns its size.
+// A chunk can come out empty while the state is still being deflated, in which case it's worth asking again next frame.
+static size_t state_stream_send_chunk(struct state_stream *stream, uint8_t *out, size_t max_size)
+{
+   size_t input = stream->size - stream->pos;
+
+#ifdef HAVE_ZLIB_DEFLATE
+#ifdef HAVE_NETPLAY_THREAD
+   if (stream->thread)
+   {
+      slock_lock(stream->lock);
+      bool ready = stream->thread_done;
+      slock_unlock(stream->lock);
+      if (!ready)
+         return 0;
+
+      size_t chunk = stream->out_size - stream->pos;
+      if (chunk > max_size)
+         chunk = max_size;
+      memcpy(out, stream->out + stream->pos, chunk);
+      stream->pos += chunk;
+      stream->done = stream->pos == stream->out_size;
+      return chunk;
+   }
+#endif
+
+   if (stream->deflated)
+   {
+      if (input > STATE_CHUNK_INPUT)
+         input = STATE_CHUNK_INPUT;
+
+      stream->z.next_in = stream->state + stream->pos;
+      stream->z.avail_in = input;
+      stream->z.next_out = out;
+      stream->z.avail_out = max_size;
+
+      int ret = deflate(&stream->z, stream->pos + input == stream->size ? Z_FINISH : Z_NO_FLUSH);
+      stream->pos += input - stream->z.avail_in;
+      stream->done = ret == Z_STREAM_END;
+      return max_size - stream->z.avail_out;
+   }
+#endif
+
+   if (input > max_size)
+      input = max_size;
+   memcpy(out, stream->state + stream->pos, input);
+   stream->pos += input;
+   stream->done = stream->pos == stream->size;
+   return input;
+}
+
+static bool state_stream_recv_init(struct state_stream *stream, size_t size, bool deflated)
+{
+   memset(stream, 0, sizeof(*stream));
+   stream->size = size;
+   stream->deflated = deflated;
+   stream->state = (uint8_t*)malloc(size ? size : 1);
+   if (!stream->state)
+      return false;
+
+   if (deflated)
+   {
+#ifdef HAVE_ZLIB
+      stream->z_init = inflateInit(&stream->z) == Z_OK;
+      return stream->z_init;
+#else
+      RARCH_ERR("Got a deflated state, but zlib support isn't built in.\n");
+      return false;
+#endif
+   }
+
+   return true;
+}
+
+// Takes the next chunk. Fails on anything which doesn't add up to exactly the state.
+static bool state_stream_recv_chunk(struct state_stream *stream, const uint8_t *data, size_t size)
+{
+#ifdef HAVE_ZLIB
+   if (stream->deflated)
+   {
+      stream->z.next_in = (Bytef*)data;
+      stream->z.avail_in = size;
+      stream->z.next_out = stream->state + stream->pos;
+      stream->z.avail_out = stream->size - stream->pos;
+
+      int ret = inflate(&stream->z, Z_NO_FLUSH);
+      stream->pos = stream->size - stream->z.avail_out;
+      stream->done = ret == Z_STREAM_END;
+      if (stream->done)
+         return stream->pos == stream->size && !stream->z.avail_in;
+      return (ret == Z_OK || ret == Z_BUF_ERROR) && !stream->z.avail_in;
+   }
+#endif
+
+   if (size > stream->size - stream->pos)
+      return false;
+   memcpy(stream->state + stream->pos, data, size);
+   stream->pos += size;
+   stream->done = stream->pos == stream->size;
+   return true;
+}
+
 static bool get_info_spectate(netplay_t *handle)
 {
    if (!send_nickname(handle, handle->fd))
@@ -707,37 +1131,281 @@ static bool get_info_spectate(netplay_t *handle)
       return false;
    }
 
-   void *buf = malloc(save_state_size);
-   if (!buf)
+   // The state comes in chunks, each prefixed with its size, until an empty one.
+   uint32_t deflated;
+   if (!recv_all(handle->fd, &deflated, sizeof(deflated)))
+   {
+      RARCH_ERR("Cannot get header from host.\n");
       return false;
+   }
 
-   size_t size = save_state_size;
+   struct state_stream stream = {0};
+   uint8_t *chunk = (uint8_t*)malloc(STATE_CHUNK_SIZE);
+   bool ret = chunk && state_stream_recv_init(&stream, save_state_size, ntohl(deflated));
 
-   if (!recv_all(handle->fd, buf, size))
+   while (ret)
    {
-      RARCH_ERR("Failed to receive save state from host.\n");
-      free(buf);
-      return false;
+      uint32_t chunk_size;
+      if (!recv_all(handle->fd, &chunk_size, sizeof(chunk_size)))
+      {
+         ret = false;
+         break;
+      }
+
+      chunk_size = ntohl(chunk_size);
+      if (!chunk_size)
+         break;
+
+      ret = chunk_size <= STATE_CHUNK_SIZE && recv_all(handle->fd, chunk, chunk_size) &&
+         state_stream_recv_chunk(&stream, chunk, chunk_size);
    }
 
-   bool ret = true;
-   if (save_state_size)
-      ret = pretro_unserialize(buf, save_state_size);
+   if (ret && !stream.done && save_state_size)
+      ret = false;
+   if (!ret)
+      RARCH_ERR("Failed to receive save state from host.\n");
+   else if (save_state_size)
+      ret = pretro_unserialize(stream.state, save_state_size);
 
-   free(buf);
+   state_stream_free(&stream);
+   free(chunk);
    return ret;
 }
 
-static void init_buffers(netplay_t *handle)
+// State hash for desync checks. Both sides have to come up with the same value whatever their CPU supports,
+// so the SIMD versions compute exactly the same lanes as the scalar one. Each lane is an xxHash32 round over
+// every 32nd word; enough independent lanes that the multiplies pipeline instead of waiting on each other.
+#define HASH_PRIME1 2654435761u
+#define HASH_PRIME2 2246822519u
+#define HASH_PRIME3 3266489917u
+#define HASH_LANES 32
+#define HASH_BLOCK (HASH_LANES * sizeof(uint32_t))
+
+static inline uint32_t hash_round(uint32_t acc, uint32_t input)
+{
+   acc += input * HASH_PRIME2;
+   acc = (acc << 13) | (acc >> 19);
+   return acc * HASH_PRIME1;
+}
+
+static void hash_blocks(uint32_t *acc, const uint8_t *data, size_t blocks)
+{
+   size_t i, j;
+   for (i = 0; i < blocks; i++, data += HASH_BLOCK)
+   {
+      for (j = 0; j < HASH_LANES; j++)
+      {
+         uint32_t input;
+         memcpy(&input, data + j * sizeof(uint32_t), sizeof(input));
+         acc[j] = hash_round(acc[j], input);
+      }
+   }
+}
+
+#ifdef NETPLAY_HAVE_AVX2
+__attribute__((target("avx2")))
+static void hash_blocks_avx2(uint32_t *acc, const uint8_t *data, size_t blocks)
+{
+   size_t i, j;
+   __m256i v[HASH_LANES / 8];
+   const __m256i prime1 = _mm256_set1_epi32(HASH_PRIME1);
+   const __m256i prime2 = _mm256_set1_epi32(HASH_PRIME2);
+
+   for (j = 0; j < HASH_LANES / 8; j++)
+      v[j] = _mm256_loadu_si256((const __m256i*)acc + j);
+
+   for (i = 0; i < blocks; i++, data += HASH_BLOCK)
+   {
+      for (j = 0; j < HASH_LANES / 8; j++)
+      {
+         __m256i input = _mm256_loadu_si256((const __m256i*)data + j);
+         __m256i a = _mm256_add_epi32(v[j], _mm256_mullo_epi32(input, prime2));
+         a = _mm256_or_si256(_mm256_slli_epi32(a, 13), _mm256_srli_epi32(a, 19));
+         v[j] = _mm256_mullo_epi32(a, prime1);
+      }
+   }
+
+   for (j = 0; j < HASH_LANES / 8; j++)
+      _mm256_storeu_si256((__m256i*)acc + j, v[j]);
+}
+#endif
+
+static void (*hash_blocks_func)(uint32_t *acc, const uint8_t *data, size_t blocks) = hash_blocks;
+
+static void netplay_init_simd(void)
+{
+   hash_blocks_func = hash_blocks;
+
+#ifdef NETPLAY_HAVE_AVX2
+   if (rarch_get_cpu_features() & RETRO_SIMD_AVX2)
+      hash_blocks_func = hash_blocks_avx2;
+#endif
+}
+
+static uint32_t netplay_hash_state(const void *data_, size_t size)
+{
+   unsigned i;
+   const uint8_t *data = (const uint8_t*)data_;
+   uint32_t acc[HASH_LANES];
+   size_t blocks = size / HASH_BLOCK;
+
+   for (i = 0; i < HASH_LANES; i++)
+      acc[i] = HASH_PRIME1 * (i + 1);
+
+   hash_blocks_func(acc, data, blocks);
+   data += blocks * HASH_BLOCK;
+   size -= blocks * HASH_BLOCK;
+
+   uint32_t hash = HASH_PRIME3 + blocks * HASH_BLOCK + size;
+   for (i = 0; i < HASH_LANES; i++)
+      hash = hash_round(hash, acc[i]);
+   for (; size; size--, data++)
+      hash = hash_round(hash, *data);
+
+   hash ^= hash >> 15;
+   hash *= HASH_PRIME2;
+   hash ^= hash >> 13;
+   hash *= HASH_PRIME3;
+   hash ^= hash >> 16;
+   return hash;
+}
+
+static bool netplay_is_check_frame(netplay_t *handle, uint32_t frame)
+{
+   return handle->check_frames && frame % handle->check_frames == 0;
+}
+
+// Hashes the state of 'frame' for the desync check. A frame run again on a rollback is hashed again.
+static void netplay_hash_frame(netplay_t *handle, uint32_t frame, const void *state)
+{
+   struct netplay_crc *crc = &handle->crcs[(frame / handle->check_frames) % CRC_BUFFER_SIZE];
+   retro_time_t start = rarch_get_time_usec();
+   uint32_t hash = netplay_hash_state(state, handle->state_size);
+   handle->stats.hash_usec += rarch_get_time_usec() - start;
+   handle->stats.hashed_states++;
+
+   if (crc->frame != frame)
+   {
+      memset(crc, 0, sizeof(*crc));
+      crc->frame = frame;
+   }
+
+   crc->local = hash;
+   crc->has_local = true;
+}
+
+static bool init_buffers(netplay_t *handle)
 {
    unsigned i;
    handle->buffer = (struct delta_frame*)calloc(handle->buffer_size, sizeof(*handle->buffer));
-   handle->state_size = pretro_serialize_size();
+   if (!handle->buffer)
+      return false;
+
    for (i = 0; i < handle->buffer_size; i++)
-   {
-      handle->buffer[i].state = malloc(handle->state_size);
       handle->buffer[i].is_simulated = true;
+
+   handle->checkpoint_interval = g_settings.netplay_checkpoint_interval ? g_settings.netplay_checkpoint_interval : 1;
+   handle->states_size = handle->buffer_size + handle->checkpoint_interval;
+   handle->states = (struct state_frame*)calloc(handle->states_size, sizeof(*handle->states));
+   if (!handle->states)
+      return false;
+
+   handle->inputs_size = handle->states_size + RESYNC_HISTORY_FRAMES;
+   handle->inputs = (struct input_frame*)calloc(handle->inputs_size, sizeof(*handle->inputs));
+   if (!handle->inputs)
+      return false;
+
+   handle->state_size = pretro_serialize_size();
+   if (!handle->state_size)
+      return true;
+
+   handle->state = state_manager_block_new(handle->state_size, 0x0000);
+   handle->next_state = state_manager_block_new(handle->state_size, 0xFFFF);
+   handle->scratch_delta = (uint8_t*)malloc(state_manager_delta_max_size(handle->state_size));
+   return handle->state && handle->next_state && handle->scratch_delta;
+}
+
+// Serializes the state of 'frame', which must come after last_frame.
+static void netplay_store_state(netplay_t *handle, uint32_t frame)
+{
+   if (!handle->state_size)
+      return;
+
+   pretro_serialize(handle->next_state, handle->state_size);
+
+   if (netplay_is_check_frame(handle, frame))
+      netplay_hash_frame(handle, frame, handle->next_state);
+
+   if (handle->has_state)
+   {
+      struct state_frame *last = &handle->states[handle->last_frame % handle->states_size];
+      size_t size = state_manager_delta_encode(handle->scratch_delta,
+            handle->state, handle->next_state, handle->state_size);
+
+      if (size > last->delta_capacity)
+      {
+         uint8_t *delta = (uint8_t*)realloc(last->delta, size);
+         if (delta)
+         {
+            last->delta = delta;
+            last->delta_capacity = size;
+         }
+      }
+
+      if (size <= last->delta_capacity)
+         memcpy(last->delta, handle->scratch_delta, size);
+      else
+      {
+         // Every older frame chains through this one, so none of them can be loaded any more.
+         // Rolling back past here would quietly desync us, so the session ends instead.
+         unsigned i;
+         RARCH_ERR("Failed to allocate netplay state history.\n");
+         for (i = 0; i < handle->states_size; i++)
+            handle->states[i].stored = false;
+         if (handle->has_connection)
+         {
+            handle->has_connection = false;
+            warn_hangup();
+         }
+      }
+   }
+
+   void *tmp = handle->state;
+   handle->state = handle->next_state;
+   handle->next_state = tmp;
+   handle->last_frame = frame;
+   handle->states[frame % handle->states_size].stored = true;
+   handle->has_state = true;
+}
+
+// Loads the newest stored state at or before 'frame' into the core, and returns which frame that is.
+// Frames after it are invalid until they're stored again.
+static uint32_t netplay_load_state(netplay_t *handle, uint32_t frame)
+{
+   if (!handle->state_size)
+      return frame;
+
+   while (handle->last_frame > frame)
+   {
+      uint32_t prev = handle->last_frame - 1;
+      while (!handle->states[prev % handle->states_size].stored)
+         prev--;
+
+      state_manager_delta_apply(handle->states[prev % handle->states_size].delta, handle->state);
+      handle->last_frame = prev;
    }
+
+   pretro_unserialize(handle->state, handle->state_size);
+   return handle->last_frame;
+}
+
+// Remembers what a frame was run with, for when it has to be run again from an earlier checkpoint.
+static void netplay_record_input(netplay_t *handle, uint32_t frame, size_t ptr)
+{
+   struct input_frame *input = &handle->inputs[frame % handle->inputs_size];
+   input->self_input = handle->buffer[ptr].self_state;
+   input->other_input = handle->buffer[ptr].is_simulated ?
+      handle->buffer[ptr].simulated_input_state : handle->buffer[ptr].real_input_state;
 }
 
 netplay_t *netplay_new(const char *server, uint16_t port,
@@ -755,6 +1423,9 @@ netplay_t *netplay_new(const char *server, uint16_t port,
 
    handle->fd = -1;
    handle->udp_fd = -1;
+#ifdef HAVE_SPECTATE_EPOLL
+   handle->spectate_epoll = -1;
+#endif
    handle->cbs = *cb;
    handle->port = server ? 0 : 1;
    handle->spectate = spectate;
@@ -776,7 +1447,13 @@ netplay_t *netplay_new(const char *server, uint16_t port,
       }
 
       for (i = 0; i < MAX_SPECTATORS; i++)
-         handle->spectate_fds[i] = -1;
+         handle->spectators[i].fd = -1;
+
+      if (!server && !init_spectate_server(handle))
+      {
+         RARCH_ERR("Failed to set up spectator server.\n");
+         goto error;
+      }
    }
    else
    {
@@ -792,19 +1469,49 @@ netplay_t *netplay_new(const char *server, uint16_t port,
       }
 
       handle->buffer_size = frames + 1;
+      handle->input_delay_max = g_settings.netplay_input_delay_max;
+      if (handle->input_delay_max > MAX_INPUT_DELAY)
+         handle->input_delay_max = MAX_INPUT_DELAY;
+      handle->start_time = rarch_get_time_usec();
 
-      init_buffers(handle);
+      if (!init_buffers(handle))
+         goto error;
       handle->has_connection = true;
+
+      if (handle->state_size)
+         handle->check_frames = g_settings.netplay_check_frames;
+      netplay_init_simd();
+
+#ifdef HAVE_NETPLAY_THREAD
+      if (!netplay_net_start(handle))
+      {
+         RARCH_ERR("Failed to start netplay network thread.\n");
+         goto error;
+      }
+#endif
    }
 
    return handle;
 
 error:
+#ifdef HAVE_NETPLAY_THREAD
+   netplay_net_stop(handle);
+#endif
+#ifdef HAVE_SPECTATE_EPOLL
+   if (handle->spectate_epoll >= 0)
+      close(handle->spectate_epoll);
+#endif
    if (handle->fd >= 0)
       close(handle->fd);
    if (handle->udp_fd >= 0)
       close(handle->udp_fd);
 
+   free(handle->buffer);
+   free(handle->states);
+   free(handle->inputs);
+   free(handle->state);
+   free(handle->next_state);
+   free(handle->scratch_delta);
    free(handle);
    return NULL;
 }
@@ -815,31 +1522,59 @@ static bool netplay_is_alive(netplay_t *handle)
    return handle->has_connection;
 }
 
-static bool send_chunk(netplay_t *handle)
+static bool send_packet(netplay_t *handle, const uint32_t *packet)
 {
+   struct sockaddr_storage their_addr;
    const struct sockaddr *addr = NULL;
    if (handle->addr)
       addr = handle->addr->ai_addr;
-   else if (handle->has_client_addr)
-      addr = (const struct sockaddr*)&handle->their_addr;
+   else
+   {
+#ifdef HAVE_NETPLAY_THREAD
+      slock_lock(handle->net_lock);
+#endif
+      if (handle->has_client_addr)
+      {
+         their_addr = handle->their_addr;
+         addr = (const struct sockaddr*)&their_addr;
+      }
+#ifdef HAVE_NETPLAY_THREAD
+      slock_unlock(handle->net_lock);
+#endif
+   }
 
    if (addr)
    {
-      if (sendto(handle->udp_fd, CONST_CAST handle->packet_buffer,
+      if (sendto(handle->udp_fd, CONST_CAST packet,
                sizeof(handle->packet_buffer), 0, addr,
                sizeof(struct sockaddr)) != sizeof(handle->packet_buffer))
-      {
-         warn_hangup();
-         handle->has_connection = false;
          return false;
-      }
    }
    return true;
 }
 
-#define MAX_RETRIES 16
-#define RETRY_MS 500
+static bool send_chunk(netplay_t *handle)
+{
+#ifdef HAVE_NETPLAY_THREAD
+   slock_lock(handle->net_lock);
+   memcpy(handle->resend_buffer, handle->packet_buffer, sizeof(handle->packet_buffer));
+   handle->resend_time = rarch_get_time_usec();
+   slock_unlock(handle->net_lock);
+#endif
 
+   if (!send_packet(handle, handle->packet_buffer))
+   {
+      warn_hangup();
+      handle->has_connection = false;
+      return false;
+   }
+   return true;
+}
+
+#define MAX_RETRIES 16
+#define RETRY_MS 500
+
+#ifndef HAVE_NETPLAY_THREAD
 static int poll_input(netplay_t *handle, bool block)
 {
    int max_fd = (handle->fd > handle->udp_fd ? handle->fd : handle->udp_fd) + 1;
@@ -890,6 +1625,47 @@ static int poll_input(netplay_t *handle, bool block)
       return -1;
    return 0;
 }
+#endif
+
+static void predictor_update(struct input_predictor *predictor, uint16_t state)
+{
+   unsigned i;
+   for (i = 0; i < PREDICT_BUTTONS; i++)
+   {
+      bool was_pressed = predictor->last & (1 << i);
+      if (was_pressed == !!(state & (1 << i)))
+      {
+         if (predictor->run[i] < UINT16_MAX)
+            predictor->run[i]++;
+         continue;
+      }
+
+      if (was_pressed)
+      {
+         unsigned len = predictor->run[i] < UINT8_MAX ? predictor->run[i] : UINT8_MAX;
+         predictor->press_len[i] = predictor->press_len[i] ? (predictor->press_len[i] + len + 1) / 2 : len;
+      }
+      predictor->run[i] = 1;
+   }
+
+   predictor->last = state;
+}
+
+// Guesses the input ahead frames after the last one the predictor has seen.
+static uint16_t predictor_guess(const struct input_predictor *predictor, unsigned ahead)
+{
+   unsigned i;
+   uint16_t state = predictor->last;
+
+   for (i = 0; i < PREDICT_BUTTONS; i++)
+   {
+      unsigned len = predictor->press_len[i];
+      if ((state & (1 << i)) && len && len <= PREDICT_TAP_FRAMES && predictor->run[i] + ahead > len)
+         state &= ~(1 << i);
+   }
+
+   return state;
+}
 
 // Grab our own input state and send this over the network.
 static bool get_self_input_state(netplay_t *handle)
@@ -909,10 +1685,24 @@ static bool get_self_input_state(netplay_t *handle)
       }
    }
 
-   memmove(handle->packet_buffer, handle->packet_buffer + 2,
-         sizeof (handle->packet_buffer) - 2 * sizeof(uint32_t));
-   handle->packet_buffer[(UDP_FRAME_PACKETS - 1) * 2] = htonl(handle->frame_count); 
-   handle->packet_buffer[(UDP_FRAME_PACKETS - 1) * 2 + 1] = htonl(state);
+   if (predictor_guess(&handle->self_predictor, 1) != state)
+      handle->delay_window_mispredicts++;
+   predictor_update(&handle->self_predictor, state);
+
+   // What we sample now is the input for input_delay frames ahead. If the delay just went up,
+   // the frames in between get the same input. If it went down, we've already sent this frame.
+   for (; handle->input_send_frame <= handle->frame_count + handle->input_delay; handle->input_send_frame++)
+   {
+      handle->delayed_input[handle->input_send_frame % UDP_FRAME_PACKETS] = state;
+
+      memmove(handle->packet_buffer, handle->packet_buffer + 2,
+            (UDP_FRAME_PACKETS - 1) * 2 * sizeof(uint32_t));
+      handle->packet_buffer[(UDP_FRAME_PACKETS - 1) * 2] = htonl(handle->input_send_frame);
+      handle->packet_buffer[(UDP_FRAME_PACKETS - 1) * 2 + 1] = htonl(state);
+   }
+
+   handle->packet_buffer[UDP_SEND_FRAME_INDEX] = htonl(handle->frame_count + 1);
+   handle->packet_buffer[UDP_ECHO_FRAME_INDEX] = htonl(handle->peer_send_frame);
 
    if (!send_chunk(handle))
    {
@@ -921,44 +1711,321 @@ static bool get_self_input_state(netplay_t *handle)
       return false;
    }
 
-   ptr->self_state = state;
+   ptr->self_state = handle->delayed_input[handle->frame_count % UDP_FRAME_PACKETS];
    handle->self_ptr = NEXT_PTR(handle->self_ptr);
    return true;
 }
 
-// TODO: Somewhat better prediction. :P
+// Takes the other side's real input for read_frame_count.
+static void read_real_input(netplay_t *handle, uint16_t state)
+{
+   struct delta_frame *ptr = &handle->buffer[handle->read_ptr];
+
+   // Frames we've already run had to make do with a prediction.
+   if (handle->read_frame_count < handle->frame_count)
+   {
+      handle->stats.predicted_frames++;
+      if (ptr->simulated_input_state != state)
+         handle->stats.mispredicted_frames++;
+   }
+
+   ptr->is_simulated = false;
+   ptr->real_input_state = state;
+   handle->read_ptr = NEXT_PTR(handle->read_ptr);
+   handle->read_frame_count++;
+   handle->timeout_cnt = 0;
+
+   predictor_update(&handle->predictor, state);
+}
+
+static void read_packet_trailer(netplay_t *handle, uint32_t send_frame, uint32_t echo_frame)
+{
+   if (send_frame > handle->peer_send_frame)
+      handle->peer_send_frame = send_frame;
+   if (echo_frame > handle->peer_echo_frame)
+      handle->peer_echo_frame = echo_frame;
+}
+
+// Measures the round trip time from our echoed frames, and once every INPUT_DELAY_WINDOW frames
+// moves the input delay a frame closer to where it should be. Delay only pays off if our input would
+// otherwise be mispredicted often enough, and never beyond the one way latency.
+static void update_input_delay(netplay_t *handle)
+{
+   uint32_t echo_frame = handle->peer_echo_frame;
+   if (echo_frame != handle->last_echo_frame && echo_frame <= handle->frame_count + 1)
+   {
+      float rtt = handle->frame_count + 1 - echo_frame;
+      if (handle->last_echo_frame)
+         handle->rtt_frames += (rtt - handle->rtt_frames) * 0.125f;
+      else
+         handle->rtt_frames = rtt;
+      handle->last_echo_frame = echo_frame;
+   }
+
+   if (handle->frame_count - handle->delay_window_start < INPUT_DELAY_WINDOW)
+      return;
+
+   float mispredict_rate = (float)handle->delay_window_mispredicts / (handle->frame_count - handle->delay_window_start);
+   handle->delay_window_start = handle->frame_count;
+   handle->delay_window_mispredicts = 0;
+
+   unsigned target = 0;
+   if (mispredict_rate >= INPUT_DELAY_MISPREDICT_RATE)
+      target = (unsigned)(handle->rtt_frames / 2.0f + 0.5f);
+   if (target > handle->input_delay_max)
+      target = handle->input_delay_max;
+
+   if (target == handle->input_delay)
+      return;
+
+   handle->input_delay += target > handle->input_delay ? 1 : -1;
+   RARCH_LOG("Netplay input delay is now %u frames (round trip %.1f frames, %.1f%% of input unpredictable).\n",
+         handle->input_delay, handle->rtt_frames, mispredict_rate * 100.0f);
+}
+
 static void simulate_input(netplay_t *handle)
 {
    size_t ptr = PREV_PTR(handle->self_ptr);
-   size_t prev = PREV_PTR(handle->read_ptr);
 
-   handle->buffer[ptr].simulated_input_state = handle->buffer[prev].real_input_state;
+   handle->buffer[ptr].simulated_input_state = predictor_guess(&handle->predictor,
+         handle->frame_count - (handle->read_frame_count - 1));
    handle->buffer[ptr].is_simulated = true;
    handle->buffer[ptr].used_real = false;
 }
 
-static void parse_packet(netplay_t *handle, uint32_t *buffer, unsigned size)
+#ifdef HAVE_NETPLAY_THREAD
+#define NET_THREAD_POLL_MS 10
+// While the main thread is stalled, our last packet goes out again this often.
+// It's much sooner than RETRY_MS, which is how long the main thread waits before it counts towards giving up.
+// A stall where both sides lost their last packet then costs a few frames rather than half a second.
+#define NET_RESEND_MS 40
+
+static void net_wake(netplay_t *handle)
+{
+   slock_lock(handle->net_lock);
+   scond_signal(handle->net_cond);
+   slock_unlock(handle->net_lock);
+}
+
+// Producer side. Every packet repeats the last UDP_FRAME_PACKETS frames, so only push what is new.
+static void net_push_packet(netplay_t *handle, const uint32_t *buffer)
 {
    unsigned i;
-   for (i = 0; i < size * 2; i++)
-      buffer[i] = ntohl(buffer[i]);
+   uint32_t write = handle->net_queue_write;
 
-   for (i = 0; i < size && handle->read_frame_count <= handle->frame_count; i++)
+   for (i = 0; i < UDP_FRAME_PACKETS; i++)
    {
-      uint32_t frame = buffer[2 * i + 0];
-      uint32_t state = buffer[2 * i + 1];
+      if (ntohl(buffer[2 * i + 0]) != handle->net_next_frame)
+         continue;
 
-      if (frame == handle->read_frame_count)
+      // Full. The frame will come around again in a later packet.
+      if (write - handle->net_queue_read == NET_QUEUE_SIZE)
+         break;
+
+      struct net_input *input = &handle->net_queue[write & (NET_QUEUE_SIZE - 1)];
+      input->frame = handle->net_next_frame++;
+      input->state = ntohl(buffer[2 * i + 1]);
+      write++;
+   }
+
+   // The entries have to be visible before the index which publishes them.
+   __sync_synchronize();
+   handle->net_queue_write = write;
+
+   read_packet_trailer(handle, ntohl(buffer[UDP_SEND_FRAME_INDEX]), ntohl(buffer[UDP_ECHO_FRAME_INDEX]));
+}
+
+static void netplay_net_thread(void *data)
+{
+   netplay_t *handle = (netplay_t*)data;
+   int max_fd = (handle->fd > handle->udp_fd ? handle->fd : handle->udp_fd) + 1;
+
+   while (!handle->net_quit)
+   {
+      bool wake = false;
+      struct timeval tv = {0};
+      tv.tv_usec = NET_THREAD_POLL_MS * 1000;
+
+      fd_set fds;
+      FD_ZERO(&fds);
+      FD_SET(handle->udp_fd, &fds);
+      // Commands are read by the main thread. Leave the socket alone until it has.
+      if (!handle->net_cmd_pending)
+         FD_SET(handle->fd, &fds);
+
+      int ret = select(max_fd, &fds, NULL, NULL, &tv);
+      if (ret < 0)
+         break;
+
+      if (ret > 0 && FD_ISSET(handle->fd, &fds))
       {
-         handle->buffer[handle->read_ptr].is_simulated = false;
-         handle->buffer[handle->read_ptr].real_input_state = state;
-         handle->read_ptr = NEXT_PTR(handle->read_ptr);
-         handle->read_frame_count++;
-         handle->timeout_cnt = 0;
+         handle->net_cmd_pending = true;
+         wake = true;
       }
+
+      if (ret > 0 && FD_ISSET(handle->udp_fd, &fds))
+      {
+         uint32_t buffer[UDP_PACKET_WORDS];
+         struct sockaddr_storage their_addr;
+         socklen_t addrlen = sizeof(their_addr);
+
+         if (recvfrom(handle->udp_fd, NONCONST_CAST buffer, sizeof(buffer), 0,
+                  (struct sockaddr*)&their_addr, &addrlen) != (ssize_t)sizeof(buffer))
+            break;
+
+         if (!handle->addr)
+         {
+            slock_lock(handle->net_lock);
+            handle->their_addr = their_addr;
+            handle->has_client_addr = true;
+            slock_unlock(handle->net_lock);
+         }
+
+         net_push_packet(handle, buffer);
+         wake = true;
+      }
+
+      // The main thread is blocked on input, so the other side might be missing ours as well.
+      if (handle->net_stalled)
+      {
+         bool resend = false;
+         uint32_t packet[UDP_PACKET_WORDS];
+         retro_time_t now = rarch_get_time_usec();
+
+         slock_lock(handle->net_lock);
+         if (now - handle->resend_time >= NET_RESEND_MS * 1000)
+         {
+            memcpy(packet, handle->resend_buffer, sizeof(packet));
+            handle->resend_time = now;
+            resend = true;
+         }
+         slock_unlock(handle->net_lock);
+
+         if (resend && !send_packet(handle, packet))
+            break;
+      }
+
+      if (wake)
+         net_wake(handle);
+   }
+
+   if (!handle->net_quit)
+   {
+      handle->net_error = true;
+      net_wake(handle);
+   }
+}
+
+static bool netplay_net_start(netplay_t *handle)
+{
+   // Frame 0 is never sent, see netplay_poll().
+   handle->net_next_frame = 1;
+
+   handle->net_lock = slock_new();
+   handle->net_cond = scond_new();
+   if (!handle->net_lock || !handle->net_cond)
+      return false;
+
+   handle->net_thread = sthread_create(netplay_net_thread, handle);
+   return handle->net_thread;
+}
+
+static void netplay_net_stop(netplay_t *handle)
+{
+   if (handle->net_thread)
+   {
+      handle->net_quit = true;
+      sthread_join(handle->net_thread);
+      handle->net_thread = NULL;
+   }
+
+   if (handle->net_lock)
+      slock_free(handle->net_lock);
+   if (handle->net_cond)
+      scond_free(handle->net_cond);
+   handle->net_lock = NULL;
+   handle->net_cond = NULL;
+}
+
+// Consumer side.
+static void net_drain_queue(netplay_t *handle)
+{
+   uint32_t read = handle->net_queue_read;
+   uint32_t write = handle->net_queue_write;
+
+   // Pairs with the barrier in net_push_packet().
+   __sync_synchronize();
+
+   for (; read != write && handle->read_frame_count <= handle->frame_count; read++)
+   {
+      const struct net_input *input = &handle->net_queue[read & (NET_QUEUE_SIZE - 1)];
+      if (input->frame == handle->read_frame_count)
+         read_real_input(handle, input->state);
    }
+
+   // Done with the entries before handing them back.
+   __sync_synchronize();
+   handle->net_queue_read = read;
 }
 
+static bool net_handle_cmd(netplay_t *handle)
+{
+   // netplay_flip_players() might already have read whatever woke the thread up.
+   // A state being sent comes in a chunk per frame, so take everything that's there.
+   int ret;
+   do
+   {
+      fd_set fds;
+      struct timeval tv = {0};
+      FD_ZERO(&fds);
+      FD_SET(handle->fd, &fds);
+
+      ret = select(handle->fd + 1, &fds, NULL, NULL, &tv);
+      if (ret > 0 && !netplay_get_cmd(handle))
+         return false;
+   } while (ret > 0);
+
+   handle->net_cmd_pending = false;
+   return ret >= 0;
+}
+
+// Takes whatever the network thread has queued up. Only blocks when the rollback window is exhausted,
+// and then only until something new arrives.
+static bool poll_queue(netplay_t *handle)
+{
+   uint32_t first_read = handle->read_frame_count;
+
+   for (;;)
+   {
+      if (handle->net_error)
+         return false;
+      if (handle->net_cmd_pending && !net_handle_cmd(handle))
+         return false;
+
+      net_drain_queue(handle);
+      if (handle->other_ptr != handle->self_ptr || handle->read_frame_count != first_read)
+         return true;
+
+      bool timed_out = false;
+      slock_lock(handle->net_lock);
+      handle->net_stalled = true;
+      if (handle->net_queue_read == handle->net_queue_write &&
+            !handle->net_error && !handle->net_cmd_pending)
+         timed_out = !scond_wait_timeout(handle->net_cond, handle->net_lock, RETRY_MS * 1000);
+      handle->net_stalled = false;
+      slock_unlock(handle->net_lock);
+
+      if (timed_out)
+      {
+         if (++handle->timeout_cnt >= MAX_RETRIES)
+            return false;
+
+         RARCH_LOG("Network is stalling, resending packet... Count %u of %d ...\n",
+               handle->timeout_cnt, MAX_RETRIES);
+      }
+   }
+}
+#else
 static bool receive_data(netplay_t *handle, uint32_t *buffer, size_t size)
 {
    socklen_t addrlen = sizeof(handle->their_addr);
@@ -968,6 +2035,25 @@ static bool receive_data(netplay_t *handle, uint32_t *buffer, size_t size)
    return true;
 }
 
+static void parse_packet(netplay_t *handle, uint32_t *buffer, unsigned size)
+{
+   unsigned i;
+   for (i = 0; i < UDP_PACKET_WORDS; i++)
+      buffer[i] = ntohl(buffer[i]);
+
+   for (i = 0; i < size && handle->read_frame_count <= handle->frame_count; i++)
+   {
+      uint32_t frame = buffer[2 * i + 0];
+      uint32_t state = buffer[2 * i + 1];
+
+      if (frame == handle->read_frame_count)
+         read_real_input(handle, state);
+   }
+
+   read_packet_trailer(handle, buffer[UDP_SEND_FRAME_INDEX], buffer[UDP_ECHO_FRAME_INDEX]);
+}
+#endif
+
 // Poll network to see if we have anything new. If our network buffer is full, we simply have to block for new input data.
 static bool netplay_poll(netplay_t *handle)
 {
@@ -990,6 +2076,14 @@ static bool netplay_poll(netplay_t *handle)
       return true;
    }
 
+#ifdef HAVE_NETPLAY_THREAD
+   if (!poll_queue(handle))
+   {
+      handle->has_connection = false;
+      warn_hangup();
+      return false;
+   }
+#else
    // We might have reached the end of the buffer, where we simply have to block.
    int res = poll_input(handle, handle->other_ptr == handle->self_ptr);
    if (res == -1)
@@ -1004,7 +2098,7 @@ static bool netplay_poll(netplay_t *handle)
       uint32_t first_read = handle->read_frame_count;
       do 
       {
-         uint32_t buffer[UDP_FRAME_PACKETS * 2];
+         uint32_t buffer[UDP_PACKET_WORDS];
          if (!receive_data(handle, buffer, sizeof(buffer)))
          {
             warn_hangup();
@@ -1026,6 +2120,10 @@ static bool netplay_poll(netplay_t *handle)
          return false;
       }
    }
+#endif
+
+   if (handle->input_delay_max)
+      update_input_delay(handle);
 
    if (handle->read_ptr != handle->self_ptr)
       simulate_input(handle);
@@ -1061,13 +2159,190 @@ static bool netplay_cmd_nak(netplay_t *handle)
    return send_all(handle->fd, &cmd, sizeof(cmd));
 }
 
+static bool netplay_handle_cmd(netplay_t *handle, uint32_t cmd);
+
+// The other side may have sent a command of its own before answering ours.
 static bool netplay_get_response(netplay_t *handle)
 {
-   uint32_t response;
-   if (!recv_all(handle->fd, &response, sizeof(response)))
+   for (;;)
+   {
+      uint32_t response;
+      if (!recv_all(handle->fd, &response, sizeof(response)))
+         return false;
+
+      response = ntohl(response);
+      if (response == NETPLAY_CMD_ACK || response == NETPLAY_CMD_NAK)
+         return response == NETPLAY_CMD_ACK;
+
+      if (!netplay_handle_cmd(handle, response))
+         return false;
+   }
+}
+
+// Starts sending the core's current state, which is that of 'frame', over to the client.
+// The rest goes out a chunk per frame, see netplay_send_state_chunk().
+static void netplay_send_state(netplay_t *handle, uint32_t frame)
+{
+   unsigned i;
+   handle->resync_needed = false;
+
+   if (!handle->resync_chunk)
+      handle->resync_chunk = (uint8_t*)malloc(STATE_CHUNK_SIZE);
+   if (!handle->resync_chunk || !state_stream_send_init(&handle->resync_stream, handle->state_size) ||
+         !pretro_serialize(handle->resync_stream.state, handle->state_size))
+   {
+      RARCH_ERR("Failed to save state to resync netplay.\n");
+      state_stream_free(&handle->resync_stream);
+      return;
+   }
+   state_stream_send_start(&handle->resync_stream);
+
+   // Whatever the client sends until it has loaded this is stale.
+   handle->sync_generation++;
+   for (i = 0; i < CRC_BUFFER_SIZE; i++)
+      handle->crcs[i].has_remote = false;
+
+   uint32_t header[4] = {
+      htonl(frame),
+      htonl(handle->sync_generation),
+      htonl(handle->state_size),
+      htonl(handle->resync_stream.deflated),
+   };
+
+   if (!netplay_send_cmd(handle, NETPLAY_CMD_LOAD_STATE, header, sizeof(header)))
+   {
+      RARCH_ERR("Failed to send state to resync netplay.\n");
+      state_stream_free(&handle->resync_stream);
+      return;
+   }
+
+   handle->resync_streaming = true;
+   handle->stats.resyncs++;
+   RARCH_LOG("Sending netplay state of frame %u to resync.\n", frame);
+}
+
+static void netplay_send_state_chunk(netplay_t *handle)
+{
+   struct state_stream *stream = &handle->resync_stream;
+   size_t chunk_size = state_stream_send_chunk(stream, handle->resync_chunk, STATE_CMD_CHUNK_SIZE);
+
+   if (chunk_size && !netplay_send_cmd(handle, NETPLAY_CMD_STATE_CHUNK, handle->resync_chunk, chunk_size))
+   {
+      RARCH_ERR("Failed to send state to resync netplay.\n");
+      stream->done = true;
+   }
+
+   if (stream->done)
+   {
+      state_stream_free(stream);
+      handle->resync_streaming = false;
+   }
+}
+
+static bool netplay_get_state(netplay_t *handle, size_t cmd_size)
+{
+   uint32_t header[4];
+   if (cmd_size != sizeof(header) || !recv_all(handle->fd, header, sizeof(header)))
+   {
+      RARCH_ERR("Failed to receive CMD_LOAD_STATE header.\n");
       return false;
+   }
+
+   if (ntohl(header[2]) != handle->state_size)
+   {
+      RARCH_ERR("CMD_LOAD_STATE has unexpected state size.\n");
+      return false;
+   }
+
+   // A newer state replaces one which is still coming in.
+   state_stream_free(&handle->resync_stream);
+   handle->resync_streaming = false;
+   handle->resync_stream_frame = ntohl(header[0]);
+   handle->resync_stream_generation = ntohl(header[1]);
+
+   if (!handle->resync_chunk)
+      handle->resync_chunk = (uint8_t*)malloc(STATE_CHUNK_SIZE);
+   if (!handle->resync_chunk || !state_stream_recv_init(&handle->resync_stream, handle->state_size, ntohl(header[3])))
+   {
+      // Moving on to its generation without loading it makes the host see we're still off and try again.
+      RARCH_ERR("Cannot take state from host.\n");
+      state_stream_free(&handle->resync_stream);
+      handle->sync_generation = handle->resync_stream_generation;
+      return true;
+   }
+
+   handle->resync_streaming = true;
+   return true;
+}
+
+static bool netplay_get_state_chunk(netplay_t *handle, size_t cmd_size)
+{
+   uint8_t discard[256];
+   struct state_stream *stream = &handle->resync_stream;
+
+   if (!handle->resync_streaming)
+   {
+      // What's left of a state we gave up on.
+      while (cmd_size)
+      {
+         size_t size = cmd_size < sizeof(discard) ? cmd_size : sizeof(discard);
+         if (!recv_all(handle->fd, discard, size))
+            return false;
+         cmd_size -= size;
+      }
+      return true;
+   }
+
+   if (cmd_size > STATE_CMD_CHUNK_SIZE || !recv_all(handle->fd, handle->resync_chunk, cmd_size))
+   {
+      RARCH_ERR("Failed to receive state from host.\n");
+      return false;
+   }
+
+   if (!state_stream_recv_chunk(stream, handle->resync_chunk, cmd_size))
+   {
+      RARCH_ERR("Failed to inflate state from host.\n");
+      state_stream_free(stream);
+      handle->resync_streaming = false;
+      handle->sync_generation = handle->resync_stream_generation;
+      return true;
+   }
+
+   if (!stream->done)
+      return true;
+
+   // Loaded after the frame, see netplay_load_resync().
+   free(handle->resync_state);
+   handle->resync_state = stream->state;
+   stream->state = NULL;
+   state_stream_free(stream);
+   handle->resync_streaming = false;
+
+   handle->resync_pending = true;
+   handle->resync_frame = handle->resync_stream_frame;
+   handle->resync_generation = handle->resync_stream_generation;
+   return true;
+}
+
+// Hash the other side sent for 'frame'. Hashes which are older than what we keep are ignored.
+static void netplay_crc_remote(netplay_t *handle, uint32_t frame, uint32_t hash)
+{
+   if (!handle->check_frames || frame % handle->check_frames)
+      return;
+
+   struct netplay_crc *crc = &handle->crcs[(frame / handle->check_frames) % CRC_BUFFER_SIZE];
+   if (crc->frame != frame)
+   {
+      if ((int32_t)(frame - crc->frame) < 0 && (crc->has_local || crc->has_remote))
+         return;
+
+      memset(crc, 0, sizeof(*crc));
+      crc->frame = frame;
+   }
 
-   return ntohl(response) == NETPLAY_CMD_ACK;
+   crc->remote = hash;
+   crc->has_remote = true;
+   crc->done = false;
 }
 
 static bool netplay_get_cmd(netplay_t *handle)
@@ -1076,8 +2351,11 @@ static bool netplay_get_cmd(netplay_t *handle)
    if (!recv_all(handle->fd, &cmd, sizeof(cmd)))
       return false;
 
-   cmd = ntohl(cmd);
+   return netplay_handle_cmd(handle, ntohl(cmd));
+}
 
+static bool netplay_handle_cmd(netplay_t *handle, uint32_t cmd)
+{
    size_t cmd_size = cmd & 0xffff;
    cmd = cmd >> 16;
 
@@ -1114,6 +2392,27 @@ static bool netplay_get_cmd(netplay_t *handle)
          return netplay_cmd_ack(handle);
       }
 
+      case NETPLAY_CMD_CRC:
+      {
+         uint32_t crc[3];
+         if (cmd_size != sizeof(crc) || !recv_all(handle->fd, crc, sizeof(crc)))
+         {
+            RARCH_ERR("Failed to receive CMD_CRC argument.\n");
+            return false;
+         }
+
+         // Anything the client hashed before it loaded our latest state is bound to differ.
+         if (ntohl(crc[2]) == handle->sync_generation)
+            netplay_crc_remote(handle, ntohl(crc[0]), ntohl(crc[1]));
+         return true;
+      }
+
+      case NETPLAY_CMD_LOAD_STATE:
+         return netplay_get_state(handle, cmd_size);
+
+      case NETPLAY_CMD_STATE_CHUNK:
+         return netplay_get_state_chunk(handle, cmd_size);
+
       default:
          RARCH_ERR("Unknown netplay command received.\n");
          return netplay_cmd_nak(handle);
@@ -1185,7 +2484,12 @@ int16_t netplay_input_state(netplay_t *handle, bool port, unsigned device, unsig
 
    port = netplay_flip_port(handle, port);
 
-   if ((port ? 1 : 0) == handle->port)
+   if (handle->is_catchup)
+   {
+      const struct input_frame *input = &handle->inputs[handle->tmp_frame_count % handle->inputs_size];
+      input_state = (port ? 1 : 0) == handle->port ? input->other_input : input->self_input;
+   }
+   else if ((port ? 1 : 0) == handle->port)
    {
       if (handle->buffer[ptr].is_simulated)
          input_state = handle->buffer[ptr].simulated_input_state;
@@ -1201,24 +2505,42 @@ int16_t netplay_input_state(netplay_t *handle, bool port, unsigned device, unsig
 void netplay_free(netplay_t *handle)
 {
    unsigned i;
+#ifdef HAVE_NETPLAY_THREAD
+   netplay_net_stop(handle);
+#endif
    close(handle->fd);
 
    if (handle->spectate)
    {
       for (i = 0; i < MAX_SPECTATORS; i++)
-         if (handle->spectate_fds[i] >= 0)
-            close(handle->spectate_fds[i]);
+         if (handle->spectators[i].fd >= 0)
+            spectator_close(handle, i, NULL);
 
+#ifdef HAVE_SPECTATE_EPOLL
+      if (handle->spectate_epoll >= 0)
+         close(handle->spectate_epoll);
+#endif
       free(handle->spectate_input);
    }
    else
    {
       close(handle->udp_fd);
 
-      for (i = 0; i < handle->buffer_size; i++)
-         free(handle->buffer[i].state);
+      if (handle->states)
+      {
+         for (i = 0; i < handle->states_size; i++)
+            free(handle->states[i].delta);
+      }
 
       free(handle->buffer);
+      free(handle->states);
+      free(handle->inputs);
+      free(handle->state);
+      free(handle->next_state);
+      free(handle->scratch_delta);
+      free(handle->resync_state);
+      free(handle->resync_chunk);
+      state_stream_free(&handle->resync_stream);
    }
 
    if (handle->addr)
@@ -1234,7 +2556,7 @@ static bool netplay_should_skip(netplay_t *handle)
 
 static void netplay_pre_frame_net(netplay_t *handle)
 {
-   pretro_serialize(handle->buffer[handle->self_ptr].state, handle->state_size);
+   netplay_store_state(handle, handle->frame_count);
    handle->can_poll = true;
 
    input_poll_net();
@@ -1281,89 +2603,399 @@ int16_t input_state_spectate_client(unsigned port, unsigned device, unsigned ind
    return netplay_get_spectate_input(g_extern.netplay, port, device, index, id);
 }
 
-static void netplay_pre_frame_spectate(netplay_t *handle)
+static bool socket_nonblock(int fd)
 {
-   unsigned i;
-   if (handle->spectate_client)
-      return;
+#ifdef _WIN32
+   u_long mode = 1;
+   return ioctlsocket(fd, FIONBIO, &mode) == 0;
+#else
+   return fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == 0;
+#endif
+}
 
-   fd_set fds;
-   FD_ZERO(&fds);
-   FD_SET(handle->fd, &fds);
+static bool socket_would_block(void)
+{
+#ifdef _WIN32
+   return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+   return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
 
-   struct timeval tmp_tv = {0};
-   if (select(handle->fd + 1, &fds, NULL, NULL, &tmp_tv) <= 0)
-      return;
+static bool init_spectate_server(netplay_t *handle)
+{
+   if (!socket_nonblock(handle->fd))
+      return false;
 
-   if (!FD_ISSET(handle->fd, &fds))
-      return;
+#ifdef HAVE_SPECTATE_EPOLL
+   handle->spectate_epoll = epoll_create(MAX_SPECTATORS + 1);
+   if (handle->spectate_epoll < 0)
+      return false;
 
-   struct sockaddr_storage their_addr;
-   socklen_t addr_size = sizeof(their_addr);
-   int new_fd = accept(handle->fd, (struct sockaddr*)&their_addr, &addr_size);
-   if (new_fd < 0)
+   // Slot 0 is the listening socket, spectators are index + 1. See spectator_epoll_data().
+   struct epoll_event event = {0};
+   event.events = EPOLLIN;
+   event.data.u64 = 0;
+   if (epoll_ctl(handle->spectate_epoll, EPOLL_CTL_ADD, handle->fd, &event) < 0)
+      return false;
+#endif
+
+   return true;
+}
+
+static void spectator_close(netplay_t *handle, unsigned index, const char *reason)
+{
+   struct spectator *spectator = &handle->spectators[index];
+
+   // Closing the socket takes it out of the epoll set as well.
+   close(spectator->fd);
+   free(spectator->queue);
+   free(spectator->join);
+   state_stream_free(&spectator->join_stream);
+   memset(spectator, 0, sizeof(*spectator));
+   spectator->fd = -1;
+
+   if (reason)
    {
-      RARCH_ERR("Failed to accept incoming spectator.\n");
-      return;
+      RARCH_LOG("Client (#%u) %s ...\n", index, reason);
+
+      char msg[512];
+      snprintf(msg, sizeof(msg), "Client (#%u) %s.", index, reason);
+      msg_queue_push(g_extern.msg_queue, msg, 1, 180);
    }
+}
 
-   int index = -1;
-   for (i = 0; i < MAX_SPECTATORS; i++)
+#ifdef HAVE_SPECTATE_EPOLL
+// The slot goes in the low half and the spectator's generation in the high half. One epoll_wait() can return events
+// for a client which an earlier event in the same batch dropped, after which spectator_accept() reused its slot.
+static uint64_t spectator_epoll_data(const netplay_t *handle, unsigned index)
+{
+   return ((uint64_t)handle->spectators[index].generation << 32) | (index + 1);
+}
+#endif
+
+static void spectator_watch(netplay_t *handle, unsigned index)
+{
+#ifdef HAVE_SPECTATE_EPOLL
+   const struct spectator *spectator = &handle->spectators[index];
+   struct epoll_event event = {0};
+   event.events = EPOLLIN | (spectator->want_write ? EPOLLOUT : 0);
+   event.data.u64 = spectator_epoll_data(handle, index);
+   epoll_ctl(handle->spectate_epoll, EPOLL_CTL_MOD, spectator->fd, &event);
+#else
+   (void)handle;
+   (void)index;
+#endif
+}
+
+static bool spectator_queue(struct spectator *spectator, const void *data_, size_t size)
+{
+   const uint8_t *data = (const uint8_t*)data_;
+   if (spectator->queue_capacity - spectator->queue_used < size)
+      return false;
+
+   size_t tail = (spectator->queue_head + spectator->queue_used) % spectator->queue_capacity;
+   size_t first = spectator->queue_capacity - tail;
+   if (first > size)
+      first = size;
+
+   memcpy(spectator->queue + tail, data, first);
+   memcpy(spectator->queue, data + first, size - first);
+   spectator->queue_used += size;
+   return true;
+}
+
+// Sends as much of the join data and then the queue as the socket takes right now.
+static bool spectator_flush(netplay_t *handle, unsigned index)
+{
+   struct spectator *spectator = &handle->spectators[index];
+
+   while (spectator->join_used)
    {
-      if (handle->spectate_fds[i] == -1)
-      {
-         index = i;
+      ssize_t ret = send(spectator->fd, CONST_CAST (spectator->join + spectator->join_head), spectator->join_used, 0);
+      if (ret < 0 && socket_would_block())
          break;
-      }
+      if (ret <= 0)
+         return false;
+
+      spectator->join_head += ret;
+      spectator->join_used -= ret;
    }
 
-   // No vacant client streams :(
-   if (index == -1)
+   // Input has to wait until all of the state is out.
+   while (!spectator->join && spectator->queue_used)
    {
-      close(new_fd);
-      return;
+      size_t chunk = spectator->queue_capacity - spectator->queue_head;
+      if (chunk > spectator->queue_used)
+         chunk = spectator->queue_used;
+
+      ssize_t ret = send(spectator->fd, CONST_CAST (spectator->queue + spectator->queue_head), chunk, 0);
+      if (ret < 0 && socket_would_block())
+         break;
+      if (ret <= 0)
+         return false;
+
+      spectator->queue_head = (spectator->queue_head + ret) % spectator->queue_capacity;
+      spectator->queue_used -= ret;
    }
 
-   if (!get_nickname(handle, new_fd))
+   bool want_write = spectator->join_used || (!spectator->join && spectator->queue_used);
+   if (want_write != spectator->want_write)
    {
-      RARCH_ERR("Failed to get nickname from client.\n");
-      close(new_fd);
+      spectator->want_write = want_write;
+      spectator_watch(handle, index);
+   }
+
+   return true;
+}
+
+// Puts the next piece of the join state into the join buffer, framed with its size. An empty chunk ends the state.
+static void spectator_join_chunk(struct spectator *spectator)
+{
+   struct state_stream *stream = &spectator->join_stream;
+   uint32_t chunk_size = state_stream_send_chunk(stream, spectator->join + sizeof(chunk_size), STATE_CHUNK_SIZE);
+   if (!chunk_size && !stream->done)
       return;
+
+   uint32_t size_net = htonl(chunk_size);
+   memcpy(spectator->join, &size_net, sizeof(size_net));
+   spectator->join_head = 0;
+   spectator->join_used = sizeof(size_net) + chunk_size;
+
+   if (stream->done && chunk_size)
+   {
+      size_net = 0;
+      memcpy(spectator->join + spectator->join_used, &size_net, sizeof(size_net));
+      spectator->join_used += sizeof(size_net);
+   }
+}
+
+// Reads the spectator's nickname as it trickles in. Once we have all of it,
+// our nickname and the join state are queued up.
+static bool spectator_handshake(netplay_t *handle, unsigned index)
+{
+   struct spectator *spectator = &handle->spectators[index];
+
+   while (spectator->nick_ptr == 0 || spectator->nick_ptr < 1 + (size_t)spectator->nick_size)
+   {
+      uint8_t *dst = &spectator->nick_size;
+      size_t size = 1;
+      if (spectator->nick_ptr > 0)
+      {
+         dst = (uint8_t*)spectator->nick + spectator->nick_ptr - 1;
+         size = 1 + spectator->nick_size - spectator->nick_ptr;
+      }
+
+      ssize_t ret = recv(spectator->fd, NONCONST_CAST dst, size, 0);
+      if (ret < 0 && socket_would_block())
+         return true;
+      if (ret <= 0)
+      {
+         RARCH_ERR("Failed to get nickname from client.\n");
+         return false;
+      }
+
+      spectator->nick_ptr += ret;
+      if (spectator->nick_ptr == 1 && spectator->nick_size >= sizeof(spectator->nick))
+      {
+         RARCH_ERR("Invalid nick size.\n");
+         return false;
+      }
    }
 
-   if (!send_nickname(handle, new_fd))
+   size_t state_size = pretro_serialize_size();
+   spectator->queue_capacity = SPECTATOR_QUEUE_SIZE;
+   spectator->queue = (uint8_t*)malloc(spectator->queue_capacity);
+   spectator->join = (uint8_t*)malloc(SPECTATOR_JOIN_SIZE);
+   if (!spectator->queue || !spectator->join || !state_stream_send_init(&spectator->join_stream, state_size) ||
+         (state_size && !pretro_serialize(spectator->join_stream.state, state_size)))
    {
-      RARCH_ERR("Failed to send nickname to client.\n");
-      close(new_fd);
-      return;
+      RARCH_ERR("Failed to save state for spectator.\n");
+      return false;
    }
+   state_stream_send_start(&spectator->join_stream);
+
+   uint32_t header[4];
+   uint32_t deflated = htonl(spectator->join_stream.deflated);
+   uint8_t nick_size = strlen(handle->nick);
+   bsv_header_generate(header, implementation_magic_value());
+
+   memcpy(spectator->join, &nick_size, sizeof(nick_size));
+   memcpy(spectator->join + sizeof(nick_size), handle->nick, nick_size);
+   memcpy(spectator->join + sizeof(nick_size) + nick_size, header, sizeof(header));
+   memcpy(spectator->join + sizeof(nick_size) + nick_size + sizeof(header), &deflated, sizeof(deflated));
+   spectator->join_used = sizeof(nick_size) + nick_size + sizeof(header) + sizeof(deflated);
+
+   // Lets the state go out in as few frames as the connection allows.
+   int bufsize = state_size < SPECTATOR_SNDBUF_MAX ? state_size : SPECTATOR_SNDBUF_MAX;
+   setsockopt(spectator->fd, SOL_SOCKET, SO_SNDBUF, CONST_CAST &bufsize, sizeof(int));
+
+   spectator->streaming = true;
+
+#ifndef HAVE_SOCKET_LEGACY
+   log_connection(&spectator->addr, index, spectator->nick);
+#endif
+
+   return spectator_flush(handle, index);
+}
 
-   size_t header_size;
-   uint32_t *header = bsv_header_generate(&header_size, implementation_magic_value());
-   if (!header)
+static void spectator_accept(netplay_t *handle)
+{
+   unsigned i;
+
+   for (;;)
    {
-      RARCH_ERR("Failed to generate BSV header.\n");
-      close(new_fd);
-      return;
+      struct sockaddr_storage their_addr;
+      socklen_t addr_size = sizeof(their_addr);
+      int new_fd = accept(handle->fd, (struct sockaddr*)&their_addr, &addr_size);
+      if (new_fd < 0)
+      {
+         if (!socket_would_block())
+            RARCH_ERR("Failed to accept incoming spectator.\n");
+         return;
+      }
+
+      int index = -1;
+      for (i = 0; i < MAX_SPECTATORS; i++)
+      {
+         if (handle->spectators[i].fd == -1)
+         {
+            index = i;
+            break;
+         }
+      }
+
+      // No vacant client streams :(
+      if (index == -1 || !socket_nonblock(new_fd))
+      {
+         close(new_fd);
+         continue;
+      }
+
+      struct spectator *spectator = &handle->spectators[index];
+      memset(spectator, 0, sizeof(*spectator));
+      spectator->fd = -1;
+
+#ifdef HAVE_SPECTATE_EPOLL
+      // Never 0, which is what a free slot has.
+      if (!++handle->spectate_generation)
+         handle->spectate_generation = 1;
+      spectator->generation = handle->spectate_generation;
+
+      struct epoll_event event = {0};
+      event.events = EPOLLIN;
+      event.data.u64 = spectator_epoll_data(handle, index);
+      if (epoll_ctl(handle->spectate_epoll, EPOLL_CTL_ADD, new_fd, &event) < 0)
+      {
+         close(new_fd);
+         continue;
+      }
+#endif
+
+      spectator->fd = new_fd;
+      spectator->addr = their_addr;
+      spectator->accept_frame = handle->frame_count;
    }
+}
 
-   int bufsize = header_size;
-   setsockopt(new_fd, SOL_SOCKET, SO_SNDBUF, CONST_CAST &bufsize, sizeof(int));
+static void spectator_event(netplay_t *handle, unsigned index, bool readable, bool writable)
+{
+   struct spectator *spectator = &handle->spectators[index];
+   if (spectator->fd < 0)
+      return;
 
-   if (!send_all(new_fd, header, header_size))
+   if (readable)
    {
-      RARCH_ERR("Failed to send header to client.\n");
-      close(new_fd);
-      free(header);
+      if (!spectator->streaming)
+      {
+         if (!spectator_handshake(handle, index))
+         {
+            spectator_close(handle, index, NULL);
+            return;
+         }
+      }
+      else
+      {
+         // Spectators have nothing more to say once streaming, so this is a hangup.
+         uint8_t buf[64];
+         ssize_t ret = recv(spectator->fd, NONCONST_CAST buf, sizeof(buf), 0);
+         if (ret == 0 || (ret < 0 && !socket_would_block()))
+         {
+            spectator_close(handle, index, "disconnected");
+            return;
+         }
+      }
+   }
+
+   if (writable && spectator->streaming && !spectator_flush(handle, index))
+      spectator_close(handle, index, "disconnected");
+}
+
+static void netplay_pre_frame_spectate(netplay_t *handle)
+{
+   unsigned i;
+   if (handle->spectate_client)
       return;
+
+#ifdef HAVE_SPECTATE_EPOLL
+   struct epoll_event events[MAX_SPECTATORS + 1];
+   int ret = epoll_wait(handle->spectate_epoll, events, MAX_SPECTATORS + 1, 0);
+
+   for (i = 0; ret > 0 && i < (unsigned)ret; i++)
+   {
+      uint32_t slot = (uint32_t)events[i].data.u64;
+      uint32_t generation = (uint32_t)(events[i].data.u64 >> 32);
+
+      if (slot == 0)
+         spectator_accept(handle);
+      else if (handle->spectators[slot - 1].generation == generation)
+         spectator_event(handle, slot - 1,
+               events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP),
+               events[i].events & EPOLLOUT);
+   }
+#else
+   fd_set read_fds, write_fds;
+   FD_ZERO(&read_fds);
+   FD_ZERO(&write_fds);
+   FD_SET(handle->fd, &read_fds);
+
+   int max_fd = handle->fd;
+   for (i = 0; i < MAX_SPECTATORS; i++)
+   {
+      int fd = handle->spectators[i].fd;
+      if (fd < 0)
+         continue;
+
+      FD_SET(fd, &read_fds);
+      if (handle->spectators[i].want_write)
+         FD_SET(fd, &write_fds);
+      if (fd > max_fd)
+         max_fd = fd;
    }
 
-   free(header);
-   handle->spectate_fds[index] = new_fd;
+   struct timeval tmp_tv = {0};
+   if (select(max_fd + 1, &read_fds, &write_fds, NULL, &tmp_tv) > 0)
+   {
+      for (i = 0; i < MAX_SPECTATORS; i++)
+      {
+         int fd = handle->spectators[i].fd;
+         if (fd >= 0)
+            spectator_event(handle, i, FD_ISSET(fd, &read_fds), FD_ISSET(fd, &write_fds));
+      }
 
-#ifndef HAVE_SOCKET_LEGACY
-   log_connection(&their_addr, index, handle->other_nick);
+      if (FD_ISSET(handle->fd, &read_fds))
+         spectator_accept(handle);
+   }
 #endif
+
+   // Nobody gets to sit on a slot without finishing the handshake.
+   for (i = 0; i < MAX_SPECTATORS; i++)
+   {
+      const struct spectator *spectator = &handle->spectators[i];
+      if (spectator->fd >= 0 && !spectator->streaming &&
+            handle->frame_count - spectator->accept_frame > SPECTATOR_HANDSHAKE_FRAMES)
+         spectator_close(handle, i, "timed out");
+   }
 }
 
 void netplay_pre_frame(netplay_t *handle)
@@ -1374,13 +3006,95 @@ void netplay_pre_frame(netplay_t *handle)
       netplay_pre_frame_net(handle);
 }
 
-static void netplay_post_frame_net(netplay_t *handle)
+// Hashes become final once all input before their frame is known. The client sends those over, the host compares them.
+static void netplay_check_sync(netplay_t *handle)
 {
-   handle->frame_count++;
+   unsigned i;
+   for (i = 0; i < CRC_BUFFER_SIZE; i++)
+   {
+      struct netplay_crc *crc = &handle->crcs[i];
+      if (!crc->has_local || crc->done || (int32_t)(crc->frame - handle->other_frame_count) > 0)
+         continue;
+
+      if (handle->port == 0)
+      {
+         uint32_t data[3] = { htonl(crc->frame), htonl(crc->local), htonl(handle->sync_generation) };
+         if (!netplay_send_cmd(handle, NETPLAY_CMD_CRC, data, sizeof(data)))
+            RARCH_WARN("Failed to send netplay state hash.\n");
+         crc->done = true;
+      }
+      else if (crc->has_remote)
+      {
+         crc->done = true;
+         if (crc->local != crc->remote)
+         {
+            RARCH_WARN("Netplay desync detected on frame %u.\n", crc->frame);
+            msg_queue_push(g_extern.msg_queue, "Netplay desync detected, resyncing.", 1, 180);
+            handle->stats.desyncs++;
+            handle->resync_needed = true;
+         }
+      }
+   }
+}
+
+// Loads the state the host sent and runs it up to our current frame with the inputs we remember.
+// Waits until we have the host's input up to the state's frame, so there's nothing before it left to roll back.
+static void netplay_load_resync(netplay_t *handle)
+{
+   unsigned i;
+   uint32_t frame = handle->resync_frame;
+   if ((int32_t)(frame - handle->other_frame_count) > 0)
+      return;
+
+   handle->resync_pending = false;
+   handle->sync_generation = handle->resync_generation;
 
-   // Nothing to do...
-   if (handle->other_frame_count == handle->read_frame_count)
+   if (handle->frame_count - frame >= handle->inputs_size)
+   {
+      RARCH_WARN("Netplay state of frame %u from host is too old to catch up from.\n", frame);
       return;
+   }
+
+   pretro_unserialize(handle->resync_state, handle->state_size);
+   for (i = 0; i < handle->states_size; i++)
+      handle->states[i].stored = false;
+   handle->has_state = false;
+
+   // Hashes from before the state have nothing more to say, the ones after it are sent again.
+   for (i = 0; i < CRC_BUFFER_SIZE; i++)
+      handle->crcs[i].done = (int32_t)(handle->crcs[i].frame - frame) < 0;
+
+   handle->is_replay = true;
+   handle->is_catchup = true;
+   for (handle->tmp_frame_count = frame; handle->tmp_frame_count != handle->frame_count; handle->tmp_frame_count++)
+   {
+      uint32_t tmp = handle->tmp_frame_count;
+      if (tmp == frame || tmp % handle->checkpoint_interval == 0 || netplay_is_check_frame(handle, tmp) ||
+            tmp + 1 == handle->frame_count)
+         netplay_store_state(handle, tmp);
+
+#if defined(HAVE_THREADS) && !defined(RARCH_CONSOLE)
+      lock_autosave();
+#endif
+      pretro_run();
+#if defined(HAVE_THREADS) && !defined(RARCH_CONSOLE)
+      unlock_autosave();
+#endif
+      handle->stats.replayed_frames++;
+   }
+   handle->is_catchup = false;
+   handle->is_replay = false;
+
+   handle->stats.resyncs++;
+   RARCH_LOG("Netplay resynced from host's state of frame %u.\n", frame);
+   msg_queue_push(g_extern.msg_queue, "Netplay resynced.", 1, 180);
+}
+
+static void netplay_post_frame_net(netplay_t *handle)
+{
+   netplay_record_input(handle, handle->frame_count, PREV_PTR(handle->self_ptr));
+   handle->frame_count++;
+   handle->stats.frames++;
 
    // Skip ahead if we predicted correctly. Skip until our simulation failed.
    while (handle->other_frame_count < handle->read_frame_count)
@@ -1392,18 +3106,62 @@ static void netplay_post_frame_net(netplay_t *handle)
       handle->other_frame_count++;
    }
 
-   if (handle->other_frame_count < handle->read_frame_count)
+   // The host's state to resync with has to have all input before it known. Getting there takes a replay as well,
+   // unless that's where we are anyway. One state goes out at a time.
+   bool send_state = handle->resync_needed && !handle->resync_streaming;
+   bool resync = send_state && handle->other_frame_count != handle->frame_count;
+   if (send_state && !resync)
+      netplay_send_state(handle, handle->frame_count);
+
+   // Without a connection, there is no one to stay in sync with, and the state history may be gone.
+   if (handle->has_connection && (handle->other_frame_count < handle->read_frame_count || resync))
    {
       // Replay frames
       handle->is_replay = true;
+      if (handle->other_frame_count < handle->read_frame_count)
+         handle->stats.rollbacks++;
       handle->tmp_ptr = handle->other_ptr;
-      handle->tmp_frame_count = handle->other_frame_count;
+      handle->tmp_frame_count = netplay_load_state(handle, handle->other_frame_count);
+
+      // The frames up to other_frame_count were run with the right inputs already, just not stored.
+      handle->is_catchup = true;
+      for (; handle->tmp_frame_count != handle->other_frame_count; handle->tmp_frame_count++)
+      {
+#if defined(HAVE_THREADS) && !defined(RARCH_CONSOLE)
+         lock_autosave();
+#endif
+         pretro_run();
+#if defined(HAVE_THREADS) && !defined(RARCH_CONSOLE)
+         unlock_autosave();
+#endif
+         handle->stats.replayed_frames++;
+      }
+      handle->is_catchup = false;
+
+      if (resync)
+         netplay_send_state(handle, handle->tmp_frame_count);
 
-      pretro_unserialize(handle->buffer[handle->other_ptr].state, handle->state_size);
       bool first = true;
       while (first || (handle->tmp_ptr != handle->self_ptr))
       {
-         pretro_serialize(handle->buffer[handle->tmp_ptr].state, handle->state_size);
+         // Everything from here on could be rolled back again later. A checkpoint every few frames will do for that,
+         // but the newest frame has to be stored for the next regular frame to chain onto.
+         if (handle->tmp_frame_count != handle->last_frame)
+         {
+            if (handle->tmp_frame_count % handle->checkpoint_interval == 0 || NEXT_PTR(handle->tmp_ptr) == handle->self_ptr ||
+                  netplay_is_check_frame(handle, handle->tmp_frame_count))
+               netplay_store_state(handle, handle->tmp_frame_count);
+            else
+               handle->states[handle->tmp_frame_count % handle->states_size].stored = false;
+         }
+
+         // Frames still without real input get a fresh guess now that we know more.
+         struct delta_frame *ptr = &handle->buffer[handle->tmp_ptr];
+         if (ptr->is_simulated)
+            ptr->simulated_input_state = predictor_guess(&handle->predictor,
+                  handle->tmp_frame_count - (handle->read_frame_count - 1));
+
+         netplay_record_input(handle, handle->tmp_frame_count, handle->tmp_ptr);
 #if defined(HAVE_THREADS) && !defined(RARCH_CONSOLE)
          lock_autosave();
 #endif
@@ -1413,6 +3171,7 @@ static void netplay_post_frame_net(netplay_t *handle)
 #endif
          handle->tmp_ptr = NEXT_PTR(handle->tmp_ptr);
          handle->tmp_frame_count++;
+         handle->stats.replayed_frames++;
          first = false;
       }
 
@@ -1420,6 +3179,24 @@ static void netplay_post_frame_net(netplay_t *handle)
       handle->other_frame_count = handle->read_frame_count;
       handle->is_replay = false;
    }
+
+   if (handle->resync_streaming && handle->port != 0)
+      netplay_send_state_chunk(handle);
+   if (handle->resync_pending)
+      netplay_load_resync(handle);
+   if (handle->check_frames)
+      netplay_check_sync(handle);
+}
+
+void netplay_get_stats(netplay_t *handle, struct netplay_stats *stats)
+{
+   *stats = handle->stats;
+   stats->input_delay = handle->input_delay;
+   stats->rtt_frames = handle->rtt_frames;
+
+   retro_time_t elapsed = rarch_get_time_usec() - handle->start_time;
+   if (elapsed > 0 && !handle->spectate)
+      stats->rollbacks_per_minute = handle->stats.rollbacks * 60000000.0 / elapsed;
 }
 
 static void netplay_post_frame_spectate(netplay_t *handle)
@@ -1430,25 +3207,31 @@ static void netplay_post_frame_spectate(netplay_t *handle)
 
    for (i = 0; i < MAX_SPECTATORS; i++)
    {
-      if (handle->spectate_fds[i] == -1)
+      struct spectator *spectator = &handle->spectators[i];
+      if (spectator->fd < 0 || !spectator->streaming)
          continue;
 
-      if (!send_all(handle->spectate_fds[i],
-               handle->spectate_input, handle->spectate_input_ptr * sizeof(int16_t)))
+      if (spectator->join && !spectator->join_used)
       {
-         RARCH_LOG("Client (#%u) disconnected ...\n", i);
-
-         char msg[512];
-         snprintf(msg, sizeof(msg), "Client (#%u) disconnected.", i);
-         msg_queue_push(g_extern.msg_queue, msg, 1, 180);
-
-         close(handle->spectate_fds[i]);
-         handle->spectate_fds[i] = -1;
-         break;
+         if (spectator->join_stream.done)
+         {
+            free(spectator->join);
+            spectator->join = NULL;
+            state_stream_free(&spectator->join_stream);
+         }
+         else
+            spectator_join_chunk(spectator);
       }
+
+      // Dropping input would desync the spectator for good, so one which can't keep up is let go instead.
+      if (!spectator_queue(spectator, handle->spectate_input, handle->spectate_input_ptr * sizeof(int16_t)))
+         spectator_close(handle, i, "fell too far behind and was kicked");
+      else if (!spectator_flush(handle, i))
+         spectator_close(handle, i, "disconnected");
    }
 
    handle->spectate_input_ptr = 0;
+   handle->frame_count++;
 }
 
 // Here we check if we have new input and replay from recorded input.
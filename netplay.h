@@ -53,6 +53,25 @@ void netplay_free(netplay_t *handle);
 // On regular netplay, flip who controls player 1 and 2.
 void netplay_flip_players(netplay_t *handle);
 
+struct netplay_stats
+{
+   uint64_t frames;
+   uint64_t rollbacks;
+   uint64_t replayed_frames; // Frames run again on rollbacks.
+   uint64_t predicted_frames; // Frames run before the other side's input for them got in.
+   uint64_t mispredicted_frames;
+   float rollbacks_per_minute;
+   unsigned input_delay;
+   float rtt_frames;
+   uint64_t hashed_states; // Save states hashed for desync checks.
+   uint64_t hash_usec;
+   uint64_t desyncs;
+   uint64_t resyncs; // States sent to or loaded from the host to resync.
+};
+
+// Counters for how much rollback work netplay has done so far.
+void netplay_get_stats(netplay_t *handle, struct netplay_stats *stats);
+
 // Call this before running retro_run()
 void netplay_pre_frame(netplay_t *handle);
 // Call this after running retro_run()
@@ -190,8 +190,31 @@ void rarch_take_screenshot(void)
 }
 #endif
 
-static void readjust_audio_input_rate(void)
+// Audio may be processed on its own thread, where registering a counter on first use would race the main thread.
+// Underruns and overruns are counted as runs of a perf counter, so they show up with perfcnt_enable.
+static struct retro_perf_counter audio_underrun = {"audio_underrun"};
+static struct retro_perf_counter audio_overrun = {"audio_overrun"};
+static struct retro_perf_counter audio_convert_s16 = {"audio_convert_s16"};
+static struct retro_perf_counter audio_dsp = {"audio_dsp"};
+static struct retro_perf_counter resampler_proc = {"resampler_proc"};
+static struct retro_perf_counter audio_convert_float = {"audio_convert_float"};
+
+// Registers the audio counters. Called from init_audio(), before there is an audio thread.
+void rarch_init_audio_perf(void)
+{
+   rarch_perf_register(&audio_underrun);
+   rarch_perf_register(&audio_overrun);
+   rarch_perf_register(&audio_convert_s16);
+   rarch_perf_register(&audio_dsp);
+   rarch_perf_register(&resampler_proc);
+   rarch_perf_register(&audio_convert_float);
+}
+
+// 'frames' is the amount of input about to be resampled and written.
+static void readjust_audio_input_rate(size_t frames)
 {
+   rarch_rate_control_t *rc = &g_extern.audio_data.rate_controller;
+
    int avail = audio_write_avail_func();
    //RARCH_LOG_OUTPUT("Audio buffer is %u%% full\n",
    //      (unsigned)(100 - (avail * 100) / g_extern.audio_data.driver_buffer_size));
@@ -199,11 +222,25 @@ static void readjust_audio_input_rate(void)
    unsigned write_index = g_extern.measure_data.buffer_free_samples_count++ & (AUDIO_BUFFER_FREE_SAMPLES_COUNT - 1);
    g_extern.measure_data.buffer_free_samples[write_index] = avail;
 
-   int half_size = g_extern.audio_data.driver_buffer_size / 2;
-   int delta_mid = avail - half_size;
-   double direction = (double)delta_mid / half_size;
+   size_t frame_size = g_extern.audio_data.use_float ? 2 * sizeof(float) : 2 * sizeof(int16_t);
+   size_t write_size = (size_t)(frames * g_extern.audio_data.src_ratio) * frame_size;
+
+   unsigned underruns = rc->underruns;
+   unsigned overruns  = rc->overruns;
+
+   double adjust = rarch_rate_control_update(rc, avail, g_extern.audio_data.driver_buffer_size,
+         write_size, (double)frames / g_settings.audio.in_rate);
 
-   double adjust = 1.0 + g_settings.audio.rate_control_delta * direction;
+   if (rc->underruns != underruns)
+   {
+      RARCH_PERFORMANCE_START(audio_underrun);
+      RARCH_PERFORMANCE_STOP(audio_underrun);
+   }
+   if (rc->overruns != overruns)
+   {
+      RARCH_PERFORMANCE_START(audio_overrun);
+      RARCH_PERFORMANCE_STOP(audio_overrun);
+   }
 
    g_extern.audio_data.src_ratio = g_extern.audio_data.orig_src_ratio * adjust;
 
@@ -359,93 +396,137 @@ void rarch_render_cached_frame(void)
 #endif
 }
 
-static bool audio_flush(const int16_t *data, size_t samples)
+// Converts, filters and resamples a batch of samples and writes it to the driver.
+// Runs on the audio processing thread if there is one.
+bool rarch_audio_process(const int16_t *data, size_t samples)
 {
-#ifdef HAVE_RECORD
-   if (g_extern.rec)
-   {
-      struct ffemu_audio_data ffemu_data = {0};
-      ffemu_data.data                    = data;
-      ffemu_data.frames                  = samples / 2;
+   if (g_extern.audio_data.rate_control)
+      readjust_audio_input_rate(samples >> 1);
 
-      g_extern.rec_driver->push_audio(g_extern.rec, &ffemu_data);
-   }
-#endif
+   struct resampler_data src_data = {0};
+   src_data.ratio = g_extern.audio_data.src_ratio;
+   if (g_extern.is_slowmotion)
+      src_data.ratio *= g_settings.slowmotion_ratio;
 
-   if (g_extern.is_paused || g_extern.audio_data.mute)
-      return true;
-   if (!g_extern.audio_active)
-      return false;
+   float *block              = g_extern.audio_data.data;
+   float *outsamples         = g_extern.audio_data.outsamples;
+   int16_t *conv_outsamples  = g_extern.audio_data.conv_outsamples;
+   float volume_gain         = g_extern.audio_data.volume_gain;
+   size_t output_samples     = 0;
+   size_t frames             = samples >> 1;
 
-   const float *output_data = NULL;
-   unsigned output_frames      = 0;
+   if (!g_extern.audio_data.dsp && g_extern.audio_data.use_float)
+   {
+      // Common case: nothing between conversion and the resampler, and the driver takes floats as-is.
+      while (frames)
+      {
+         size_t block_frames = frames < AUDIO_FLUSH_BLOCK_FRAMES ? frames : AUDIO_FLUSH_BLOCK_FRAMES;
 
-   struct resampler_data src_data = {0};
-   RARCH_PERFORMANCE_INIT(audio_convert_s16);
-   RARCH_PERFORMANCE_START(audio_convert_s16);
-   audio_convert_s16_to_float(g_extern.audio_data.data, data, samples,
-         g_extern.audio_data.volume_gain);
-   RARCH_PERFORMANCE_STOP(audio_convert_s16);
+         RARCH_PERFORMANCE_START(audio_convert_s16);
+         audio_convert_s16_to_float(block, data, block_frames << 1, volume_gain);
+         RARCH_PERFORMANCE_STOP(audio_convert_s16);
 
-   struct rarch_dsp_data dsp_data = {0};
-   dsp_data.input                 = g_extern.audio_data.data;
-   dsp_data.input_frames          = samples >> 1;
+         src_data.data_in      = block;
+         src_data.input_frames = block_frames;
+         src_data.data_out     = outsamples + output_samples;
 
-   if (g_extern.audio_data.dsp)
-   {
-      RARCH_PERFORMANCE_INIT(audio_dsp);
-      RARCH_PERFORMANCE_START(audio_dsp);
-      rarch_dsp_filter_process(g_extern.audio_data.dsp, &dsp_data);
-      RARCH_PERFORMANCE_STOP(audio_dsp);
+         RARCH_PERFORMANCE_START(resampler_proc);
+         rarch_resampler_process(g_extern.audio_data.resampler,
+               g_extern.audio_data.resampler_data, &src_data);
+         RARCH_PERFORMANCE_STOP(resampler_proc);
+
+         output_samples += src_data.output_frames << 1;
+         data           += block_frames << 1;
+         frames         -= block_frames;
+      }
    }
+   else
+   {
+      while (frames)
+      {
+         size_t block_frames = frames < AUDIO_FLUSH_BLOCK_FRAMES ? frames : AUDIO_FLUSH_BLOCK_FRAMES;
 
-   src_data.data_in      = dsp_data.output ? dsp_data.output : g_extern.audio_data.data;
-   src_data.input_frames = dsp_data.output ? dsp_data.output_frames : (samples >> 1);
+         RARCH_PERFORMANCE_START(audio_convert_s16);
+         audio_convert_s16_to_float(block, data, block_frames << 1, volume_gain);
+         RARCH_PERFORMANCE_STOP(audio_convert_s16);
 
-   src_data.data_out = g_extern.audio_data.outsamples;
+         struct rarch_dsp_data dsp_data = {0};
+         dsp_data.input                 = block;
+         dsp_data.input_frames          = block_frames;
 
-   if (g_extern.audio_data.rate_control)
-      readjust_audio_input_rate();
+         if (g_extern.audio_data.dsp)
+         {
+            RARCH_PERFORMANCE_START(audio_dsp);
+            rarch_dsp_filter_process(g_extern.audio_data.dsp, &dsp_data);
+            RARCH_PERFORMANCE_STOP(audio_dsp);
+         }
 
-   src_data.ratio = g_extern.audio_data.src_ratio;
-   if (g_extern.is_slowmotion)
-      src_data.ratio *= g_settings.slowmotion_ratio;
+         src_data.data_in      = dsp_data.output ? dsp_data.output : block;
+         src_data.input_frames = dsp_data.output ? dsp_data.output_frames : block_frames;
+         src_data.data_out     = outsamples + output_samples;
 
-   RARCH_PERFORMANCE_INIT(resampler_proc);
-   RARCH_PERFORMANCE_START(resampler_proc);
-   rarch_resampler_process(g_extern.audio_data.resampler,
-         g_extern.audio_data.resampler_data, &src_data);
-   RARCH_PERFORMANCE_STOP(resampler_proc);
+         RARCH_PERFORMANCE_START(resampler_proc);
+         rarch_resampler_process(g_extern.audio_data.resampler,
+               g_extern.audio_data.resampler_data, &src_data);
+         RARCH_PERFORMANCE_STOP(resampler_proc);
 
-   output_data   = g_extern.audio_data.outsamples;
-   output_frames = src_data.output_frames;
+         if (!g_extern.audio_data.use_float)
+         {
+            RARCH_PERFORMANCE_START(audio_convert_float);
+            audio_convert_float_to_s16(conv_outsamples + output_samples,
+                  outsamples + output_samples, src_data.output_frames << 1);
+            RARCH_PERFORMANCE_STOP(audio_convert_float);
+         }
 
-   if (g_extern.audio_data.use_float)
-   {
-      if (audio_write_func(output_data, output_frames * sizeof(float) * 2) < 0)
-      {
-         RARCH_ERR("Audio backend failed to write. Will continue without sound.\n");
-         return false;
+         output_samples += src_data.output_frames << 1;
+         data           += block_frames << 1;
+         frames         -= block_frames;
       }
    }
-   else
+
+   const void *output_data = outsamples;
+   size_t output_size      = output_samples * sizeof(float);
+   if (!g_extern.audio_data.use_float)
    {
-      RARCH_PERFORMANCE_INIT(audio_convert_float);
-      RARCH_PERFORMANCE_START(audio_convert_float);
-      audio_convert_float_to_s16(g_extern.audio_data.conv_outsamples,
-            output_data, output_frames * 2);
-      RARCH_PERFORMANCE_STOP(audio_convert_float);
+      output_data = conv_outsamples;
+      output_size = output_samples * sizeof(int16_t);
+   }
 
-      if (audio_write_func(g_extern.audio_data.conv_outsamples, output_frames * sizeof(int16_t) * 2) < 0)
-      {
-         RARCH_ERR("Audio backend failed to write. Will continue without sound.\n");
-         return false;
-      }
+   if (audio_write_func(output_data, output_size) < 0)
+   {
+      RARCH_ERR("Audio backend failed to write. Will continue without sound.\n");
+      return false;
    }
 
    return true;
 }
 
+static bool audio_flush(const int16_t *data, size_t samples)
+{
+#ifdef HAVE_RECORD
+   if (g_extern.rec)
+   {
+      struct ffemu_audio_data ffemu_data = {0};
+      ffemu_data.data                    = data;
+      ffemu_data.frames                  = samples / 2;
+
+      g_extern.rec_driver->push_audio(g_extern.rec, &ffemu_data);
+   }
+#endif
+
+   if (g_extern.is_paused || g_extern.audio_data.mute)
+      return true;
+   if (!g_extern.audio_active)
+      return false;
+
+#ifdef HAVE_THREADS
+   if (g_extern.audio_data.pipeline)
+      return rarch_audio_pipeline_push(g_extern.audio_data.pipeline, data, samples);
+#endif
+
+   return rarch_audio_process(data, samples);
+}
+
 static void audio_sample_rewind(int16_t left, int16_t right)
 {
    g_extern.audio_data.rewind_buf[--g_extern.audio_data.rewind_ptr] = right;
@@ -465,13 +546,13 @@ size_t audio_sample_batch_rewind(const int16_t *data, size_t frames)
 
 static void audio_sample(int16_t left, int16_t right)
 {
-   g_extern.audio_data.conv_outsamples[g_extern.audio_data.data_ptr++] = left;
-   g_extern.audio_data.conv_outsamples[g_extern.audio_data.data_ptr++] = right;
+   g_extern.audio_data.sample_buf[g_extern.audio_data.data_ptr++] = left;
+   g_extern.audio_data.sample_buf[g_extern.audio_data.data_ptr++] = right;
 
    if (g_extern.audio_data.data_ptr < g_extern.audio_data.chunk_size)
       return;
 
-   g_extern.audio_active = audio_flush(g_extern.audio_data.conv_outsamples,
+   g_extern.audio_active = audio_flush(g_extern.audio_data.sample_buf,
          g_extern.audio_data.data_ptr) && g_extern.audio_active;
 
    g_extern.audio_data.data_ptr = 0;
@@ -1508,8 +1589,27 @@ void rarch_init_rewind(void)
       return;
    }
 
+   struct state_manager_info info = {0};
+   info.state_size = g_extern.state_size;
+   info.buffer_size = g_settings.rewind_buffer_size;
+   info.threaded = g_settings.rewind_threaded;
+   info.level = g_settings.rewind_compression;
+   info.keyframe_interval = g_settings.rewind_keyframe_interval;
+
+   char history_path[PATH_MAX];
+   if (g_settings.rewind_history_persist)
+   {
+      fill_pathname(history_path, g_extern.savestate_name, ".rewind", sizeof(history_path));
+      info.path = history_path;
+      info.content_id = g_extern.sha256;
+      RARCH_LOG("Using rewind history file: \"%s\".\n", history_path);
+   }
+
+   memset(&g_extern.rewind_granularity, 0, sizeof(g_extern.rewind_granularity));
+   g_extern.rewind_granularity.interval = g_settings.rewind_granularity ? g_settings.rewind_granularity : 1;
+
    RARCH_LOG("Initing rewind buffer with size: %u MB\n", (unsigned)(g_settings.rewind_buffer_size / 1000000));
-   g_extern.state_manager = state_manager_new(g_extern.state_size, g_settings.rewind_buffer_size);
+   g_extern.state_manager = state_manager_new(&info);
 
    if (!g_extern.state_manager)
       RARCH_WARN("Failed to initialize rewind buffer. Rewinding will be disabled.\n");
@@ -1543,6 +1643,7 @@ static void init_movie(void)
       msg_queue_push(g_extern.msg_queue, "Starting movie playback.", 2, 180);
       RARCH_LOG("Starting movie playback.\n");
       g_settings.rewind_granularity = 1;
+      g_settings.rewind_granularity_auto = false;
    }
    else if (g_extern.bsv.movie_start_recording)
    {
@@ -1559,6 +1660,7 @@ static void init_movie(void)
       {
          RARCH_LOG("Starting movie record to \"%s\".\n", g_extern.bsv.movie_start_path);
          g_settings.rewind_granularity = 1;
+         g_settings.rewind_granularity_auto = false;
       }
       else
          RARCH_ERR("Failed to start movie record.\n");
@@ -1624,7 +1726,23 @@ static void init_netplay(void)
 static void deinit_netplay(void)
 {
    if (g_extern.netplay)
+   {
+      if (!g_extern.netplay_is_spectate)
+      {
+         struct netplay_stats stats;
+         netplay_get_stats(g_extern.netplay, &stats);
+         RARCH_LOG("Netplay: %llu frames, %llu rollbacks (%.1f per minute), %llu frames replayed, %llu of %llu predicted frames mispredicted.\n",
+               (unsigned long long)stats.frames, (unsigned long long)stats.rollbacks, stats.rollbacks_per_minute,
+               (unsigned long long)stats.replayed_frames,
+               (unsigned long long)stats.mispredicted_frames, (unsigned long long)stats.predicted_frames);
+         if (stats.hashed_states)
+            RARCH_LOG("Netplay: %llu desyncs, %llu resyncs, %.1f usec per state hash.\n",
+                  (unsigned long long)stats.desyncs, (unsigned long long)stats.resyncs,
+                  (double)stats.hash_usec / stats.hashed_states);
+      }
+
       netplay_free(g_extern.netplay);
+   }
 }
 #endif
 
@@ -2089,15 +2207,60 @@ static inline void setup_rewind_audio(void)
    for (i = 0; i < g_extern.audio_data.data_ptr; i += 2)
    {
       g_extern.audio_data.rewind_buf[--g_extern.audio_data.rewind_ptr] =
-         g_extern.audio_data.conv_outsamples[i + 1];
+         g_extern.audio_data.sample_buf[i + 1];
 
       g_extern.audio_data.rewind_buf[--g_extern.audio_data.rewind_ptr] =
-         g_extern.audio_data.conv_outsamples[i + 0];
+         g_extern.audio_data.sample_buf[i + 0];
    }
 
    g_extern.audio_data.data_ptr = 0;
 }
 
+// Auto granularity keeps the average cost of snapshots below this share of the frame budget.
+#define REWIND_AUTO_BUDGET 0.25f
+#define REWIND_AUTO_MAX_INTERVAL 60
+
+// Re-evaluated about once per second of forward play, from the snapshot cost alone: serializing (rewind_serialize)
+// and pushing (gen_deltas, or waiting for the rewind thread). Those counters only run with perfcnt_enable, so the
+// same sections are timed separately. The interval jumps straight up to what the cost needs and steps back down one at a time.
+static void update_rewind_granularity(void)
+{
+   float fps = g_extern.system.av_info.timing.fps;
+   if (fps <= 0.0f || ++g_extern.rewind_granularity.frames < fps || !g_extern.rewind_granularity.pushes)
+      return;
+
+   float budget = 1000000.0f / fps;
+   float push_time = (float)g_extern.rewind_granularity.push_time / g_extern.rewind_granularity.pushes;
+
+   unsigned min_interval = (unsigned)ceilf(push_time / (budget * REWIND_AUTO_BUDGET));
+   if (min_interval > REWIND_AUTO_MAX_INTERVAL)
+      min_interval = REWIND_AUTO_MAX_INTERVAL;
+   if (min_interval < g_settings.rewind_granularity)
+      min_interval = g_settings.rewind_granularity;
+   if (min_interval < 1)
+      min_interval = 1;
+
+   unsigned interval = g_extern.rewind_granularity.interval;
+   if (interval < min_interval)
+      interval = min_interval;
+   else if (interval > min_interval)
+      interval--;
+
+   if (interval != g_extern.rewind_granularity.interval)
+   {
+      char msg[64];
+      RARCH_LOG("Rewind granularity: %u (snapshot %.2f ms, budget %.2f ms).\n",
+            interval, push_time / 1000.0f, budget / 1000.0f);
+      snprintf(msg, sizeof(msg), "Rewind granularity: %u.", interval);
+      msg_queue_push(g_extern.msg_queue, msg, 1, 60);
+      g_extern.rewind_granularity.interval = interval;
+   }
+
+   g_extern.rewind_granularity.frames = 0;
+   g_extern.rewind_granularity.push_time = 0;
+   g_extern.rewind_granularity.pushes = 0;
+}
+
 static void check_rewind(void)
 {
    flush_rewind_audio();
@@ -2133,10 +2296,29 @@ static void check_rewind(void)
       else
          msg_queue_push(g_extern.msg_queue, "Reached end of rewind buffer.", 0, 30);
    }
+#ifdef HAVE_BSV_MOVIE
+   // Movies can only be rewound, not replayed.
+   else if (input_key_pressed_func(RARCH_REWIND_REDO) && !g_extern.bsv.movie)
+#else
+   else if (input_key_pressed_func(RARCH_REWIND_REDO))
+#endif
+   {
+      msg_queue_clear(g_extern.msg_queue);
+      const void *buf;
+      if (state_manager_redo(g_extern.state_manager, &buf))
+      {
+         msg_queue_push(g_extern.msg_queue, "Undoing rewind.", 0, g_extern.is_paused ? 1 : 30);
+         pretro_unserialize(buf, g_extern.state_size);
+      }
+      else
+         msg_queue_push(g_extern.msg_queue, "Reached end of redo buffer.", 0, 30);
+   }
    else
    {
       static unsigned cnt = 0;
-      cnt = (cnt + 1) % (g_settings.rewind_granularity ? g_settings.rewind_granularity : 1); // Avoid possible SIGFPE.
+      unsigned granularity = g_settings.rewind_granularity_auto ?
+         g_extern.rewind_granularity.interval : g_settings.rewind_granularity;
+      cnt = (cnt + 1) % (granularity ? granularity : 1); // Avoid possible SIGFPE.
 #ifdef HAVE_BSV_MOVIE
       if (cnt == 0 || g_extern.bsv.movie)
 #else
@@ -2146,13 +2328,19 @@ static void check_rewind(void)
          void *state;
          state_manager_push_where(g_extern.state_manager, &state);
 
+         retro_time_t start = rarch_get_time_usec();
          RARCH_PERFORMANCE_INIT(rewind_serialize);
          RARCH_PERFORMANCE_START(rewind_serialize);
          pretro_serialize(state, g_extern.state_size);
          RARCH_PERFORMANCE_STOP(rewind_serialize);
 
          state_manager_push_do(g_extern.state_manager);
+         g_extern.rewind_granularity.push_time += rarch_get_time_usec() - start;
+         g_extern.rewind_granularity.pushes++;
       }
+
+      if (g_settings.rewind_granularity_auto)
+         update_rewind_granularity();
    }
 
    pretro_set_audio_sample(g_extern.frame_is_reverse ?
@@ -2185,6 +2373,7 @@ static void movie_record_toggle(void)
    else
    {
       g_settings.rewind_granularity = 1;
+      g_settings.rewind_granularity_auto = false;
 
       char path[PATH_MAX];
       if (g_extern.state_slot > 0)
@@ -21,6 +21,22 @@
 #include <stdint.h>
 #include <string.h>
 
+#ifdef HAVE_THREADS
+#include "thread.h"
+#endif
+
+#ifdef HAVE_ZLIB_DEFLATE
+#include <zlib.h>
+#endif
+
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#endif
+
 #ifndef UINT16_MAX
 #define UINT16_MAX 0xffff
 #endif
@@ -38,13 +54,23 @@
 #define NO_UNALIGNED_MEM
 #endif
 
+// AVX2 scanners are built with a target attribute and only picked if the CPU has it, see rewind_init_simd().
+#if defined(CPU_X86) && (defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define REWIND_HAVE_AVX2
+#include <immintrin.h>
+#endif
+
+// Blocks are over-allocated by this much so the SIMD scanners can read past the end marker.
+#define BLOCK_PADDING (sizeof(uint16_t) * 4 + 32)
+
 // Format per frame:
 // size nextstart;
+// uint16 flags; // FRAME_KEYFRAME if a second repeat block follows, see below.
 // repeat {
 //   uint16 numchanged; // everything is counted in units of uint16
 //   if (numchanged) {
 //     uint16 numunchanged; // skip these before handling numchanged
-//     uint16[numchanged] changeddata;
+//     uint16[numchanged] changeddata; // this frame XOR the next frame
 //   }
 //   else
 //   {
@@ -62,6 +88,51 @@
 // Wrapping is handled by returning to the start of the buffer if the compressed data could potentially hit the edge;
 // if the compressed data could potentially overwrite the tail pointer, the tail retreats until it can no longer collide.
 // This means that on average, ~2 * maxcompsize is unused at any given moment.
+//
+// Since the delta is an XOR, the same frame turns the next frame into this one, and this one into the next.
+// Popping walks backwards through it, state_manager_redo() walks forwards again over frames that were popped but not yet overwritten.
+//
+// If a compression level is set, the repeat block above is additionally deflated and each frame looks like this instead:
+// size nextstart;
+// uint16 flags;
+// uint32 deltasize; // size of the repeat block before deflating
+// uint32 zsize;
+// uint8[zsize] zdata;
+// size thisstart;
+// The uint32s are stored native endian. There is no alignment padding, the delta is always inflated to a separate buffer.
+
+// Keyframes hold a complete state, so state_manager_seek() can start decoding from there instead of from the head.
+// They have a second repeat block after the regular one, relative to an all-zero state; pop and redo just skip it.
+// That costs roughly as much as a full (zero-skipping) state, so they're only written every keyframe_interval frames.
+#define FRAME_KEYFRAME 1
+
+// With a history file, the ring is memory mapped from it, after a header and a copy of thisblock:
+// struct state_manager_file_header;
+// uint8[blocksize] thisblock; // padded to FILE_ALIGN
+// uint8[capacity] data;
+// The header is only written back on state_manager_free(), so 'clean' tells us whether the ring is consistent.
+// Everything is native endian; the file is not meant to be moved between machines.
+#define FILE_MAGIC "RARCHRWD"
+#define FILE_VERSION 2
+#define FILE_ALIGN 64
+
+struct state_manager_file_header
+{
+   char magic[8];
+   uint32_t version;
+   uint32_t clean;
+   uint64_t blocksize;
+   uint64_t capacity;
+   uint32_t deflated;
+   uint32_t thisblock_valid;
+   uint64_t head;
+   uint64_t tail;
+   uint32_t head_seq;
+   uint32_t entries;
+   uint32_t keyframe_interval;
+   uint32_t padding;
+   char content_id[72];
+};
 
 // These are called very few constant times per frame, keep it as simple as possible.
 static inline void write_size_t(void *ptr, size_t val)
@@ -75,54 +146,351 @@ static inline size_t read_size_t(const void *ptr)
    return ret;
 }
 
+// States are rounded up to whole uint16s.
+static inline size_t state_manager_block_size(size_t state_size)
+{
+   return ((state_size - 1) | (sizeof(uint16_t) - 1)) + 1;
+}
+
 struct state_manager
 {
    uint8_t *data;
    size_t capacity;
    uint8_t *head; // Reading and writing is done here.
    uint8_t *tail; // If head comes close to this, discard a frame.
+   uint8_t *redo_end; // Frames between head and this were popped, but can still be redone.
 
    uint8_t *thisblock;
    uint8_t *nextblock;
 
    size_t blocksize; // This one is runded up from reset::blocksize.
    size_t maxcompsize; // size_t + (blocksize + 131071) / 131072 * (blocksize + u16 + u16) + u16 + u32 + size_t (yes, the math is a bit ugly).
+   size_t maxdeltasize; // maxcompsize without the two size_t. With deflate, maxcompsize grows to fit the deflated delta instead.
+   size_t maxkeysize; // maxcompsize for keyframes, which carry two deltas.
 
    unsigned entries;
    bool thisblock_valid;
+
+   unsigned head_seq; // Sequence number of the newest frame in the ring. Keyframes are placed by this.
+   unsigned keyframe_interval;
+   uint8_t *zeroblock; // Keyframes are deltas against this.
+
+   // Keyframes currently in the ring, oldest first.
+   struct state_manager_keyframe
+   {
+      size_t start;
+      unsigned seq;
+   } *keyframes;
+   size_t num_keyframes;
+   size_t num_keyframes_redo; // Keyframes past num_keyframes are in the redo region.
+   size_t keyframes_size;
+
+#ifdef HAVE_ZLIB_DEFLATE
+   // Second stage; the delta is built in deltablock, then deflated into the ring.
+   unsigned level;
+   uint8_t *deltablock;
+   z_stream deflate;
+   z_stream inflate;
+   bool deflate_init;
+   bool inflate_init;
+   size_t delta_bytes; // What the entries in the ring would take up without deflate.
+#endif
+
+#ifdef HAVE_MMAP
+   int fd;
+   uint8_t *map;
+   size_t map_size;
+#endif
+
+#ifdef HAVE_THREADS
+   // Threaded mode: push_do() only hands job_old/job_new to the worker, which compresses them into the ring.
+   // The main thread never touches the ring while a job is pending; see state_manager_flush().
+   sthread_t *thread;
+   slock_t *lock;
+   scond_t *cond;
+
+   uint8_t *spareblock; // NULL while the worker still reads it as job_old.
+   const uint8_t *job_old;
+   const uint8_t *job_new;
+   bool job_pending;
+   bool thread_quit;
+#endif
 };
 
-state_manager_t *state_manager_new(size_t state_size, size_t buffer_size)
+// Counted on the worker thread when there is one, so it's registered up front in state_manager_new().
+static struct retro_perf_counter gen_deltas = {"gen_deltas"};
+
+static void rewind_init_simd(void);
+#ifdef HAVE_THREADS
+static void state_manager_thread(void *data);
+#endif
+
+#ifdef HAVE_MMAP
+static size_t file_block_offset(void)
+{
+   return (sizeof(struct state_manager_file_header) + FILE_ALIGN - 1) & ~(FILE_ALIGN - 1);
+}
+
+static size_t file_data_offset(const state_manager_t *state)
+{
+   return file_block_offset() + ((state->blocksize + FILE_ALIGN - 1) & ~(size_t)(FILE_ALIGN - 1));
+}
+
+// Maps the history file. Returns true if it already holds a usable ring for this content.
+static bool state_manager_map(state_manager_t *state, const char *path, const char *content_id)
+{
+   state->fd = open(path, O_RDWR | O_CREAT, 0644);
+   if (state->fd < 0)
+   {
+      RARCH_ERR("Failed to open rewind history: %s (%s).\n", path, strerror(errno));
+      return false;
+   }
+
+   state->map_size = file_data_offset(state) + state->capacity;
+
+   struct stat fds;
+   bool reuse = fstat(state->fd, &fds) == 0 && (size_t)fds.st_size == state->map_size;
+   if (!reuse && ftruncate(state->fd, state->map_size) < 0)
+   {
+      RARCH_ERR("Failed to resize rewind history: %s (%s).\n", path, strerror(errno));
+      goto error;
+   }
+
+   state->map = (uint8_t*)mmap(NULL, state->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, state->fd, 0);
+   if (state->map == MAP_FAILED)
+   {
+      state->map = NULL;
+      RARCH_ERR("Failed to mmap() rewind history: %s (%s).\n", path, strerror(errno));
+      goto error;
+   }
+
+   state->data = state->map + file_data_offset(state);
+
+   struct state_manager_file_header *header = (struct state_manager_file_header*)state->map;
+   bool deflated = false;
+#ifdef HAVE_ZLIB_DEFLATE
+   deflated = state->level;
+#endif
+
+   reuse = reuse && !memcmp(header->magic, FILE_MAGIC, sizeof(header->magic)) &&
+      header->version == FILE_VERSION && header->clean &&
+      header->blocksize == state->blocksize && header->capacity == state->capacity &&
+      header->deflated == deflated && header->keyframe_interval == state->keyframe_interval && *content_id &&
+      !strncmp(header->content_id, content_id, sizeof(header->content_id));
+
+   if (!reuse)
+   {
+      memset(header, 0, sizeof(*header));
+      memcpy(header->magic, FILE_MAGIC, sizeof(header->magic));
+      header->version = FILE_VERSION;
+      header->blocksize = state->blocksize;
+      header->capacity = state->capacity;
+      header->deflated = deflated;
+      header->keyframe_interval = state->keyframe_interval;
+      strncpy(header->content_id, content_id, sizeof(header->content_id) - 1);
+   }
+
+   header->clean = 0;
+   return reuse;
+
+error:
+   close(state->fd);
+   state->fd = -1;
+   return false;
+}
+
+// Picks up where the previous session left the ring. Keyframes and the deflate statistics are rebuilt from the frames.
+static void state_manager_restore(state_manager_t *state)
+{
+   struct state_manager_file_header *header = (struct state_manager_file_header*)state->map;
+
+   memcpy(state->thisblock, state->map + file_block_offset(), state->blocksize);
+   state->thisblock_valid = header->thisblock_valid;
+   state->head = state->data + header->head;
+   state->tail = state->data + header->tail;
+   state->head_seq = header->head_seq;
+   state->entries = header->entries;
+
+   unsigned seq = state->head_seq - (state->entries - state->thisblock_valid);
+   size_t pos = header->tail;
+   while (state->data + pos != state->head)
+   {
+      uint16_t flags;
+      memcpy(&flags, state->data + pos + sizeof(size_t), sizeof(uint16_t));
+      seq++;
+
+      if ((flags & FRAME_KEYFRAME) && state->keyframe_interval)
+      {
+         if (state->num_keyframes == state->keyframes_size)
+         {
+            size_t size = state->keyframes_size ? state->keyframes_size * 2 : 16;
+            struct state_manager_keyframe *keyframes = (struct state_manager_keyframe*)
+               realloc(state->keyframes, size * sizeof(*keyframes));
+            if (!keyframes)
+               break;
+            state->keyframes = keyframes;
+            state->keyframes_size = size;
+         }
+
+         state->keyframes[state->num_keyframes].start = pos;
+         state->keyframes[state->num_keyframes].seq = seq;
+         state->num_keyframes++;
+      }
+
+#ifdef HAVE_ZLIB_DEFLATE
+      if (state->level)
+      {
+         uint32_t deltasize;
+         memcpy(&deltasize, state->data + pos + sizeof(size_t) + sizeof(uint16_t), sizeof(uint32_t));
+         state->delta_bytes += deltasize + sizeof(uint16_t) + sizeof(size_t) * 2;
+      }
+#endif
+
+      pos = read_size_t(state->data + pos);
+   }
+
+   state->num_keyframes_redo = state->num_keyframes;
+   state->redo_end = state->head;
+
+   RARCH_LOG("Restored %u rewind frames from previous session.\n", state->entries);
+}
+
+static void state_manager_unmap(state_manager_t *state)
+{
+   struct state_manager_file_header *header = (struct state_manager_file_header*)state->map;
+
+   // If we didn't get as far as setting up the ring, leave the file marked as unusable.
+   if (state->thisblock && state->head)
+   {
+      memcpy(state->map + file_block_offset(), state->thisblock, state->blocksize);
+      header->thisblock_valid = state->thisblock_valid;
+      header->head = state->head - state->data;
+      header->tail = state->tail - state->data;
+      header->head_seq = state->head_seq;
+      header->entries = state->entries;
+      header->clean = 1;
+   }
+
+   munmap(state->map, state->map_size);
+   close(state->fd);
+}
+#endif
+
+state_manager_t *state_manager_new(const struct state_manager_info *info)
 {
    state_manager_t *state = (state_manager_t*)calloc(1, sizeof(*state));
    if (!state)
       return NULL;
 
-   size_t newblocksize = ((state_size - 1) | (sizeof(uint16_t) - 1)) + 1;
-   state->blocksize = newblocksize;
+   size_t state_size = info->state_size;
+   size_t buffer_size = info->buffer_size;
+
+#ifdef HAVE_MMAP
+   bool reuse = false;
+   state->fd = -1;
+#endif
+
+   state->blocksize = state_manager_block_size(state_size);
+   state->maxdeltasize = state_manager_delta_max_size(state_size);
+   state->maxcompsize = state->maxdeltasize + sizeof(uint16_t) + sizeof(size_t) * 2;
+   state->maxkeysize = state->maxcompsize;
+   state->capacity = buffer_size;
+   state->keyframe_interval = info->keyframe_interval;
+
+#ifdef HAVE_ZLIB_DEFLATE
+   state->level = info->level > Z_BEST_COMPRESSION ? Z_BEST_COMPRESSION : info->level;
+#else
+   if (info->level)
+      RARCH_WARN("Rewind compression needs zlib with deflate support. Will rewind without it.\n");
+#endif
 
-   const int maxcblkcover = UINT16_MAX * sizeof(uint16_t);
-   const int maxcblks = (state->blocksize + maxcblkcover - 1) / maxcblkcover;
-   state->maxcompsize = state->blocksize + maxcblks * sizeof(uint16_t) * 2 + sizeof(uint16_t) + sizeof(uint32_t) + sizeof(size_t) * 2;
+   if (info->path)
+   {
+#ifdef HAVE_MMAP
+      reuse = state_manager_map(state, info->path, info->content_id ? info->content_id : "");
+#else
+      RARCH_WARN("Rewind history files are not supported on this platform.\n");
+#endif
+   }
 
-   state->data = (uint8_t*)malloc(buffer_size);
+   if (!state->data)
+      state->data = (uint8_t*)malloc(buffer_size);
 
-   state->thisblock = (uint8_t*)calloc(state->blocksize + sizeof(uint16_t) * 4 + 16, 1);
-   state->nextblock = (uint8_t*)calloc(state->blocksize + sizeof(uint16_t) * 4 + 16, 1);
+   state->thisblock = (uint8_t*)calloc(state->blocksize + BLOCK_PADDING, 1);
+   state->nextblock = (uint8_t*)calloc(state->blocksize + BLOCK_PADDING, 1);
    if (!state->data || !state->thisblock || !state->nextblock)
       goto error;
 
    // Force in a different byte at the end, so we don't need to check bounds in the innermost loop (it's expensive).
    // There is also a large amount of data that's the same, to stop the other scan
    // There is also some padding at the end. This is so we don't read outside the buffer end if we're reading in large blocks;
-   // it doesn't make any difference to us, but sacrificing 16 bytes to get Valgrind happy is worth it.
+   // it doesn't make any difference to us, but sacrificing 32 bytes to get Valgrind happy is worth it.
    *(uint16_t*)(state->thisblock + state->blocksize + sizeof(uint16_t) * 3) = 0xFFFF;
    *(uint16_t*)(state->nextblock + state->blocksize + sizeof(uint16_t) * 3) = 0x0000;
 
-   state->capacity = buffer_size;
+   rewind_init_simd();
+   rarch_perf_register(&gen_deltas);
 
    state->head = state->data + sizeof(size_t);
    state->tail = state->data + sizeof(size_t);
+   state->redo_end = state->head;
+
+   size_t maxdeltasize = state->maxdeltasize;
+   if (state->keyframe_interval)
+   {
+      state->zeroblock = (uint8_t*)calloc(state->blocksize + BLOCK_PADDING, 1);
+      if (!state->zeroblock)
+         goto error;
+      *(uint16_t*)(state->zeroblock + state->blocksize + sizeof(uint16_t) * 3) = 0xAAAA;
+
+      maxdeltasize *= 2;
+      state->maxkeysize += state->maxdeltasize;
+   }
+
+#ifdef HAVE_ZLIB_DEFLATE
+   if (state->level)
+   {
+      state->deltablock = (uint8_t*)malloc(maxdeltasize);
+      if (!state->deltablock)
+         goto error;
+
+      if (deflateInit(&state->deflate, state->level) != Z_OK)
+         goto error;
+      state->deflate_init = true;
+      if (inflateInit(&state->inflate) != Z_OK)
+         goto error;
+      state->inflate_init = true;
+
+      state->maxcompsize = deflateBound(&state->deflate, state->maxdeltasize)
+         + sizeof(uint16_t) + sizeof(uint32_t) * 2 + sizeof(size_t) * 2;
+      state->maxkeysize = deflateBound(&state->deflate, maxdeltasize)
+         + sizeof(uint16_t) + sizeof(uint32_t) * 2 + sizeof(size_t) * 2;
+   }
+#endif
+
+#ifdef HAVE_MMAP
+   if (reuse)
+      state_manager_restore(state);
+#endif
+
+#ifdef HAVE_THREADS
+   if (info->threaded)
+   {
+      // Any two of the three blocks can end up compared against each other, so they all need distinct end markers.
+      state->spareblock = (uint8_t*)calloc(state->blocksize + BLOCK_PADDING, 1);
+      if (!state->spareblock)
+         goto error;
+      *(uint16_t*)(state->spareblock + state->blocksize + sizeof(uint16_t) * 3) = 0x5555;
+
+      state->lock = slock_new();
+      state->cond = scond_new();
+      if (!state->lock || !state->cond)
+         goto error;
+
+      // If we can't get a thread, just compress synchronously.
+      state->thread = sthread_create(state_manager_thread, state);
+   }
+#endif
 
    return state;
 
@@ -133,16 +501,185 @@ error:
 
 void state_manager_free(state_manager_t *state)
 {
-   free(state->data);
+#ifdef HAVE_THREADS
+   if (state->thread)
+   {
+      slock_lock(state->lock);
+      state->thread_quit = true;
+      scond_signal(state->cond);
+      slock_unlock(state->lock);
+      sthread_join(state->thread);
+   }
+
+   if (state->lock)
+      slock_free(state->lock);
+   if (state->cond)
+      scond_free(state->cond);
+   free(state->spareblock);
+#endif
+
+#ifdef HAVE_ZLIB_DEFLATE
+   if (state->deflate_init)
+      deflateEnd(&state->deflate);
+   if (state->inflate_init)
+      inflateEnd(&state->inflate);
+   free(state->deltablock);
+#endif
+
+#ifdef HAVE_MMAP
+   if (state->map)
+      state_manager_unmap(state);
+   else
+#endif
+      free(state->data);
    free(state->thisblock);
    free(state->nextblock);
+   free(state->zeroblock);
+   free(state->keyframes);
    free(state);
 }
 
+// Applies a delta made by delta_encode() to out16, which is either of the two states it was made from.
+// Returns the end of the delta.
+static const uint16_t *delta_decode(const uint16_t *compressed16, uint16_t *out16)
+{
+   for (;;)
+   {
+      uint16_t i;
+      uint16_t numchanged = *(compressed16++);
+      if (numchanged)
+      {
+         out16 += *compressed16++;
+         // We could do memcpy, but it seems that memcpy has a constant-per-call overhead that actually shows up.
+         // Our average size in here seems to be 8 or something.
+         // Therefore, we do something with lower overhead.
+         for (i = 0; i < numchanged; i++)
+            out16[i] ^= compressed16[i];
+
+         compressed16 += numchanged;
+         out16 += numchanged;
+      }
+      else
+      {
+         uint32_t numunchanged = compressed16[0] | (compressed16[1] << 16);
+         compressed16 += 2;
+         if (!numunchanged)
+            return compressed16;
+         out16 += numunchanged;
+      }
+   }
+}
+
+// Returns the end of a delta without applying it.
+static const uint16_t *delta_skip(const uint16_t *compressed16)
+{
+   for (;;)
+   {
+      uint16_t numchanged = *(compressed16++);
+      if (numchanged)
+         compressed16 += numchanged + 1;
+      else
+      {
+         uint32_t numunchanged = compressed16[0] | (compressed16[1] << 16);
+         compressed16 += 2;
+         if (!numunchanged)
+            return compressed16;
+      }
+   }
+}
+
+// Waits until the worker has committed everything pushed so far, so the ring can be used directly.
+static inline void state_manager_flush(state_manager_t *state)
+{
+#ifdef HAVE_THREADS
+   if (!state->thread)
+      return;
+
+   slock_lock(state->lock);
+   while (state->job_pending)
+      scond_wait(state->cond, state->lock);
+   slock_unlock(state->lock);
+#else
+   (void)state;
+#endif
+}
+
+// Decodes the frame starting at 'start' into out, which must hold either neighbour of the frame in the ring.
+// If 'full' is set, the frame must be a keyframe and out can hold anything.
+static void state_manager_decode(state_manager_t *state, const uint8_t *start, uint8_t *out, bool full)
+{
+   uint16_t flags;
+   const uint8_t *compressed = start + sizeof(size_t);
+   memcpy(&flags, compressed, sizeof(uint16_t));
+   compressed += sizeof(uint16_t);
+
+#ifdef HAVE_ZLIB_DEFLATE
+   if (state->level)
+   {
+      uint32_t deltasize, zsize;
+      memcpy(&deltasize, compressed, sizeof(uint32_t));
+      memcpy(&zsize, compressed + sizeof(uint32_t), sizeof(uint32_t));
+
+      state->inflate.next_in = (Bytef*)(compressed + sizeof(uint32_t) * 2);
+      state->inflate.avail_in = zsize;
+      state->inflate.next_out = state->deltablock;
+      state->inflate.avail_out = deltasize;
+      inflateReset(&state->inflate);
+      inflate(&state->inflate, Z_FINISH);
+
+      compressed = state->deltablock;
+   }
+#endif
+
+   if (full)
+   {
+      compressed = (const uint8_t*)delta_skip((const uint16_t*)compressed);
+      memset(out, 0, state->blocksize);
+   }
+
+   delta_decode((const uint16_t*)compressed, (uint16_t*)out);
+}
+
+// Bookkeeping for the newest frame, starting at 'start', leaving the ring.
+static void state_manager_forget(state_manager_t *state, size_t start)
+{
+#ifdef HAVE_ZLIB_DEFLATE
+   if (state->level)
+   {
+      uint32_t deltasize;
+      memcpy(&deltasize, state->data + start + sizeof(size_t) + sizeof(uint16_t), sizeof(uint32_t));
+      state->delta_bytes -= deltasize + sizeof(uint16_t) + sizeof(size_t) * 2;
+   }
+#endif
+
+   if (state->num_keyframes && state->keyframes[state->num_keyframes - 1].start == start)
+      state->num_keyframes--;
+   state->head_seq--;
+}
+
+// Same as state_manager_forget(), for a frame being redone.
+static void state_manager_remember(state_manager_t *state, size_t start)
+{
+#ifdef HAVE_ZLIB_DEFLATE
+   if (state->level)
+   {
+      uint32_t deltasize;
+      memcpy(&deltasize, state->data + start + sizeof(size_t) + sizeof(uint16_t), sizeof(uint32_t));
+      state->delta_bytes += deltasize + sizeof(uint16_t) + sizeof(size_t) * 2;
+   }
+#endif
+
+   if (state->num_keyframes < state->num_keyframes_redo && state->keyframes[state->num_keyframes].start == start)
+      state->num_keyframes++;
+   state->head_seq++;
+}
+
 bool state_manager_pop(state_manager_t *state, const void **data)
 {
    *data = NULL;
 
+   state_manager_flush(state);
+
    if (state->thisblock_valid)
    {
       state->thisblock_valid = false;
@@ -155,44 +692,95 @@ bool state_manager_pop(state_manager_t *state, const void **data)
       return false;
 
    size_t start = read_size_t(state->head - sizeof(size_t));
+   state_manager_decode(state, state->data + start, state->thisblock, false);
+   state_manager_forget(state, start);
    state->head = state->data + start;
 
-   const uint8_t *compressed = state->data + start + sizeof(size_t);
-   uint8_t *out = state->thisblock;
+   state->entries--;
+   *data = state->thisblock;
+   return true;
+}
 
-   // Begin decompression code
-   // out is the last pushed (or returned) state
-   const uint16_t *compressed16 = (const uint16_t*)compressed;
-   uint16_t *out16 = (uint16_t*)out;
+bool state_manager_seek(state_manager_t *state, unsigned frames_back, const void **data)
+{
+   *data = NULL;
 
-   for (;;)
+   if (!frames_back)
+      return false;
+
+   state_manager_flush(state);
+
+   bool have_block = false;
+   if (state->thisblock_valid)
    {
-      uint16_t i;
-      uint16_t numchanged = *(compressed16++);
-      if (numchanged)
+      state->thisblock_valid = false;
+      state->entries--;
+      frames_back--;
+      have_block = true;
+   }
+
+   // thisblock_valid is clear now, so everything left in entries is in the ring.
+   if (frames_back > state->entries)
+      frames_back = state->entries;
+
+   if (frames_back)
+   {
+      unsigned target = state->head_seq - frames_back + 1;
+      size_t pos = state->head - state->data;
+      unsigned pos_seq = state->head_seq + 1;
+      size_t i;
+
+      // Decoding from the oldest keyframe at or above the target is bounded by the keyframe interval.
+      // Don't bother if walking from the head is just as short.
+      for (i = state->num_keyframes; i > 0 && state->keyframes[i - 1].seq - target < frames_back; i--);
+      if (i < state->num_keyframes && state->keyframes[i].seq - target + 1 < frames_back)
       {
-         out16 += *compressed16++;
-         // We could do memcpy, but it seems that memcpy has a constant-per-call overhead that actually shows up.
-         // Our average size in here seems to be 8 or something.
-         // Therefore, we do something with lower overhead.
-         for (i = 0; i < numchanged; i++)
-            out16[i] = compressed16[i];
+         pos = state->keyframes[i].start;
+         pos_seq = state->keyframes[i].seq;
+         state_manager_decode(state, state->data + pos, state->thisblock, true);
+      }
 
-         compressed16 += numchanged;
-         out16 += numchanged;
+      while (pos_seq != target)
+      {
+         pos = read_size_t(state->data + pos - sizeof(size_t));
+         pos_seq--;
+         state_manager_decode(state, state->data + pos, state->thisblock, false);
       }
-      else
+
+      // Account for everything we dropped. This only chases pointers, it doesn't decode.
+      size_t start = state->head - state->data;
+      while (start != pos)
       {
-         uint32_t numunchanged = compressed16[0] | (compressed16[1] << 16);
-         if (!numunchanged)
-            break;
-         compressed16 += 2;
-         out16 += numunchanged;
+         start = read_size_t(state->data + start - sizeof(size_t));
+         state_manager_forget(state, start);
       }
+
+      state->head = state->data + pos;
+      state->entries -= frames_back;
+      have_block = true;
    }
-   // End decompression code
 
-   state->entries--;
+   if (have_block)
+      *data = state->thisblock;
+   return have_block;
+}
+
+bool state_manager_redo(state_manager_t *state, const void **data)
+{
+   *data = NULL;
+
+   state_manager_flush(state);
+
+   // thisblock is only the state before the head while it's not valid.
+   if (state->thisblock_valid || state->head == state->redo_end)
+      return false;
+
+   size_t start = state->head - state->data;
+   state_manager_decode(state, state->head, state->thisblock, false);
+   state_manager_remember(state, start);
+   state->head = state->data + read_size_t(state->head);
+
+   state->entries++;
    *data = state->thisblock;
    return true;
 }
@@ -329,113 +917,378 @@ static inline size_t find_same(const uint16_t *a, const uint16_t *b)
 	return a - a_org;
 }
 
-void state_manager_push_do(state_manager_t *state)
+#ifdef REWIND_HAVE_AVX2
+// Same as the SSE2 find_change, just twice as wide.
+__attribute__((target("avx2")))
+static size_t find_change_avx2(const uint16_t *a, const uint16_t *b)
 {
-   if (state->thisblock_valid)
-   {
-      if (state->capacity < sizeof(size_t) + state->maxcompsize)
-         return;
+   const __m256i *a256 = (const __m256i*)a;
+   const __m256i *b256 = (const __m256i*)b;
 
-recheckcapacity:;
+   for (;;)
+   {
+      __m256i v0 = _mm256_loadu_si256(a256);
+      __m256i v1 = _mm256_loadu_si256(b256);
+      __m256i c = _mm256_cmpeq_epi32(v0, v1);
 
-      size_t headpos = state->head - state->data;
-      size_t tailpos = state->tail - state->data;
-      size_t remaining = (tailpos + state->capacity - sizeof(size_t) - headpos - 1) % state->capacity + 1;
-      if (remaining <= state->maxcompsize)
+      uint32_t mask = _mm256_movemask_epi8(c);
+      if (mask != 0xffffffffu)
       {
-         state->tail = state->data + read_size_t(state->tail);
-         state->entries--;
-         goto recheckcapacity;
+         size_t ret = (((uint8_t*)a256 - (uint8_t*)a) | __builtin_ctz(~mask)) >> 1;
+         return ret | (a[ret] == b[ret]);
       }
 
-      RARCH_PERFORMANCE_INIT(gen_deltas);
-      RARCH_PERFORMANCE_START(gen_deltas);
+      a256++;
+      b256++;
+   }
+}
 
-      const uint8_t *oldb = state->thisblock;
-      const uint8_t *newb = state->nextblock;
-      uint8_t *compressed = state->head + sizeof(size_t);
+// Stops at the same uint32 as the scalar find_same, so the output is identical.
+__attribute__((target("avx2")))
+static size_t find_same_avx2(const uint16_t *a, const uint16_t *b)
+{
+   const uint16_t *a_org = a;
+   const __m256i *a256 = (const __m256i*)a;
+   const __m256i *b256 = (const __m256i*)b;
 
-      // Begin compression code; 'compressed' will point to the end of the compressed data (excluding the prev pointer).
-      const uint16_t *old16 = (const uint16_t*)oldb;
-      const uint16_t *new16 = (const uint16_t*)newb;
-      uint16_t *compressed16 = (uint16_t*)compressed;
-      size_t num16s = state->blocksize / sizeof(uint16_t);
+   for (;;)
+   {
+      __m256i v0 = _mm256_loadu_si256(a256);
+      __m256i v1 = _mm256_loadu_si256(b256);
+      __m256i c = _mm256_cmpeq_epi32(v0, v1);
 
-      while (num16s)
+      uint32_t mask = _mm256_movemask_epi8(c);
+      if (mask)
       {
-         size_t i;
-         size_t skip = find_change(old16, new16);
+         a = (const uint16_t*)a256 + (__builtin_ctz(mask) >> 1);
+         b = (const uint16_t*)b256 + (__builtin_ctz(mask) >> 1);
+         break;
+      }
 
-         if (skip >= num16s)
-            break;
+      a256++;
+      b256++;
+   }
 
-         old16 += skip;
-         new16 += skip;
-         num16s -= skip;
+   if (a != a_org && a[-1] == b[-1])
+   {
+      a--;
+      b--;
+   }
+   return a - a_org;
+}
+#endif
+
+static size_t (*find_change_func)(const uint16_t *a, const uint16_t *b) = find_change;
+static size_t (*find_same_func)(const uint16_t *a, const uint16_t *b) = find_same;
+
+static void rewind_init_simd(void)
+{
+   find_change_func = find_change;
+   find_same_func = find_same;
+
+#ifdef REWIND_HAVE_AVX2
+   if (rarch_get_cpu_features() & RETRO_SIMD_AVX2)
+   {
+      find_change_func = find_change_avx2;
+      find_same_func = find_same_avx2;
+   }
+#endif
+}
+
+// Writes a delta which turns new16 into old16 and back. Returns the end of the written delta.
+static uint16_t *delta_encode(uint16_t *compressed16, const uint16_t *old16, const uint16_t *new16, size_t num16s)
+{
+   while (num16s)
+   {
+      size_t i;
+      size_t skip = find_change_func(old16, new16);
+
+      if (skip >= num16s)
+         break;
+
+      old16 += skip;
+      new16 += skip;
+      num16s -= skip;
 
-         if (skip > UINT16_MAX)
+      if (skip > UINT16_MAX)
+      {
+         if (skip > UINT32_MAX)
          {
-            if (skip > UINT32_MAX)
-            {
-               // This will make it scan the entire thing again, but it only hits on 8GB unchanged
-               // data anyways, and if you're doing that, you've got bigger problems.
-               skip = UINT32_MAX;
-            }
-            *compressed16++ = 0;
-            *compressed16++ = skip;
-            *compressed16++ = skip >> 16;
-            skip = 0;
-            continue;
+            // This will make it scan the entire thing again, but it only hits on 8GB unchanged
+            // data anyways, and if you're doing that, you've got bigger problems.
+            skip = UINT32_MAX;
          }
+         *compressed16++ = 0;
+         *compressed16++ = skip;
+         *compressed16++ = skip >> 16;
+         skip = 0;
+         continue;
+      }
 
-         size_t changed = find_same(old16, new16);
-         if (changed > UINT16_MAX)
-            changed = UINT16_MAX;
+      size_t changed = find_same_func(old16, new16);
+      if (changed > UINT16_MAX)
+         changed = UINT16_MAX;
 
-         *compressed16++ = changed;
-         *compressed16++ = skip;
+      *compressed16++ = changed;
+      *compressed16++ = skip;
+
+      for (i = 0; i < changed; i++)
+         compressed16[i] = old16[i] ^ new16[i];
+
+      old16 += changed;
+      new16 += changed;
+      num16s -= changed;
+      compressed16 += changed;
+   }
 
-         for (i = 0; i < changed; i++)
-            compressed16[i] = old16[i];
+   compressed16[0] = 0;
+   compressed16[1] = 0;
+   compressed16[2] = 0;
+   return compressed16 + 3;
+}
 
-         old16 += changed;
-         new16 += changed;
-         num16s -= changed;
-         compressed16 += changed;
+void *state_manager_block_new(size_t state_size, uint16_t marker)
+{
+   size_t blocksize = state_manager_block_size(state_size);
+   uint8_t *block = (uint8_t*)calloc(blocksize + BLOCK_PADDING, 1);
+   if (block)
+      *(uint16_t*)(block + blocksize + sizeof(uint16_t) * 3) = marker;
+   return block;
+}
+
+size_t state_manager_delta_max_size(size_t state_size)
+{
+   const size_t maxcblkcover = UINT16_MAX * sizeof(uint16_t);
+   size_t blocksize = state_manager_block_size(state_size);
+   return blocksize + (blocksize + maxcblkcover - 1) / maxcblkcover * sizeof(uint16_t) * 2 + sizeof(uint16_t) + sizeof(uint32_t);
+}
+
+size_t state_manager_delta_encode(void *delta, const void *old_block, const void *new_block, size_t state_size)
+{
+   return (uint8_t*)delta_encode((uint16_t*)delta, (const uint16_t*)old_block, (const uint16_t*)new_block,
+         state_manager_block_size(state_size) / sizeof(uint16_t)) - (uint8_t*)delta;
+}
+
+void state_manager_delta_apply(const void *delta, void *block)
+{
+   delta_decode((const uint16_t*)delta, (uint16_t*)block);
+}
+
+static void state_manager_drop_tail(state_manager_t *state)
+{
+#ifdef HAVE_ZLIB_DEFLATE
+   if (state->level)
+   {
+      uint32_t deltasize;
+      memcpy(&deltasize, state->tail + sizeof(size_t) + sizeof(uint16_t), sizeof(uint32_t));
+      state->delta_bytes -= deltasize + sizeof(uint16_t) + sizeof(size_t) * 2;
+   }
+#endif
+
+   if (state->num_keyframes && state->data + state->keyframes[0].start == state->tail)
+      memmove(state->keyframes, state->keyframes + 1, --state->num_keyframes * sizeof(*state->keyframes));
+   state->num_keyframes_redo = state->num_keyframes;
+
+   state->tail = state->data + read_size_t(state->tail);
+   state->entries--;
+}
+
+// Upper bound on the size of the frame after the head.
+static inline size_t state_manager_next_size(const state_manager_t *state)
+{
+   if (state->keyframe_interval && (state->head_seq + 1) % state->keyframe_interval == 0)
+      return state->maxkeysize;
+   return state->maxcompsize;
+}
+
+// Writes the delta(s) for one frame to out. Returns the end of what was written.
+static uint8_t *state_manager_encode(state_manager_t *state, uint8_t *out,
+      const uint8_t *oldb, const uint8_t *newb, uint16_t flags)
+{
+   size_t num16s = state->blocksize / sizeof(uint16_t);
+   uint16_t *end = delta_encode((uint16_t*)out, (const uint16_t*)oldb, (const uint16_t*)newb, num16s);
+   if (flags & FRAME_KEYFRAME)
+      end = delta_encode(end, (const uint16_t*)oldb, (const uint16_t*)state->zeroblock, num16s);
+   return (uint8_t*)end;
+}
+
+// Compresses oldb against newb and appends the result to the ring, dropping entries at the tail if needed.
+// Returns false if the buffer can't fit even a single entry.
+static bool state_manager_compress(state_manager_t *state, const uint8_t *oldb, const uint8_t *newb)
+{
+   if (state->capacity < sizeof(size_t) + state->maxkeysize)
+      return false;
+
+   // Whatever was popped is overwritten now.
+   state->num_keyframes_redo = state->num_keyframes;
+
+recheckcapacity:;
+
+   size_t headpos = state->head - state->data;
+   size_t tailpos = state->tail - state->data;
+   size_t remaining = (tailpos + state->capacity - sizeof(size_t) - headpos - 1) % state->capacity + 1;
+   if (remaining <= state_manager_next_size(state))
+   {
+      state_manager_drop_tail(state);
+      goto recheckcapacity;
+   }
+
+   RARCH_PERFORMANCE_START(gen_deltas);
+
+   uint8_t *compressed = state->head + sizeof(size_t);
+   uint16_t flags = 0;
+
+   state->head_seq++;
+   if (state->keyframe_interval && state->head_seq % state->keyframe_interval == 0)
+   {
+      // Keep track of it for seeking. If we can't, it's still a perfectly good frame.
+      if (state->num_keyframes == state->keyframes_size)
+      {
+         size_t size = state->keyframes_size ? state->keyframes_size * 2 : 16;
+         struct state_manager_keyframe *keyframes = (struct state_manager_keyframe*)
+            realloc(state->keyframes, size * sizeof(*keyframes));
+         if (keyframes)
+         {
+            state->keyframes = keyframes;
+            state->keyframes_size = size;
+         }
+      }
+
+      if (state->num_keyframes < state->keyframes_size)
+      {
+         state->keyframes[state->num_keyframes].start = state->head - state->data;
+         state->keyframes[state->num_keyframes].seq = state->head_seq;
+         state->num_keyframes_redo = ++state->num_keyframes;
       }
 
-      compressed16[0] = 0;
-      compressed16[1] = 0;
-      compressed16[2] = 0;
-      compressed = (uint8_t*)(compressed16 + 3);
-      // End compression code.
+      flags |= FRAME_KEYFRAME;
+   }
+
+   memcpy(compressed, &flags, sizeof(uint16_t));
+   compressed += sizeof(uint16_t);
 
-      if (compressed - state->data + state->maxcompsize > state->capacity)
+#ifdef HAVE_ZLIB_DEFLATE
+   if (state->level)
+   {
+      uint8_t *zdata = compressed + sizeof(uint32_t) * 2;
+      uint32_t deltasize = state_manager_encode(state, state->deltablock, oldb, newb, flags) - state->deltablock;
+      size_t maxsize = (flags & FRAME_KEYFRAME) ? state->maxkeysize : state->maxcompsize;
+
+      state->deflate.next_in = state->deltablock;
+      state->deflate.avail_in = deltasize;
+      state->deflate.next_out = zdata;
+      state->deflate.avail_out = maxsize - sizeof(uint16_t) - sizeof(uint32_t) * 2 - sizeof(size_t) * 2;
+      deflateReset(&state->deflate);
+      deflate(&state->deflate, Z_FINISH); // avail_out is deflateBound(), so this always completes.
+
+      uint32_t zsize = state->deflate.next_out - zdata;
+      memcpy(compressed, &deltasize, sizeof(uint32_t));
+      memcpy(compressed + sizeof(uint32_t), &zsize, sizeof(uint32_t));
+      compressed = zdata + zsize;
+
+      state->delta_bytes += deltasize + sizeof(uint16_t) + sizeof(size_t) * 2;
+   }
+   else
+#endif
+      compressed = state_manager_encode(state, compressed, oldb, newb, flags);
+
+   if (compressed - state->data + state_manager_next_size(state) > state->capacity)
+   {
+      compressed = state->data;
+      if (state->tail == state->data + sizeof(size_t))
+         state_manager_drop_tail(state);
+   }
+   write_size_t(compressed, state->head-state->data);
+   compressed += sizeof(size_t);
+   write_size_t(state->head, compressed-state->data);
+   state->head = compressed;
+   state->redo_end = compressed;
+
+   RARCH_PERFORMANCE_STOP(gen_deltas);
+
+   return true;
+}
+
+#ifdef HAVE_THREADS
+static void state_manager_thread(void *data)
+{
+   state_manager_t *state = (state_manager_t*)data;
+
+   slock_lock(state->lock);
+   for (;;)
+   {
+      while (!state->job_pending && !state->thread_quit)
+         scond_wait(state->cond, state->lock);
+
+      if (!state->job_pending)
+         break;
+
+      // The main thread only waits on us while a job is pending, so holding the lock here costs nothing.
+      if (!state_manager_compress(state, state->job_old, state->job_new))
+         state->entries--;
+
+      state->spareblock = (uint8_t*)state->job_old;
+      state->job_pending = false;
+      scond_signal(state->cond);
+   }
+   slock_unlock(state->lock);
+}
+
+static void state_manager_push_threaded(state_manager_t *state)
+{
+   slock_lock(state->lock);
+   while (state->job_pending)
+      scond_wait(state->cond, state->lock);
+
+   state->job_old = state->thisblock;
+   state->job_new = state->nextblock;
+   state->job_pending = true;
+
+   // job_new stays readable as thisblock, it's only overwritten by pop() which flushes first.
+   state->thisblock = state->nextblock;
+   state->nextblock = state->spareblock;
+   state->spareblock = NULL;
+
+   state->entries++;
+   scond_signal(state->cond);
+   slock_unlock(state->lock);
+}
+#endif
+
+void state_manager_push_do(state_manager_t *state)
+{
+   if (state->thisblock_valid)
+   {
+#ifdef HAVE_THREADS
+      if (state->thread)
       {
-         compressed = state->data;
-         if (state->tail == state->data + sizeof(size_t))
-            state->tail = state->data + read_size_t(state->tail);
+         state_manager_push_threaded(state);
+         return;
       }
-      write_size_t(compressed, state->head-state->data);
-      compressed += sizeof(size_t);
-      write_size_t(state->head, compressed-state->data);
-      state->head = compressed;
+#endif
 
-      RARCH_PERFORMANCE_STOP(gen_deltas);
+      if (!state_manager_compress(state, state->thisblock, state->nextblock))
+         return;
    }
    else
+   {
+      // The ring was popped empty, so this starts a new history. What was popped can't be redone on top of it.
+      state->redo_end = state->head;
+      state->num_keyframes_redo = state->num_keyframes;
       state->thisblock_valid = true;
+   }
 
    uint8_t *swap = state->thisblock;
    state->thisblock = state->nextblock;
    state->nextblock = swap;
 
    state->entries++;
-   return;
 }
 
-void state_manager_capacity(state_manager_t *state, unsigned *entries, size_t *bytes, bool *full)
+void state_manager_capacity(state_manager_t *state, unsigned *entries, size_t *bytes, size_t *delta_bytes, bool *full)
 {
+   state_manager_flush(state);
+
    size_t headpos = state->head - state->data;
    size_t tailpos = state->tail - state->data;
    size_t remaining = (tailpos + state->capacity - sizeof(size_t) - headpos - 1) % state->capacity + 1;
@@ -444,6 +1297,15 @@ void state_manager_capacity(state_manager_t *state, unsigned *entries, size_t *b
       *entries = state->entries;
    if (bytes)
       *bytes = state->capacity-remaining;
+   if (delta_bytes)
+   {
+#ifdef HAVE_ZLIB_DEFLATE
+      if (state->level)
+         *delta_bytes = state->delta_bytes;
+      else
+#endif
+         *delta_bytes = state->capacity-remaining;
+   }
    if (full)
       *full = remaining <= state->maxcompsize * 2;
 }
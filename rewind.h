@@ -17,15 +17,53 @@
 #define __RARCH_REWIND_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include "boolean.h"
 
 typedef struct state_manager state_manager_t;
 
-state_manager_t *state_manager_new(size_t state_size, size_t buffer_size);
+struct state_manager_info
+{
+   size_t state_size;
+   size_t buffer_size;
+
+   // If set, push_do() hands the state to a worker thread which does the delta compression.
+   bool threaded;
+
+   // Deflate level (1-9) used on top of the deltas. 0 disables deflate, as does building without zlib.
+   unsigned level;
+
+   // Every keyframe_interval frames a complete state is stored, which bounds the cost of state_manager_seek().
+   // 0 disables keyframes.
+   unsigned keyframe_interval;
+
+   // If set, the buffer is memory mapped from this file and kept when the state manager is freed.
+   // The history in it is picked up again if content_id matches and the other parameters didn't change.
+   const char *path;
+   const char *content_id;
+};
+
+state_manager_t *state_manager_new(const struct state_manager_info *info);
 void state_manager_free(state_manager_t *state);
 bool state_manager_pop(state_manager_t *state, const void **data);
+// Same as calling state_manager_pop() frames_back times, but decodes at most keyframe_interval frames.
+// If there are fewer than frames_back frames, it stops at the oldest one. Returns false if there was nothing to pop.
+bool state_manager_seek(state_manager_t *state, unsigned frames_back, const void **data);
+// Undoes the last pop, returning the state that was current before it. Frames can be redone until the next push_do().
+// Returns false if there is nothing to redo.
+bool state_manager_redo(state_manager_t *state, const void **data);
 void state_manager_push_where(state_manager_t *state, void **data);
 void state_manager_push_do(state_manager_t *state);
-void state_manager_capacity(state_manager_t *state, unsigned int *entries, size_t *bytes, bool *full);
+
+// The XOR delta coding the rewind buffer is made of, for other code keeping a history of states (netplay).
+// Deltas can only be made between blocks from state_manager_block_new() with different markers; free blocks with free().
+// Applying a delta to either of the two blocks it was made from gives the other one.
+void *state_manager_block_new(size_t state_size, uint16_t marker);
+size_t state_manager_delta_max_size(size_t state_size);
+size_t state_manager_delta_encode(void *delta, const void *old_block, const void *new_block, size_t state_size);
+void state_manager_delta_apply(const void *delta, void *block);
+
+// bytes is what the ring currently uses. delta_bytes is what it would use without deflate; bytes / delta_bytes is the deflate ratio.
+void state_manager_capacity(state_manager_t *state, unsigned int *entries, size_t *bytes, size_t *delta_bytes, bool *full);
 
 #endif
@@ -330,14 +330,22 @@ void config_set_defaults(void)
    g_settings.audio.sync = audio_sync;
    g_settings.audio.rate_control = rate_control;
    g_settings.audio.rate_control_delta = rate_control_delta;
+   g_settings.audio.rate_control_integral = rate_control_integral;
    g_settings.audio.volume = audio_volume;
    g_extern.audio_data.volume_db   = g_settings.audio.volume;
    g_extern.audio_data.volume_gain = db_to_gain(g_settings.audio.volume);
    strlcpy(g_settings.audio.resampler, audio_resampler, sizeof(g_settings.audio.resampler));
+   g_settings.audio.resampler_quality = audio_resampler_quality;
+   g_settings.audio.threaded_process = audio_threaded_process;
 
    g_settings.rewind_enable = rewind_enable;
    g_settings.rewind_buffer_size = rewind_buffer_size;
    g_settings.rewind_granularity = rewind_granularity;
+   g_settings.rewind_granularity_auto = rewind_granularity_auto;
+   g_settings.rewind_threaded = rewind_threaded;
+   g_settings.rewind_compression = rewind_compression;
+   g_settings.rewind_keyframe_interval = rewind_keyframe_interval;
+   g_settings.rewind_history_persist = rewind_history_persist;
    g_settings.slowmotion_ratio = slowmotion_ratio;
    g_settings.fastforward_ratio = fastforward_ratio;
    g_settings.pause_nonactive = pause_nonactive;
@@ -389,6 +397,9 @@ void config_set_defaults(void)
 
    g_settings.input.axis_threshold = axis_threshold;
    g_settings.input.netplay_client_swap_input = netplay_client_swap_input;
+   g_settings.netplay_checkpoint_interval = netplay_checkpoint_interval;
+   g_settings.netplay_input_delay_max = netplay_input_delay_max;
+   g_settings.netplay_check_frames = netplay_check_frames;
    g_settings.input.turbo_period = turbo_period;
    g_settings.input.turbo_duty_cycle = turbo_duty_cycle;
 
@@ -947,6 +958,9 @@ bool config_load_file(const char *path, bool set_defaults)
 
    CONFIG_GET_FLOAT(input.axis_threshold, "input_axis_threshold");
    CONFIG_GET_BOOL(input.netplay_client_swap_input, "netplay_client_swap_input");
+   CONFIG_GET_INT(netplay_checkpoint_interval, "netplay_checkpoint_interval");
+   CONFIG_GET_INT(netplay_input_delay_max, "netplay_input_delay_max");
+   CONFIG_GET_INT(netplay_check_frames, "netplay_check_frames");
 
    for (i = 0; i < MAX_PLAYERS; i++)
    {
@@ -973,8 +987,11 @@ bool config_load_file(const char *path, bool set_defaults)
    CONFIG_GET_BOOL(audio.sync, "audio_sync");
    CONFIG_GET_BOOL(audio.rate_control, "audio_rate_control");
    CONFIG_GET_FLOAT(audio.rate_control_delta, "audio_rate_control_delta");
+   CONFIG_GET_FLOAT(audio.rate_control_integral, "audio_rate_control_integral");
    CONFIG_GET_FLOAT(audio.volume, "audio_volume");
    CONFIG_GET_STRING(audio.resampler, "audio_resampler");
+   CONFIG_GET_INT(audio.resampler_quality, "audio_resampler_quality");
+   CONFIG_GET_BOOL(audio.threaded_process, "audio_threaded_process");
    g_extern.audio_data.volume_db   = g_settings.audio.volume;
    g_extern.audio_data.volume_gain = db_to_gain(g_settings.audio.volume);
 
@@ -1068,6 +1085,11 @@ bool config_load_file(const char *path, bool set_defaults)
       g_settings.rewind_buffer_size = buffer_size * UINT64_C(1000000);
 
    CONFIG_GET_INT(rewind_granularity, "rewind_granularity");
+   CONFIG_GET_BOOL(rewind_granularity_auto, "rewind_granularity_auto");
+   CONFIG_GET_BOOL(rewind_threaded, "rewind_threaded");
+   CONFIG_GET_INT(rewind_compression, "rewind_compression");
+   CONFIG_GET_INT(rewind_keyframe_interval, "rewind_keyframe_interval");
+   CONFIG_GET_BOOL(rewind_history_persist, "rewind_history_persist");
    CONFIG_GET_FLOAT(slowmotion_ratio, "slowmotion_ratio");
    if (g_settings.slowmotion_ratio < 1.0f)
       g_settings.slowmotion_ratio = 1.0f;
@@ -1360,6 +1382,11 @@ bool config_save_file(const char *path)
    config_set_bool(conf,  "audio_sync",    g_settings.audio.sync);
    config_set_int(conf,   "audio_block_frames", g_settings.audio.block_frames);
    config_set_int(conf,   "rewind_granularity", g_settings.rewind_granularity);
+   config_set_bool(conf,  "rewind_granularity_auto", g_settings.rewind_granularity_auto);
+   config_set_bool(conf,  "rewind_threaded", g_settings.rewind_threaded);
+   config_set_int(conf,   "rewind_compression", g_settings.rewind_compression);
+   config_set_int(conf,   "rewind_keyframe_interval", g_settings.rewind_keyframe_interval);
+   config_set_bool(conf,  "rewind_history_persist", g_settings.rewind_history_persist);
    config_set_path(conf,  "video_shader", g_settings.video.shader_path);
    config_set_bool(conf,  "video_shader_enable", g_settings.video.shader_enable);
    config_set_float(conf, "video_aspect_ratio", g_settings.video.aspect_ratio);
@@ -1398,6 +1425,7 @@ bool config_save_file(const char *path)
 #endif
    config_set_bool(conf, "audio_rate_control", g_settings.audio.rate_control);
    config_set_float(conf, "audio_rate_control_delta", g_settings.audio.rate_control_delta);
+   config_set_float(conf, "audio_rate_control_integral", g_settings.audio.rate_control_integral);
    config_set_string(conf, "audio_driver", g_settings.audio.driver);
    config_set_int(conf, "audio_out_rate", g_settings.audio.out_rate);
 
@@ -1411,6 +1439,8 @@ bool config_save_file(const char *path)
    config_set_path(conf, "system_directory", *g_settings.system_directory ? g_settings.system_directory : "default");
    config_set_path(conf, "extraction_directory", g_settings.extraction_directory);
    config_set_string(conf, "audio_resampler", g_settings.audio.resampler);
+   config_set_int(conf, "audio_resampler_quality", g_settings.audio.resampler_quality);
+   config_set_bool(conf, "audio_threaded_process", g_settings.audio.threaded_process);
    config_set_path(conf, "savefile_directory", *g_extern.savefile_dir ? g_extern.savefile_dir : "default");
    config_set_path(conf, "savestate_directory", *g_extern.savestate_dir ? g_extern.savestate_dir : "default");
    config_set_path(conf, "video_shader_dir", *g_settings.video.shader_dir ? g_settings.video.shader_dir : "default");
@@ -1480,6 +1510,9 @@ bool config_save_file(const char *path)
    config_set_string(conf, "netplay_ip_address", g_extern.netplay_server);
    config_set_int(conf, "netplay_ip_port", g_extern.netplay_port);
    config_set_int(conf, "netplay_delay_frames", g_extern.netplay_sync_frames);
+   config_set_int(conf, "netplay_checkpoint_interval", g_settings.netplay_checkpoint_interval);
+   config_set_int(conf, "netplay_input_delay_max", g_settings.netplay_input_delay_max);
+   config_set_int(conf, "netplay_check_frames", g_settings.netplay_check_frames);
 #endif
 
    bool custom_bgm_enable_val = g_extern.lifecycle_state & (1ULL << MODE_AUDIO_CUSTOM_BGM_ENABLE);
@@ -429,6 +429,8 @@ static void general_change_handler(const void *data)
     }
     else if (!strcmp(setting->name, "rewind_granularity"))
         g_settings.rewind_granularity = *setting->value.unsigned_integer;
+    else if (!strcmp(setting->name, "rewind_granularity_auto"))
+        g_settings.rewind_granularity_auto = *setting->value.boolean;
     else if (!strcmp(setting->name, "block_sram_overwrite"))
         g_settings.block_sram_overwrite = *setting->value.boolean;
     else if (!strcmp(setting->name, "video_smooth"))
@@ -842,6 +844,7 @@ rarch_setting_t* setting_data_get_list(void)
          CONFIG_BOOL(g_settings.rewind_enable,              "rewind_enable",              "Rewind",                     rewind_enable, GROUP_NAME, SUBGROUP_NAME, general_change_handler)
          //CONFIG_SIZE(g_settings.rewind_buffer_size,          "rewind_buffer_size",         "Rewind Buffer Size",       rewind_buffer_size, GROUP_NAME, SUBGROUP_NAME, general_change_handler)
          CONFIG_UINT(g_settings.rewind_granularity,         "rewind_granularity",         "Rewind Granularity",         rewind_granularity, GROUP_NAME, SUBGROUP_NAME, general_change_handler) WITH_RANGE(1, 32768)
+         CONFIG_BOOL(g_settings.rewind_granularity_auto,    "rewind_granularity_auto",    "Rewind Granularity Auto",    rewind_granularity_auto, GROUP_NAME, SUBGROUP_NAME, general_change_handler)
          CONFIG_BOOL(g_settings.block_sram_overwrite,       "block_sram_overwrite",       "SRAM Block overwrite",       block_sram_overwrite, GROUP_NAME, SUBGROUP_NAME, general_change_handler)
 #ifdef HAVE_THREADS
          CONFIG_UINT(g_settings.autosave_interval,          "autosave_interval",          "SRAM Autosave",          autosave_interval, GROUP_NAME, SUBGROUP_NAME, general_change_handler)
@@ -964,6 +967,7 @@ rarch_setting_t* setting_data_get_list(void)
          CONFIG_BOOL(g_settings.audio.sync,                 "audio_sync",                 "Audio Sync Enable",                audio_sync, GROUP_NAME, SUBGROUP_NAME, general_change_handler)
          CONFIG_UINT(g_settings.audio.latency,              "audio_latency",              "Audio Latency",                    g_defaults.settings.out_latency ? g_defaults.settings.out_latency : out_latency, GROUP_NAME, SUBGROUP_NAME, general_change_handler)
          CONFIG_FLOAT(g_settings.audio.rate_control_delta,  "audio_rate_control_delta",   "Audio Rate Control Delta",         rate_control_delta, GROUP_NAME, SUBGROUP_NAME, general_change_handler)
+         CONFIG_FLOAT(g_settings.audio.rate_control_integral, "audio_rate_control_integral", "Audio Rate Control Integral",    rate_control_integral, GROUP_NAME, SUBGROUP_NAME, general_change_handler)
          CONFIG_UINT(g_settings.audio.block_frames,         "audio_block_frames",         "Block Frames",               0, GROUP_NAME, SUBGROUP_NAME, general_change_handler)
          END_SUB_GROUP()
 
@@ -0,0 +1,843 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Runs a netplay host and client against the libretro-test core over localhost and reports
+// how much rollback work netplay.c ends up doing.
+// Each peer lives in its own process since the core and g_extern are global,
+// and every UDP packet netplay sends goes through a shim which can delay, jitter and drop it.
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <time.h>
+
+static ssize_t shim_sendto(int fd, const void *buf, size_t len, int flags,
+      const struct sockaddr *addr, socklen_t addrlen);
+
+#define sendto shim_sendto
+#include "../../netplay.c"
+#undef sendto
+
+#include "../../thread.h"
+#include "../../performance.h"
+#include <stdio.h>
+#include <getopt.h>
+
+struct global g_extern;
+struct settings g_settings;
+driver_t driver;
+
+struct bench_options
+{
+   uint16_t port;
+   unsigned delay_frames;
+   unsigned frames;
+   unsigned fps;
+   unsigned latency_ms;
+   unsigned jitter_ms;
+   unsigned loss_percent;
+   unsigned checkpoint_interval;
+   unsigned input_delay_max;
+   unsigned check_frames;
+   unsigned state_padding;
+   unsigned desync_frame;
+   unsigned seed;
+   unsigned spectators;
+   unsigned slow_spectators;
+};
+
+static struct bench_options opts = {
+   55435, // port
+   4,     // delay_frames
+   1200,  // frames
+   60,    // fps
+   0,     // latency_ms
+   0,     // jitter_ms
+   0,     // loss_percent
+   1,     // checkpoint_interval
+   0,     // input_delay_max
+   30,    // check_frames
+   0,     // state_padding
+   0,     // desync_frame
+   1,     // seed
+   0,     // spectators
+   0,     // slow_spectators
+};
+
+struct bench_stats
+{
+   unsigned frames;
+   unsigned rollbacks;
+   unsigned replayed_frames;
+   unsigned serializes;
+   retro_time_t serialize_usec;
+   unsigned unserializes;
+   retro_time_t unserialize_usec;
+   unsigned confirmed;
+   retro_time_t confirm_usec;
+   retro_time_t confirm_max_usec;
+   unsigned packets_sent;
+   unsigned packets_dropped;
+   retro_time_t frame_usec;
+   retro_time_t frame_max_usec;
+   unsigned stalls;
+   retro_time_t stall_usec;
+   retro_time_t wall_usec;
+   bool disconnected;
+   struct netplay_stats netplay;
+};
+
+// Shared between the two peers so the host can print both sides and neither hangs up early.
+struct bench_shared
+{
+   volatile int done[2];
+   struct bench_stats stats[2];
+
+   // Spectators: time from connecting until the whole join state is in.
+   unsigned joins;
+   retro_time_t join_usec;
+   retro_time_t join_max_usec;
+};
+
+static struct bench_shared *shared;
+static struct bench_stats *stats;
+static bool bench_client;
+static uint32_t rng_state;
+
+static uint32_t bench_rand(void)
+{
+   rng_state ^= rng_state << 13;
+   rng_state ^= rng_state >> 17;
+   rng_state ^= rng_state << 5;
+   return rng_state;
+}
+
+// UDP shim. Packets are queued with a due time and sent by a separate thread
+// so a peer blocking in poll_input() still gets delayed packets delivered.
+#define SHIM_MAX_PACKETS 1024
+
+struct shim_packet
+{
+   retro_time_t due;
+   int fd;
+   struct sockaddr_storage addr;
+   socklen_t addrlen;
+   size_t len;
+   uint8_t data[UDP_PACKET_WORDS * sizeof(uint32_t)];
+};
+
+static struct shim_packet shim_queue[SHIM_MAX_PACKETS];
+static unsigned shim_count;
+static slock_t *shim_lock;
+static sthread_t *shim_thread;
+static volatile bool shim_quit;
+
+static ssize_t shim_sendto(int fd, const void *buf, size_t len, int flags,
+      const struct sockaddr *addr, socklen_t addrlen)
+{
+   struct shim_packet *pkt;
+   int64_t offset;
+
+   stats->packets_sent++;
+   if (bench_rand() % 100 < opts.loss_percent)
+   {
+      stats->packets_dropped++;
+      return len;
+   }
+
+   if (!opts.latency_ms && !opts.jitter_ms)
+      return sendto(fd, buf, len, flags, addr, addrlen);
+
+   offset = opts.latency_ms * 1000;
+   if (opts.jitter_ms)
+      offset += (int64_t)(bench_rand() % (2 * opts.jitter_ms * 1000 + 1)) - opts.jitter_ms * 1000;
+   if (offset < 0)
+      offset = 0;
+
+   slock_lock(shim_lock);
+   if (shim_count == SHIM_MAX_PACKETS || len > sizeof(pkt->data))
+   {
+      slock_unlock(shim_lock);
+      stats->packets_dropped++;
+      return len;
+   }
+
+   pkt = &shim_queue[shim_count++];
+   pkt->due = rarch_get_time_usec() + offset;
+   pkt->fd = fd;
+   memcpy(&pkt->addr, addr, addrlen);
+   pkt->addrlen = addrlen;
+   pkt->len = len;
+   memcpy(pkt->data, buf, len);
+   slock_unlock(shim_lock);
+
+   return len;
+}
+
+static void shim_thread_loop(void *data)
+{
+   (void)data;
+   struct timespec tv = { 0, 250 * 1000 };
+
+   while (!shim_quit)
+   {
+      unsigned i;
+      retro_time_t now = rarch_get_time_usec();
+
+      slock_lock(shim_lock);
+      for (i = 0; i < shim_count; )
+      {
+         struct shim_packet *pkt = &shim_queue[i];
+         if (pkt->due > now)
+         {
+            i++;
+            continue;
+         }
+
+         sendto(pkt->fd, pkt->data, pkt->len, 0, (const struct sockaddr*)&pkt->addr, pkt->addrlen);
+         *pkt = shim_queue[--shim_count];
+      }
+      slock_unlock(shim_lock);
+
+      nanosleep(&tv, NULL);
+   }
+}
+
+// Core glue. Hooks serialization and retro_run() so the replay work can be counted.
+// The test core's state is tiny, so it can be padded out to what a real core saves.
+static uint8_t *state_padding;
+
+static size_t bench_serialize_size(void)
+{
+   return retro_serialize_size() + opts.state_padding;
+}
+
+static bool bench_serialize(void *data, size_t size)
+{
+   retro_time_t start = rarch_get_time_usec();
+   bool ret = retro_serialize(data, size);
+   if (ret && opts.state_padding && size >= bench_serialize_size())
+      memcpy((uint8_t*)data + retro_serialize_size(), state_padding, opts.state_padding);
+   stats->serialize_usec += rarch_get_time_usec() - start;
+   stats->serializes++;
+   return ret;
+}
+
+static bool bench_unserialize(const void *data, size_t size)
+{
+   retro_time_t start = rarch_get_time_usec();
+   bool ret = retro_unserialize(data, size);
+   stats->unserialize_usec += rarch_get_time_usec() - start;
+   stats->unserializes++;
+   return ret;
+}
+
+// Optionally makes the client's core go off on its own once, the way a core which isn't deterministic would.
+static void bench_run(void)
+{
+   netplay_t *handle = g_extern.netplay;
+   if (handle && handle->is_replay)
+      stats->replayed_frames++;
+   retro_run();
+
+   if (bench_client && opts.desync_frame && handle &&
+         (handle->is_replay ? handle->tmp_frame_count : handle->frame_count) == opts.desync_frame)
+   {
+      uint8_t state[2];
+      retro_serialize(state, sizeof(state));
+      state[0]++;
+      retro_unserialize(state, sizeof(state));
+   }
+}
+
+void (*pretro_run)(void) = bench_run;
+bool (*pretro_serialize)(void*, size_t) = bench_serialize;
+bool (*pretro_unserialize)(const void*, size_t) = bench_unserialize;
+size_t (*pretro_serialize_size)(void) = bench_serialize_size;
+unsigned (*pretro_api_version)(void) = retro_api_version;
+void *(*pretro_get_memory_data)(unsigned) = retro_get_memory_data;
+size_t (*pretro_get_memory_size)(unsigned) = retro_get_memory_size;
+void (*pretro_set_input_state)(retro_input_state_t) = retro_set_input_state;
+
+void msg_queue_push(msg_queue_t *queue, const char *msg, unsigned prio, unsigned duration)
+{
+   (void)queue;
+   (void)msg;
+   (void)prio;
+   (void)duration;
+}
+
+void msg_queue_clear(msg_queue_t *queue)
+{
+   (void)queue;
+}
+
+void lock_autosave(void)
+{}
+
+void unlock_autosave(void)
+{}
+
+// The test core logs every input it sees, which would drown the report.
+static void bench_log(enum retro_log_level level, const char *fmt, ...)
+{
+   (void)level;
+   (void)fmt;
+}
+
+static bool bench_environment(unsigned cmd, void *data)
+{
+   switch (cmd)
+   {
+      case RETRO_ENVIRONMENT_SET_PIXEL_FORMAT:
+         return true;
+
+      case RETRO_ENVIRONMENT_GET_LOG_INTERFACE:
+         ((struct retro_log_callback*)data)->log = bench_log;
+         return true;
+
+      default:
+         return false;
+   }
+}
+
+static void bench_frame(const void *data, unsigned width, unsigned height, size_t pitch)
+{}
+
+static void bench_sample(int16_t left, int16_t right)
+{}
+
+static size_t bench_sample_batch(const int16_t *data, size_t frames)
+{
+   return frames;
+}
+
+static void bench_poll(void)
+{}
+
+// Roughly how someone plays: a direction is held for a while, A is tapped now and then
+// and B is held down for longer stretches. Enough change to cause rollbacks without being pure noise.
+static uint16_t held_buttons;
+static unsigned direction_timer, tap_timer, hold_timer;
+
+static void update_buttons(void)
+{
+   const uint16_t directions = (1 << RETRO_DEVICE_ID_JOYPAD_UP) | (1 << RETRO_DEVICE_ID_JOYPAD_DOWN) |
+      (1 << RETRO_DEVICE_ID_JOYPAD_LEFT) | (1 << RETRO_DEVICE_ID_JOYPAD_RIGHT);
+
+   if (!direction_timer--)
+   {
+      held_buttons &= ~directions;
+      if (bench_rand() % 3)
+         held_buttons |= 1 << (RETRO_DEVICE_ID_JOYPAD_UP + bench_rand() % 4);
+      direction_timer = 20 + bench_rand() % 60;
+   }
+
+   if (!tap_timer--)
+   {
+      held_buttons ^= 1 << RETRO_DEVICE_ID_JOYPAD_A;
+      if (held_buttons & (1 << RETRO_DEVICE_ID_JOYPAD_A))
+         tap_timer = 2 + bench_rand() % 3;
+      else
+         tap_timer = 10 + bench_rand() % 30;
+   }
+
+   if (!hold_timer--)
+   {
+      held_buttons ^= 1 << RETRO_DEVICE_ID_JOYPAD_B;
+      hold_timer = 30 + bench_rand() % 90;
+   }
+}
+
+static int16_t bench_input(unsigned port, unsigned device, unsigned index, unsigned id)
+{
+   (void)port;
+   (void)index;
+   if (device != RETRO_DEVICE_JOYPAD)
+      return 0;
+   return (held_buttons >> id) & 1;
+}
+
+// Input to confirm latency: time from sampling our input for a frame until
+// the other side's input for the same frame has arrived.
+#define CONFIRM_RING 4096
+static retro_time_t input_time[CONFIRM_RING];
+static uint32_t confirmed_frame;
+
+static void update_confirmed(netplay_t *handle)
+{
+   retro_time_t now = rarch_get_time_usec();
+   uint32_t limit = handle->read_frame_count < handle->frame_count ?
+      handle->read_frame_count : handle->frame_count;
+
+   for (; confirmed_frame < limit; confirmed_frame++)
+   {
+      // Frame 0 is never sent over the wire.
+      if (confirmed_frame == 0)
+         continue;
+
+      retro_time_t latency = now - input_time[confirmed_frame % CONFIRM_RING];
+      stats->confirm_usec += latency;
+      if (latency > stats->confirm_max_usec)
+         stats->confirm_max_usec = latency;
+      stats->confirmed++;
+   }
+}
+
+static void wait_frame(retro_time_t *deadline)
+{
+   if (!opts.fps)
+      return;
+
+   *deadline += 1000000 / opts.fps;
+   retro_time_t now = rarch_get_time_usec();
+   if (*deadline > now)
+   {
+      struct timespec tv;
+      tv.tv_sec = (*deadline - now) / 1000000;
+      tv.tv_nsec = ((*deadline - now) % 1000000) * 1000;
+      nanosleep(&tv, NULL);
+   }
+   else
+      *deadline = now;
+}
+
+static const struct retro_callbacks bench_cbs = {
+   bench_frame,
+   bench_sample,
+   bench_sample_batch,
+   bench_input,
+};
+
+static bool init_core(retro_input_state_t state_cb)
+{
+   struct retro_system_info info;
+   retro_get_system_info(&info);
+   g_extern.system.info = info;
+   g_settings.netplay_checkpoint_interval = opts.checkpoint_interval;
+   g_settings.netplay_input_delay_max = opts.input_delay_max;
+   g_settings.netplay_check_frames = opts.check_frames;
+
+   // Same on both sides. Compresses about as well as a typical state, mostly zeroes with some noise.
+   if (opts.state_padding)
+   {
+      unsigned i;
+      uint32_t seed = 1;
+      state_padding = (uint8_t*)calloc(1, opts.state_padding);
+      if (!state_padding)
+         return false;
+      for (i = 0; i < opts.state_padding / 4; i++)
+      {
+         seed = seed * 1664525u + 1013904223u;
+         state_padding[i] = seed >> 24;
+      }
+   }
+
+   retro_set_environment(bench_environment);
+   retro_init();
+   retro_set_video_refresh(video_frame_net);
+   retro_set_audio_sample(audio_sample_net);
+   retro_set_audio_sample_batch(audio_sample_batch_net);
+   retro_set_input_poll(bench_poll);
+   retro_set_input_state(state_cb);
+   return retro_load_game(NULL);
+}
+
+// Frames which took this long count as stalls, like when both sides wait on input the other one lost.
+#define STALL_USEC 100000
+
+static void update_frame_time(unsigned frame, retro_time_t frame_start)
+{
+   retro_time_t frame_usec = rarch_get_time_usec() - frame_start;
+   if (frame >= opts.frames)
+      return;
+
+   stats->frame_usec += frame_usec;
+   if (frame_usec > stats->frame_max_usec)
+      stats->frame_max_usec = frame_usec;
+   if (frame_usec >= STALL_USEC)
+   {
+      stats->stalls++;
+      stats->stall_usec += frame_usec;
+   }
+}
+
+static int run_peer(bool host)
+{
+   unsigned i;
+   unsigned side = host ? 0 : 1;
+   netplay_t *handle = NULL;
+
+   stats = &shared->stats[side];
+   bench_client = !host;
+   rng_state = opts.seed * 2654435761u + side + 1;
+
+   if (!init_core(input_state_net))
+      return 1;
+
+   shim_lock = slock_new();
+   shim_thread = sthread_create(shim_thread_loop, NULL);
+   if (!shim_lock || !shim_thread)
+      return 1;
+
+   if (!netplay_init_network())
+      return 1;
+
+   // The client may come up before the host listens.
+   for (i = 0; i < (host ? 1 : 50) && !handle; i++)
+   {
+      if (!host)
+         usleep(100 * 1000);
+      handle = netplay_new(host ? NULL : "127.0.0.1", opts.port,
+            opts.delay_frames, &bench_cbs, false, host ? "host" : "client");
+   }
+
+   if (!handle)
+   {
+      fprintf(stderr, "[%s] Failed to set up netplay.\n", host ? "host" : "client");
+      return 1;
+   }
+   g_extern.netplay = handle;
+
+   retro_time_t start = rarch_get_time_usec();
+   retro_time_t deadline = start;
+
+   // Keep running after our own measured frames until the other side is done as well,
+   // otherwise it could block forever on input we never send.
+   for (i = 0; !shared->done[!side] || i < opts.frames; i++)
+   {
+      update_buttons();
+
+      if (i == opts.frames)
+      {
+         stats->frames = opts.frames;
+         stats->wall_usec = rarch_get_time_usec() - start;
+         shared->done[side] = 1;
+      }
+
+      retro_time_t frame_start = rarch_get_time_usec();
+      input_time[handle->frame_count % CONFIRM_RING] = frame_start;
+      netplay_pre_frame(handle);
+      update_confirmed(handle);
+
+      unsigned replayed = stats->replayed_frames;
+      bench_run();
+      netplay_post_frame(handle);
+      if (stats->replayed_frames != replayed)
+         stats->rollbacks++;
+
+      update_frame_time(i, frame_start);
+
+      if (!handle->has_connection)
+      {
+         // Once both sides are done, the other one hanging up is how this ends.
+         if (!shared->done[!side])
+            stats->disconnected = true;
+         break;
+      }
+
+      wait_frame(&deadline);
+   }
+
+   if (!shared->done[side])
+   {
+      stats->frames = i;
+      stats->wall_usec = rarch_get_time_usec() - start;
+      shared->done[side] = 1;
+   }
+
+   netplay_get_stats(handle, &stats->netplay);
+
+   shim_quit = true;
+   sthread_join(shim_thread);
+   slock_free(shim_lock);
+
+   g_extern.netplay = NULL;
+   netplay_free(handle);
+   retro_unload_game();
+   retro_deinit();
+   return stats->disconnected ? 1 : 0;
+}
+
+// Spectators are forked off as raw TCP clients which do the handshake and then either read
+// everything the host sends or never read anything at all.
+static int run_spectator(unsigned index, bool slow)
+{
+   unsigned i;
+   int fd = -1;
+   struct sockaddr_in addr = {0};
+   addr.sin_family = AF_INET;
+   addr.sin_port = htons(opts.port);
+   addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+   // Stagger joins over the run so their cost shows up in the host's frame times.
+   usleep((100 + index * 1000 / (opts.spectators + 1)) * 1000);
+
+   for (i = 0; i < 50 && fd < 0; i++)
+   {
+      fd = socket(AF_INET, SOCK_STREAM, 0);
+      if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+      {
+         close(fd);
+         fd = -1;
+         usleep(100 * 1000);
+      }
+   }
+
+   if (fd < 0)
+      return 1;
+
+   retro_time_t start = rarch_get_time_usec();
+   char nick[32];
+   snprintf(nick, sizeof(nick), "spectator%u", index);
+   uint8_t nick_size = strlen(nick);
+   if (!send_all(fd, &nick_size, sizeof(nick_size)) || !send_all(fd, nick, nick_size))
+      return 1;
+
+   // Host nick, BSV header and whether the state is deflated, then the state in chunks until an empty one.
+   if (!slow)
+   {
+      uint8_t buf[STATE_CHUNK_SIZE];
+      uint32_t header[5];
+      uint32_t chunk_size;
+
+      if (!recv_all(fd, &nick_size, sizeof(nick_size)) || !recv_all(fd, buf, nick_size) ||
+            !recv_all(fd, header, sizeof(header)))
+         return 1;
+
+      do
+      {
+         if (!recv_all(fd, &chunk_size, sizeof(chunk_size)))
+            return 1;
+         chunk_size = ntohl(chunk_size);
+         if (chunk_size > sizeof(buf) || !recv_all(fd, buf, chunk_size))
+            return 1;
+      } while (chunk_size);
+
+      retro_time_t join_usec = rarch_get_time_usec() - start;
+      __sync_fetch_and_add(&shared->joins, 1);
+      __sync_fetch_and_add(&shared->join_usec, join_usec);
+      retro_time_t max = shared->join_max_usec;
+      while (join_usec > max && !__sync_bool_compare_and_swap(&shared->join_max_usec, max, join_usec))
+         max = shared->join_max_usec;
+   }
+
+   while (!shared->done[0])
+   {
+      if (slow)
+         usleep(10 * 1000);
+      else
+      {
+         uint8_t buf[4096];
+         if (recv(fd, buf, sizeof(buf), 0) <= 0)
+            break;
+      }
+   }
+
+   close(fd);
+   return 0;
+}
+
+static int run_spectate_host(void)
+{
+   unsigned i;
+
+   stats = &shared->stats[0];
+   rng_state = opts.seed * 2654435761u + 1;
+
+   if (!init_core(input_state_spectate) || !netplay_init_network())
+      return 1;
+
+   netplay_t *handle = netplay_new(NULL, opts.port, 0, &bench_cbs, true, "host");
+   if (!handle)
+   {
+      fprintf(stderr, "[host] Failed to set up spectating.\n");
+      return 1;
+   }
+   g_extern.netplay = handle;
+
+   retro_time_t start = rarch_get_time_usec();
+   retro_time_t deadline = start;
+
+   for (i = 0; i < opts.frames; i++)
+   {
+      update_buttons();
+
+      retro_time_t frame_start = rarch_get_time_usec();
+      netplay_pre_frame(handle);
+      retro_run();
+      netplay_post_frame(handle);
+      update_frame_time(i, frame_start);
+
+      wait_frame(&deadline);
+   }
+
+   stats->frames = opts.frames;
+   stats->wall_usec = rarch_get_time_usec() - start;
+   shared->done[0] = 1;
+
+   g_extern.netplay = NULL;
+   netplay_free(handle);
+   retro_unload_game();
+   retro_deinit();
+   return 0;
+}
+
+static void print_stats(const char *ident, const struct bench_stats *s)
+{
+   double secs = s->wall_usec / 1000000.0;
+   if (secs <= 0.0)
+      secs = 1.0;
+
+   printf("%-7s frames=%u rollbacks=%u rollbacks_per_sec=%.2f replayed_frames=%u "
+         "serializes=%u serialize_usec_avg=%.3f unserializes=%u unserialize_usec_avg=%.3f "
+         "confirm_ms_avg=%.2f confirm_ms_max=%.2f frame_ms_avg=%.3f frame_ms_max=%.2f stalls=%u stall_ms=%.0f packets=%u dropped=%u "
+         "predicted=%llu mispredicted=%llu input_delay=%u rtt_frames=%.1f "
+         "hashed_states=%llu hash_usec_avg=%.3f desyncs=%llu resyncs=%llu%s\n",
+         ident, s->frames, s->rollbacks, s->rollbacks / secs, s->replayed_frames,
+         s->serializes, s->serializes ? (double)s->serialize_usec / s->serializes : 0.0,
+         s->unserializes, s->unserializes ? (double)s->unserialize_usec / s->unserializes : 0.0,
+         s->confirmed ? s->confirm_usec / 1000.0 / s->confirmed : 0.0,
+         s->confirm_max_usec / 1000.0,
+         s->frames ? s->frame_usec / 1000.0 / s->frames : 0.0, s->frame_max_usec / 1000.0,
+         s->stalls, s->stall_usec / 1000.0,
+         s->packets_sent, s->packets_dropped,
+         (unsigned long long)s->netplay.predicted_frames, (unsigned long long)s->netplay.mispredicted_frames,
+         s->netplay.input_delay, s->netplay.rtt_frames,
+         (unsigned long long)s->netplay.hashed_states,
+         s->netplay.hashed_states ? (double)s->netplay.hash_usec / s->netplay.hashed_states : 0.0,
+         (unsigned long long)s->netplay.desyncs, (unsigned long long)s->netplay.resyncs,
+         s->disconnected ? " DISCONNECTED" : "");
+}
+
+static void print_help(void)
+{
+   puts("Usage: netplay-loopback [options]");
+   puts("  -p, --port <port>       Port to use on localhost (default 55435).");
+   puts("  -F, --frames <n>        Netplay delay frames (default 4).");
+   puts("  -n, --count <n>         Frames to run on each peer (default 1200).");
+   puts("  -r, --fps <n>           Frame rate to pace each peer at, 0 to run unpaced (default 60).");
+   puts("  -l, --latency <ms>      One way latency added to every UDP packet.");
+   puts("  -j, --jitter <ms>       Random +/- jitter added on top of the latency.");
+   puts("  -d, --drop <percent>    Percentage of UDP packets to drop.");
+   puts("  -c, --checkpoint <n>    Netplay checkpoint interval during replay (default 1).");
+   puts("  -D, --input-delay <n>   Most input delay netplay may add (default 0).");
+   puts("  -C, --check <n>         Frames between desync checks, 0 to disable (default 30).");
+   puts("  -z, --state-size <n>    Bytes to pad the core's save state with.");
+   puts("  -X, --desync <frame>    Make the client's core desync on this frame.");
+   puts("  -s, --seed <n>          Seed for input and network simulation (default 1).");
+   puts("  -S, --spectators <n>    Host in spectator mode and connect this many spectators instead.");
+   puts("  -w, --slow <n>          How many of the spectators never read anything.");
+}
+
+int main(int argc, char *argv[])
+{
+   const struct option long_opts[] = {
+      { "port", 1, NULL, 'p' },
+      { "frames", 1, NULL, 'F' },
+      { "count", 1, NULL, 'n' },
+      { "fps", 1, NULL, 'r' },
+      { "latency", 1, NULL, 'l' },
+      { "jitter", 1, NULL, 'j' },
+      { "drop", 1, NULL, 'd' },
+      { "checkpoint", 1, NULL, 'c' },
+      { "input-delay", 1, NULL, 'D' },
+      { "check", 1, NULL, 'C' },
+      { "state-size", 1, NULL, 'z' },
+      { "desync", 1, NULL, 'X' },
+      { "seed", 1, NULL, 's' },
+      { "spectators", 1, NULL, 'S' },
+      { "slow", 1, NULL, 'w' },
+      { "help", 0, NULL, 'h' },
+      { NULL, 0, NULL, 0 },
+   };
+
+   int c;
+   while ((c = getopt_long(argc, argv, "p:F:n:r:l:j:d:c:D:C:z:X:s:S:w:h", long_opts, NULL)) != -1)
+   {
+      switch (c)
+      {
+         case 'p': opts.port = strtoul(optarg, NULL, 0); break;
+         case 'F': opts.delay_frames = strtoul(optarg, NULL, 0); break;
+         case 'n': opts.frames = strtoul(optarg, NULL, 0); break;
+         case 'r': opts.fps = strtoul(optarg, NULL, 0); break;
+         case 'l': opts.latency_ms = strtoul(optarg, NULL, 0); break;
+         case 'j': opts.jitter_ms = strtoul(optarg, NULL, 0); break;
+         case 'd': opts.loss_percent = strtoul(optarg, NULL, 0); break;
+         case 'c': opts.checkpoint_interval = strtoul(optarg, NULL, 0); break;
+         case 'D': opts.input_delay_max = strtoul(optarg, NULL, 0); break;
+         case 'C': opts.check_frames = strtoul(optarg, NULL, 0); break;
+         case 'z': opts.state_padding = strtoul(optarg, NULL, 0); break;
+         case 'X': opts.desync_frame = strtoul(optarg, NULL, 0); break;
+         case 's': opts.seed = strtoul(optarg, NULL, 0); break;
+         case 'S': opts.spectators = strtoul(optarg, NULL, 0); break;
+         case 'w': opts.slow_spectators = strtoul(optarg, NULL, 0); break;
+         case 'h': print_help(); return 0;
+         default: print_help(); return 1;
+      }
+   }
+
+   shared = (struct bench_shared*)mmap(NULL, sizeof(*shared), PROT_READ | PROT_WRITE,
+         MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+   if (shared == MAP_FAILED)
+      return 1;
+   memset(shared, 0, sizeof(*shared));
+
+   if (opts.spectators)
+   {
+      unsigned i;
+      int ret;
+      for (i = 0; i < opts.spectators; i++)
+      {
+         pid_t pid = fork();
+         if (pid < 0)
+            return 1;
+         if (pid == 0)
+            return run_spectator(i, i < opts.slow_spectators);
+      }
+
+      ret = run_spectate_host();
+      for (i = 0; i < opts.spectators; i++)
+         wait(NULL);
+
+      printf("spectators=%u slow=%u state_size=%u joins=%u join_ms_avg=%.2f join_ms_max=%.2f\n",
+            opts.spectators, opts.slow_spectators, (unsigned)bench_serialize_size(), shared->joins,
+            shared->joins ? shared->join_usec / 1000.0 / shared->joins : 0.0, shared->join_max_usec / 1000.0);
+      print_stats("host", &shared->stats[0]);
+      return ret;
+   }
+
+   pid_t pid = fork();
+   if (pid < 0)
+      return 1;
+   if (pid == 0)
+      return run_peer(false);
+
+   int ret = run_peer(true);
+   int status = 0;
+   waitpid(pid, &status, 0);
+   if (!WIFEXITED(status) || WEXITSTATUS(status))
+      ret = 1;
+
+   printf("delay_frames=%u latency_ms=%u jitter_ms=%u drop_percent=%u checkpoint_interval=%u input_delay_max=%u "
+         "check_frames=%u state_size=%u desync_frame=%u\n",
+         opts.delay_frames, opts.latency_ms, opts.jitter_ms, opts.loss_percent, opts.checkpoint_interval,
+         opts.input_delay_max, opts.check_frames, (unsigned)bench_serialize_size(), opts.desync_frame);
+   print_stats("host", &shared->stats[0]);
+   print_stats("client", &shared->stats[1]);
+   return ret;
+}
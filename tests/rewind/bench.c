@@ -0,0 +1,128 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ * 
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Benchmarks the rewind delta scanners on synthetic savestates.
+// rewind.c is included directly so every compiled-in scanner can be timed on the same data.
+
+#include "../../rewind.c"
+#include <stdio.h>
+
+struct global g_extern;
+
+struct scanner
+{
+   const char *ident;
+   size_t (*find_change)(const uint16_t *a, const uint16_t *b);
+   size_t (*find_same)(const uint16_t *a, const uint16_t *b);
+   unsigned simd;
+};
+
+static const struct scanner scanners[] = {
+#if __SSE2__
+   { "sse2", find_change, find_same, 0 },
+#else
+   { "c", find_change, find_same, 0 },
+#endif
+#ifdef REWIND_HAVE_AVX2
+   { "avx2", find_change_avx2, find_same_avx2, RETRO_SIMD_AVX2 },
+#endif
+};
+
+// Roughly what a frame does to a savestate: a few short runs of changed words, the rest untouched.
+static void mutate(uint8_t *block, size_t size, unsigned runs)
+{
+   unsigned i, j;
+   for (i = 0; i < runs; i++)
+   {
+      size_t pos = rand() % (size - 64);
+      unsigned len = 1 + rand() % 32;
+      for (j = 0; j < len; j++)
+         block[pos + j] ^= 1 + rand() % 255;
+   }
+}
+
+static uint8_t *alloc_block(size_t size, uint16_t marker)
+{
+   uint8_t *block = (uint8_t*)calloc(size + BLOCK_PADDING, 1);
+   if (block)
+      *(uint16_t*)(block + size + sizeof(uint16_t) * 3) = marker;
+   return block;
+}
+
+int main(int argc, char *argv[])
+{
+   static const size_t sizes[] = { 100 * 1024, 512 * 1024, 2 * 1024 * 1024 };
+   unsigned iterations = argc > 1 ? strtoul(argv[1], NULL, 0) : 200;
+   uint64_t cpu = rarch_get_cpu_features();
+   unsigned s, k, i;
+
+   for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+   {
+      size_t size = sizes[s];
+      size_t maxdelta = size * 2 + 64;
+      uint8_t *oldb = alloc_block(size, 0xffff);
+      uint8_t *newb = alloc_block(size, 0x0000);
+      uint16_t *delta = (uint16_t*)malloc(maxdelta);
+      uint16_t *ref = (uint16_t*)malloc(maxdelta);
+      size_t ref_size = 0;
+
+      if (!oldb || !newb || !delta || !ref)
+         return 1;
+
+      srand(size);
+      for (i = 0; i < size; i++)
+         oldb[i] = rand() & 0x0f ? 0 : rand();
+      memcpy(newb, oldb, size);
+      mutate(newb, size, size / 1024);
+
+      for (k = 0; k < sizeof(scanners) / sizeof(scanners[0]); k++)
+      {
+         if (scanners[k].simd && !(cpu & scanners[k].simd))
+            continue;
+
+         find_change_func = scanners[k].find_change;
+         find_same_func = scanners[k].find_same;
+
+         size_t delta_size = (uint8_t*)delta_encode(delta,
+               (const uint16_t*)oldb, (const uint16_t*)newb, size / sizeof(uint16_t)) - (uint8_t*)delta;
+         if (k == 0)
+         {
+            memcpy(ref, delta, delta_size);
+            ref_size = delta_size;
+         }
+         else if (delta_size != ref_size || memcmp(ref, delta, delta_size))
+         {
+            fprintf(stderr, "%s: delta differs from %s!\n", scanners[k].ident, scanners[0].ident);
+            return 1;
+         }
+
+         retro_time_t start = rarch_get_time_usec();
+         for (i = 0; i < iterations; i++)
+            delta_encode(delta, (const uint16_t*)oldb, (const uint16_t*)newb, size / sizeof(uint16_t));
+         retro_time_t usec = rarch_get_time_usec() - start;
+
+         printf("%-5s %5u KiB state, %6u KiB delta: %9.2f us/state, %8.1f MB/s\n",
+               scanners[k].ident, (unsigned)(size / 1024), (unsigned)(delta_size / 1024),
+               (double)usec / iterations, (double)size * iterations / (usec ? usec : 1));
+      }
+
+      free(oldb);
+      free(newb);
+      free(delta);
+      free(ref);
+   }
+
+   return 0;
+}
@@ -0,0 +1,136 @@
+/*  RetroArch - A frontend for libretro.
+ *  Copyright (C) 2010-2014 - Hans-Kristian Arntzen
+ *
+ *  RetroArch is free software: you can redistribute it and/or modify it under the terms
+ *  of the GNU General Public License as published by the Free Software Found-
+ *  ation, either version 3 of the License, or (at your option) any later version.
+ *
+ *  RetroArch is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+ *  without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+ *  PURPOSE.  See the GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along with RetroArch.
+ *  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Checks that redo only ever hands back states that were pushed, in every rewind mode.
+// In particular after rewinding to the end of the buffer and playing on from there.
+
+#include "../../rewind.c"
+#include <stdio.h>
+
+struct global g_extern;
+
+#define TEST_STATE_SIZE 4096
+#define TEST_BUFFER_SIZE (256 * 1024)
+
+static int failed;
+
+static void fill_state(uint8_t *block, unsigned frame)
+{
+   unsigned i;
+   for (i = 0; i < TEST_STATE_SIZE; i++)
+      block[i] = (i % 61 == 0) ? frame * 7 + i : i;
+}
+
+static void push(state_manager_t *state, unsigned frame)
+{
+   void *data;
+   state_manager_push_where(state, &data);
+   fill_state((uint8_t*)data, frame);
+   state_manager_push_do(state);
+}
+
+static bool check(const char *mode, const char *what, const void *data, unsigned frame)
+{
+   static uint8_t expected[TEST_STATE_SIZE];
+   fill_state(expected, frame);
+   if (!data || memcmp(data, expected, TEST_STATE_SIZE))
+   {
+      fprintf(stderr, "FAILED [%s]: %s isn't frame %u.\n", mode, what, frame);
+      failed = 1;
+      return false;
+   }
+   return true;
+}
+
+static void test_mode(bool threaded, unsigned level, unsigned keyframe_interval)
+{
+   struct state_manager_info info = { TEST_STATE_SIZE, TEST_BUFFER_SIZE, threaded, level, keyframe_interval };
+   const void *data;
+   char mode[64];
+   unsigned i;
+
+   snprintf(mode, sizeof(mode), "threaded %d, level %u, keyframes %u", threaded, level, keyframe_interval);
+
+   state_manager_t *state = state_manager_new(&info);
+   if (!state)
+   {
+      fprintf(stderr, "FAILED [%s]: state_manager_new().\n", mode);
+      failed = 1;
+      return;
+   }
+
+   for (i = 0; i < 100; i++)
+      push(state, i);
+
+   // Rewind to the end of the buffer, then play one frame and rewind it again.
+   // Nothing was pushed on top of it, so there is nothing to redo.
+   while (state_manager_pop(state, &data));
+   push(state, 1000);
+   if (state_manager_pop(state, &data))
+      check(mode, "pop after empty", data, 1000);
+   if (state_manager_redo(state, &data))
+   {
+      fprintf(stderr, "FAILED [%s]: redo after popping back to empty returned a stale frame.\n", mode);
+      failed = 1;
+   }
+
+   // Same after seeking all the way back.
+   for (i = 0; i < 100; i++)
+      push(state, 2000 + i);
+   state_manager_seek(state, 1000, &data);
+   push(state, 3000);
+   state_manager_pop(state, &data);
+   if (state_manager_redo(state, &data))
+   {
+      fprintf(stderr, "FAILED [%s]: redo after seeking back to empty returned a stale frame.\n", mode);
+      failed = 1;
+   }
+
+   // A new history built from empty redoes exactly what was pushed on it.
+   for (i = 0; i < 20; i++)
+      push(state, 4000 + i);
+   for (i = 0; i < 10; i++)
+      state_manager_pop(state, &data);
+   check(mode, "pop", data, 4010);
+   for (i = 1; i < 10; i++)
+   {
+      char what[32];
+      snprintf(what, sizeof(what), "redo %u", i);
+      if (!state_manager_redo(state, &data) || !check(mode, what, data, 4010 + i))
+         break;
+   }
+   if (i == 10 && state_manager_redo(state, &data))
+   {
+      fprintf(stderr, "FAILED [%s]: redo went past the newest frame.\n", mode);
+      failed = 1;
+   }
+
+   state_manager_free(state);
+}
+
+int main(void)
+{
+   static const unsigned keyframe_intervals[] = { 0, 7, 60 };
+   unsigned t, l, k;
+
+   for (t = 0; t < 2; t++)
+      for (l = 0; l < 2; l++)
+         for (k = 0; k < sizeof(keyframe_intervals) / sizeof(keyframe_intervals[0]); k++)
+            test_mode(t, l ? 6 : 0, keyframe_intervals[k]);
+
+   if (!failed)
+      printf("All redo tests passed.\n");
+   return failed;
+}